@@ -0,0 +1,81 @@
+/**
+ * This example compares the cost of the floating point and fixed point analog APIs. On boards without a floating
+ * point unit such as AVR, every call to getCurrentFloat pays for a software float division, and each comparison
+ * a software float compare. The fixed point methods, getCurrentFixed and setCurrentFixed, do the same work with
+ * integer shifts. The results are printed to serial as the average micros per operation.
+ */
+
+#include <IoAbstraction.h>
+#include <AnalogDeviceAbstraction.h>
+#include <TaskManagerIO.h>
+
+// This is the input pin where analog input is received.
+#define ANALOG_IN_PIN A0
+
+// the number of iterations for each part of the benchmark
+#define ITERATIONS 1000
+
+AnalogDevice* analog = internalAnalogIo();
+
+// volatile to stop the compiler optimising away the work being measured
+volatile int triggerCount = 0;
+unsigned int rawValues[16];
+
+void printResult(const char* name, unsigned long start) {
+    unsigned long taken = micros() - start;
+    Serial.print(name);
+    Serial.print(": ");
+    Serial.print(float(taken) / ITERATIONS);
+    Serial.println("us per operation");
+}
+
+void runBenchmark() {
+    // capture some real readings first, so that the pure maths benchmarks below don't include conversion time.
+    for(int i = 0; i < 16; i++) rawValues[i] = analog->getCurrentValue(ANALOG_IN_PIN);
+    int bits = analog->getBitDepth(DIR_IN, ANALOG_IN_PIN);
+    float maxValue = float(analog->getMaximumRange(DIR_IN, ANALOG_IN_PIN));
+
+    // the maths that AnalogInEvent does on every poll, scale the reading then compare to a threshold.
+    unsigned long start = micros();
+    for(int i = 0; i < ITERATIONS; i++) {
+        float reading = float(rawValues[i % 16]) / maxValue;
+        if(reading > 0.75F) triggerCount++;
+    }
+    printResult("Float scale and compare", start);
+
+    analogfixed_t fixedThreshold = analogFixedFromFloat(0.75F);
+    start = micros();
+    for(int i = 0; i < ITERATIONS; i++) {
+        analogfixed_t reading = analogScaleToFixed(rawValues[i % 16], bits);
+        if(reading > fixedThreshold) triggerCount++;
+    }
+    printResult("Fixed scale and compare", start);
+
+    // and the same again, including the conversion on the device.
+    start = micros();
+    for(int i = 0; i < ITERATIONS; i++) {
+        if(analog->getCurrentFloat(ANALOG_IN_PIN) > 0.75F) triggerCount++;
+    }
+    printResult("getCurrentFloat with conversion", start);
+
+    start = micros();
+    for(int i = 0; i < ITERATIONS; i++) {
+        if(analog->getCurrentFixed(ANALOG_IN_PIN) > fixedThreshold) triggerCount++;
+    }
+    printResult("getCurrentFixed with conversion", start);
+}
+
+void setup() {
+    Serial.begin(115200);
+    while(!Serial);
+
+    analog->initPin(ANALOG_IN_PIN, DIR_IN);
+
+    // run the benchmark every ten seconds
+    runBenchmark();
+    taskManager.scheduleFixedRate(10, runBenchmark, TIME_SECONDS);
+}
+
+void loop() {
+    taskManager.runLoop();
+}
@@ -59,6 +59,9 @@ void setup() {
     keyLayout.setColPin(1, 27);
     keyLayout.setColPin(2, 28);
 
+    // If the row pins support interrupts, scanning can stop altogether while no keys are pressed.
+    //keyboard.setUsingIdleInterrupt(true);
+
     // create the keyboard mapped to arduino pins and with the layout chosen above.
     // it will callback our listener
     keyboard.initialise(arduinoIo, &keyLayout, &myListener);
@@ -36,6 +36,8 @@ void setup() {
     // step 1. run with calibration off and get the actual min and max values if corrections need to be made
     // step 2. put the corrections into the value below, xmin, xmax, ymin, ymax and try the program again.
     touchScreen.calibrateMinMaxValues(0.15F, 0.75F, 0.06F, 0.91F);
+    // optionally, when Y+ is interrupt capable, stop polling while untouched and wake on an interrupt instead.
+    // touchScreen.setUsingTouchWake(true);
     touchScreen.start();
 
     SPI.begin();
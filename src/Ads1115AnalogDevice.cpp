@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "Ads1115AnalogDevice.h"
+#include "IoLogging.h"
+
+// the time for one conversion at each data rate, with the 10% oscillator tolerance from the datasheet added
+static const uint32_t adsConversionMicros[] = { 137500UL, 68750UL, 34375UL, 17188UL, 8594UL, 4400UL, 2316UL, 1280UL };
+
+Ads1115AnalogDevice::Ads1115AnalogDevice(uint8_t address, Ads1115Gain gain, Ads1115DataRate rate, WireType wireImpl) {
+    this->wireImpl = wireImpl;
+    this->address = address;
+    this->gain = gain;
+    this->dataRate = rate;
+    this->conversionCount = 0;
+    this->conversionTask = TASKMGR_INVALIDID;
+    this->enabledChannels = 0;
+    this->convertingChannel = -1;
+    this->running = false;
+    this->errorOccurred = false;
+    for(auto& r : results) r = 0;
+}
+
+int Ads1115AnalogDevice::getMaximumRange(AnalogDirection direction, pinid_t /*pin*/) {
+    return direction == DIR_IN ? 32767 : 0;
+}
+
+int Ads1115AnalogDevice::getBitDepth(AnalogDirection direction, pinid_t /*pin*/) {
+    return direction == DIR_IN ? 15 : 0;
+}
+
+uint32_t Ads1115AnalogDevice::getConversionMicros() const {
+    return adsConversionMicros[dataRate & 0x07];
+}
+
+void Ads1115AnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
+    if(direction != DIR_IN || pin >= ADS1115_CHANNELS) {
+        serdebugF2("ADS1115 only supports input on pins 0-3, pin ", pin);
+        return;
+    }
+    bitSet(enabledChannels, pin);
+    if(!running) {
+        running = true;
+        convertingChannel = -1;
+        conversionTask = taskManager.execute(this);
+    }
+}
+
+void Ads1115AnalogDevice::stop() {
+    if(conversionTask != TASKMGR_INVALIDID) taskManager.cancelTask(conversionTask);
+    conversionTask = TASKMGR_INVALIDID;
+    running = false;
+}
+
+unsigned int Ads1115AnalogDevice::getCurrentValue(pinid_t pin) {
+    if(pin >= ADS1115_CHANNELS) return 0;
+    int16_t val = results[pin];
+    return val < 0 ? 0 : (unsigned int)val;
+}
+
+float Ads1115AnalogDevice::getCurrentFloat(pinid_t pin) {
+    return float(getCurrentValue(pin)) / 32767.0F;
+}
+
+int8_t Ads1115AnalogDevice::nextChannel(int8_t current) const {
+    for(int8_t i = 1; i <= ADS1115_CHANNELS; i++) {
+        int8_t ch = int8_t((current + i) % ADS1115_CHANNELS);
+        if(ch < 0) ch = int8_t(ch + ADS1115_CHANNELS);
+        if(bitRead(enabledChannels, ch)) return ch;
+    }
+    return -1;
+}
+
+void Ads1115AnalogDevice::startConversion(uint8_t channel) {
+    uint16_t config = ADS1115_CFG_START | ADS1115_CFG_MUX_SINGLE | ((uint16_t)channel << 12U)
+                      | ((uint16_t)gain << 9U) | ADS1115_CFG_SINGLE_SHOT | ((uint16_t)dataRate << 5U)
+                      | ADS1115_CFG_COMP_DISABLED;
+    if(!writeRegister(ADS1115_CONFIG_REG, config)) errorOccurred = true;
+}
+
+void Ads1115AnalogDevice::exec() {
+    conversionTask = TASKMGR_INVALIDID;
+
+    // collect the result of the conversion that has just finished
+    if(convertingChannel >= 0) {
+        uint16_t raw;
+        if(readRegister(ADS1115_CONVERSION_REG, raw)) {
+            results[convertingChannel] = (int16_t)raw;
+            conversionCount++;
+        }
+        else errorOccurred = true;
+    }
+
+    // and immediately start the next one, coming back when it will be ready
+    convertingChannel = nextChannel(convertingChannel);
+    if(convertingChannel < 0) {
+        running = false;
+        return;
+    }
+    startConversion(convertingChannel);
+    conversionTask = taskManager.scheduleOnce(getConversionMicros(), this, TIME_MICROS);
+}
+
+bool Ads1115AnalogDevice::writeRegister(uint8_t reg, uint16_t value) {
+    uint8_t data[3];
+    data[0] = reg;
+    data[1] = uint8_t(value >> 8U);
+    data[2] = uint8_t(value);
+    return ioaWireWriteWithRetry(wireImpl, address, data, sizeof data);
+}
+
+bool Ads1115AnalogDevice::readRegister(uint8_t reg, uint16_t& value) {
+    uint8_t data[2];
+    if(!ioaWireWriteWithRetry(wireImpl, address, &reg, 1, 0, false)) return false;
+    if(!ioaWireRead(wireImpl, address, data, sizeof data)) return false;
+    value = ((uint16_t)data[0] << 8U) | data[1];
+    return true;
+}
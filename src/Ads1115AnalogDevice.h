@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _ADS1115_ANALOG_DEVICE_H_
+#define _ADS1115_ANALOG_DEVICE_H_
+
+/**
+ * @file Ads1115AnalogDevice.h
+ *
+ * Contains an AnalogDevice for the ADS1115 family of I2C analog to digital converters, conversions run in the
+ * background on task manager so that reading a value never waits on the bus.
+ */
+
+#include "PlatformDeterminationWire.h"
+#include "AnalogDeviceAbstraction.h"
+#include "TaskManagerIO.h"
+
+/** the number of single ended inputs on the device */
+#define ADS1115_CHANNELS 4
+/** the default I2C address with the ADDR pin connected to ground */
+#define ADS1115_DEFAULT_ADDRESS 0x48
+
+/** the register that holds the last conversion result */
+#define ADS1115_CONVERSION_REG 0x00
+/** the configuration register that selects the channel and starts conversions */
+#define ADS1115_CONFIG_REG 0x01
+
+/** in the config register, writing this bit starts a single conversion */
+#define ADS1115_CFG_START 0x8000U
+/** in the config register, single ended channel 0, add the channel number shifted by 12 for the others */
+#define ADS1115_CFG_MUX_SINGLE 0x4000U
+/** in the config register, single shot mode */
+#define ADS1115_CFG_SINGLE_SHOT 0x0100U
+/** in the config register, the comparator is disabled */
+#define ADS1115_CFG_COMP_DISABLED 0x0003U
+
+/**
+ * The full scale range of the programmable gain amplifier, the single ended reading is always 0..32767 across
+ * 0V to this voltage. Never set the range above the supply voltage.
+ */
+enum Ads1115Gain : uint8_t {
+    ADS1115_GAIN_6_144V, ADS1115_GAIN_4_096V, ADS1115_GAIN_2_048V,
+    ADS1115_GAIN_1_024V, ADS1115_GAIN_0_512V, ADS1115_GAIN_0_256V
+};
+
+/**
+ * The data rate of the converter in samples per second, faster rates have more noise.
+ */
+enum Ads1115DataRate : uint8_t {
+    ADS1115_RATE_8SPS, ADS1115_RATE_16SPS, ADS1115_RATE_32SPS, ADS1115_RATE_64SPS,
+    ADS1115_RATE_128SPS, ADS1115_RATE_250SPS, ADS1115_RATE_475SPS, ADS1115_RATE_860SPS
+};
+
+/**
+ * An AnalogDevice for the ADS1115 16 bit I2C ADC, input only. Each pin that is initialised with initPin(pin, DIR_IN)
+ * is added to a round robin of conversions that runs on task manager. As soon as the result of one channel is read,
+ * the conversion of the next channel is started, so the converter is kept busy and no time is spent polling.
+ * getCurrentValue and getCurrentFloat return the latest result from a cache without touching the bus, so they are
+ * safe to call from anywhere. Each conversion costs one register read and one config write, and with N channels
+ * each value is refreshed at roughly the data rate / N.
+ *
+ * Single ended inputs read between 0 and 32767, anything below ground is reported as 0. As usual, Wire must be
+ * started before the first pin is initialised.
+ *
+ * Example: `Ads1115AnalogDevice adc(0x48); adc.initPin(0, DIR_IN); ... adc.getCurrentValue(0);`
+ */
+class Ads1115AnalogDevice : public AnalogDevice, public Executable {
+private:
+    WireType wireImpl;
+    int16_t results[ADS1115_CHANNELS];
+    uint32_t conversionCount;
+    taskid_t conversionTask;
+    uint8_t address;
+    uint8_t enabledChannels;
+    int8_t convertingChannel;
+    Ads1115Gain gain;
+    Ads1115DataRate dataRate;
+    bool running;
+    bool errorOccurred;
+public:
+    /**
+     * Create the device at the given address, with a gain and data rate that are used for all channels.
+     * @param address the I2C address, usually between 0x48 and 0x4B
+     * @param gain the full scale range
+     * @param rate the conversion rate
+     * @param wireImpl the wire instance to use, defaults to the standard one
+     */
+    explicit Ads1115AnalogDevice(uint8_t address = ADS1115_DEFAULT_ADDRESS, Ads1115Gain gain = ADS1115_GAIN_4_096V,
+                                 Ads1115DataRate rate = ADS1115_RATE_860SPS, WireType wireImpl = defaultWireTypePtr);
+
+    int getMaximumRange(AnalogDirection direction, pinid_t pin) override;
+    int getBitDepth(AnalogDirection direction, pinid_t pin) override;
+
+    /**
+     * Adds an input to the round robin, the conversions start from the first call. Outputs are not supported.
+     */
+    void initPin(pinid_t pin, AnalogDirection direction) override;
+
+    /** @return the latest result for the pin from the cache, this does not use the bus */
+    unsigned int getCurrentValue(pinid_t pin) override;
+    float getCurrentFloat(pinid_t pin) override;
+    void setCurrentValue(pinid_t, unsigned int) override { }
+    void setCurrentFloat(pinid_t, float) override { }
+
+    /**
+     * Stop the round robin, the last results remain available. Calling initPin again restarts it.
+     */
+    void stop();
+
+    /** @return true while the background conversions are scheduled */
+    bool isRunning() const { return running; }
+
+    /** @return the number of conversions completed, useful to know when fresh values are available */
+    uint32_t getConversionCount() const { return conversionCount; }
+
+    /** @return the time that a single conversion takes in micros at the configured rate, including a margin */
+    uint32_t getConversionMicros() const;
+
+    /**
+     * This indicates if an I2C error has occurred at any point since the last call.
+     * Side effect: Every call clears it's state.
+     */
+    bool hasErrorOccurred() {
+        bool ret = errorOccurred;
+        errorOccurred = false;
+        return ret;
+    }
+
+    /** called by task manager when the current conversion has completed */
+    void exec() override;
+
+protected:
+    /**
+     * Writes a 16 bit register on the device, overridden to simulate the device in tests.
+     * @return true if the device acknowledged the write
+     */
+    virtual bool writeRegister(uint8_t reg, uint16_t value);
+
+    /**
+     * Reads a 16 bit register from the device by setting the register pointer and then reading with a repeated
+     * start, overridden to simulate the device in tests.
+     * @return true if the read succeeded
+     */
+    virtual bool readRegister(uint8_t reg, uint16_t& value);
+
+private:
+    void startConversion(uint8_t channel);
+    int8_t nextChannel(int8_t current) const;
+};
+
+#endif //_ADS1115_ANALOG_DEVICE_H_
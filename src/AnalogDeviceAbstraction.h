@@ -21,6 +21,53 @@
  */
 enum AnalogDirection { DIR_IN, DIR_OUT, DIR_PWM };
 
+/**
+ * An unsigned fixed point fraction in Q0.16 format representing 0 to 1, where 0 is 0.0 and ANALOG_FIXED_MAX is full
+ * scale. It is the integer alternative to the float methods, for boards without a floating point unit.
+ */
+typedef uint16_t analogfixed_t;
+
+/** the full scale value of an analogfixed_t, equivalent to 1.0 */
+#define ANALOG_FIXED_MAX 0xffffU
+
+/**
+ * Scales a raw value of a given bit depth up to a fixed point fraction, the bits are replicated into the lower
+ * bits so that full scale on the device maps exactly to ANALOG_FIXED_MAX. There is no division involved.
+ * @param value the raw value
+ * @param bits the bit depth of the raw value
+ * @return the fixed point equivalent
+ */
+inline analogfixed_t analogScaleToFixed(unsigned int value, uint8_t bits) {
+    if(bits == 0) return 0;
+    if(bits >= 16) return analogfixed_t(value >> (bits - 16));
+    uint32_t result = uint32_t(value) << (16 - bits);
+    for(uint8_t shift = bits; shift < 16; shift <<= 1) result |= result >> shift;
+    return analogfixed_t(result);
+}
+
+/**
+ * Scales a fixed point fraction down to a raw value of a given bit depth.
+ * @param value the fixed point value
+ * @param bits the bit depth of the raw value
+ * @return the raw equivalent
+ */
+inline unsigned int analogScaleFromFixed(analogfixed_t value, uint8_t bits) {
+    if(bits >= 16) return (unsigned int)(uint32_t(value) << (bits - 16));
+    return value >> (16 - bits);
+}
+
+/** convert a float between 0 and 1 to fixed point, clamping out of range values */
+inline analogfixed_t analogFixedFromFloat(float value) {
+    if(value <= 0.0F) return 0;
+    if(value >= 1.0F) return ANALOG_FIXED_MAX;
+    return analogfixed_t(value * float(ANALOG_FIXED_MAX));
+}
+
+/** convert a fixed point value to a float between 0 and 1 */
+inline float analogFixedToFloat(analogfixed_t value) {
+    return float(value) * (1.0F / float(ANALOG_FIXED_MAX));
+}
+
 /**
  * Describes an analog device that has commands to both read values from and write values to
  * a device. Not all devices will support both input and output. When such a case occurs the
@@ -81,6 +128,26 @@ public:
 	 */
     virtual void setCurrentFloat(pinid_t pin, float newValue)=0;
 
+    /**
+     * Returns the current value on the ADC as a fixed point fraction between 0 and ANALOG_FIXED_MAX, this is
+     * the integer equivalent of getCurrentFloat and is much faster on boards without an FPU. By default it is
+     * scaled from getCurrentValue using the input bit depth.
+     * @param pin the pin to read from
+     * @return the current value as Q0.16 fixed point
+     */
+    virtual analogfixed_t getCurrentFixed(pinid_t pin) {
+        return analogScaleToFixed(getCurrentValue(pin), getBitDepth(DIR_IN, pin));
+    }
+
+    /**
+     * Sets the current value from a fixed point fraction between 0 and ANALOG_FIXED_MAX, the integer equivalent
+     * of setCurrentFloat. By default it is scaled onto setCurrentValue using the output bit depth.
+     * @param pin the pin to set
+     * @param newValue the new value as Q0.16 fixed point
+     */
+    virtual void setCurrentFixed(pinid_t pin, analogfixed_t newValue) {
+        setCurrentValue(pin, analogScaleFromFixed(newValue, getBitDepth(DIR_OUT, pin)));
+    }
 };
 
 #if defined(IOA_USE_MBED)
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "AnalogScanGroup.h"
+#include "IoLogging.h"
+
+AnalogScanGroup::AnalogScanGroup(AnalogDevice* device) {
+    this->device = device;
+    this->readBuffer = 0;
+    this->pinCount = 0;
+    this->maxAgeMicros = ANALOG_SCAN_DEFAULT_AGE_MICROS;
+    this->lastSweepMicros = 0;
+    this->sweepCount = 0;
+    this->continuousTask = TASKMGR_INVALIDID;
+    memset(results, 0, sizeof results);
+}
+
+bool AnalogScanGroup::addPin(pinid_t pin) {
+    if(indexOf(pin) >= 0) return true;
+    if(pinCount >= ANALOG_SCAN_MAX_PINS) {
+        serdebugF2("Scan group full, pin ", pin);
+        return false;
+    }
+    device->initPin(pin, DIR_IN);
+    pins[pinCount++] = pin;
+    return true;
+}
+
+int AnalogScanGroup::indexOf(pinid_t pin) const {
+    for(uint8_t i=0; i<pinCount; i++) {
+        if(pins[i] == pin) return i;
+    }
+    return -1;
+}
+
+void AnalogScanGroup::convertAll(unsigned int* buffer) {
+    for(uint8_t i=0; i<pinCount; i++) {
+        buffer[i] = device->getCurrentValue(pins[i]);
+    }
+}
+
+void AnalogScanGroup::sweep() {
+    // fill the buffer that nobody is reading, then flip so readers always see a complete sweep.
+    uint8_t writeBuffer = readBuffer ^ 1U;
+    convertAll(results[writeBuffer]);
+    readBuffer = writeBuffer;
+    lastSweepMicros = micros();
+    sweepCount++;
+}
+
+void AnalogScanGroup::startContinuous(uint32_t intervalMicros) {
+    if(continuousTask != TASKMGR_INVALIDID) taskManager.cancelTask(continuousTask);
+    sweep();
+    continuousTask = taskManager.scheduleFixedRate(intervalMicros, this, TIME_MICROS);
+}
+
+void AnalogScanGroup::stopContinuous() {
+    if(continuousTask == TASKMGR_INVALIDID) return;
+    taskManager.cancelTask(continuousTask);
+    continuousTask = TASKMGR_INVALIDID;
+}
+
+unsigned int AnalogScanGroup::getCurrentValue(pinid_t pin) {
+    int idx = indexOf(pin);
+    if(idx < 0) return device->getCurrentValue(pin);
+
+    if(continuousTask == TASKMGR_INVALIDID && (sweepCount == 0 || (micros() - lastSweepMicros) >= maxAgeMicros)) {
+        sweep();
+    }
+    return results[readBuffer][idx];
+}
+
+float AnalogScanGroup::getCurrentFloat(pinid_t pin) {
+    return float(getCurrentValue(pin)) / float(getMaximumRange(DIR_IN, pin));
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _ANALOG_SCAN_GROUP_H_
+#define _ANALOG_SCAN_GROUP_H_
+
+/**
+ * @file AnalogScanGroup.h
+ *
+ * Contains a scan group that converts a set of analog pins in one sweep and buffers the results, so that several
+ * consumers of the same analog device share one set of conversions instead of each triggering their own.
+ */
+
+#include "AnalogDeviceAbstraction.h"
+#include "TaskManagerIO.h"
+
+/** the maximum number of pins that can be registered in a scan group */
+#ifndef ANALOG_SCAN_MAX_PINS
+#define ANALOG_SCAN_MAX_PINS 8
+#endif
+
+/** the default age after which an on demand read of a registered pin triggers a fresh sweep */
+#ifndef ANALOG_SCAN_DEFAULT_AGE_MICROS
+#define ANALOG_SCAN_DEFAULT_AGE_MICROS 2000
+#endif
+
+/**
+ * A scan group registers a set of pins on an analog device and converts them all together in one sweep, the results
+ * are double buffered so readers always see a complete sweep. The group is itself an AnalogDevice, so it can be passed
+ * to AnalogInEvent, JoystickSwitchInput, DfRobotInputAbstraction and others in place of the real device, reads of
+ * registered pins are then served from the buffer and everything else is passed through to the underlying device.
+ *
+ * There are two ways to use it:
+ *
+ * * On demand - a read of a registered pin triggers a sweep only when the last sweep is older than the maximum age,
+ *   so all consumers that read within the same tick share one sweep.
+ * * Continuous - call startContinuous and the sweep runs on task manager at a fixed rate, reads never convert.
+ *
+ * Pins that are reconfigured between reads, such as a resistive touch screen, cannot be shared in this way.
+ * Platforms that can sample in hardware can extend this class and override convertAll.
+ */
+class AnalogScanGroup : public AnalogDevice, public Executable {
+private:
+    AnalogDevice* device;
+    pinid_t pins[ANALOG_SCAN_MAX_PINS];
+    unsigned int results[2][ANALOG_SCAN_MAX_PINS];
+    volatile uint8_t readBuffer;
+    uint8_t pinCount;
+    uint32_t maxAgeMicros;
+    unsigned long lastSweepMicros;
+    uint32_t sweepCount;
+    taskid_t continuousTask;
+public:
+    /**
+     * Create a scan group that works on the pins of the device provided
+     * @param device the underlying device that performs the conversions
+     */
+    explicit AnalogScanGroup(AnalogDevice* device);
+
+    /**
+     * Register a pin in the group, it is initialised as an input on the underlying device.
+     * @param pin the pin to register
+     * @return true if registered, false if the group is full
+     */
+    bool addPin(pinid_t pin);
+
+    /** @return the number of pins registered */
+    uint8_t getPinCount() const { return pinCount; }
+
+    /**
+     * @param pin the pin to find
+     * @return the index of the pin within the group, or -1 if not registered.
+     */
+    int indexOf(pinid_t pin) const;
+
+    /**
+     * Convert every registered pin into the back buffer, and then make it the current buffer.
+     */
+    void sweep();
+
+    /**
+     * Start sweeping continuously on task manager at a fixed rate, reads will then never trigger conversions.
+     * @param intervalMicros the interval between each sweep in microseconds.
+     */
+    void startContinuous(uint32_t intervalMicros);
+
+    /** stop continuous sweeping, reads go back to triggering sweeps on demand */
+    void stopContinuous();
+
+    /** @return true if continuous sweeping is running */
+    bool isContinuous() const { return continuousTask != TASKMGR_INVALIDID; }
+
+    /**
+     * In on demand mode, set the age after which a read of a registered pin triggers a new sweep. Set this to the
+     * tick of the fastest consumer, so that all consumers share one sweep per tick.
+     * @param micros the maximum age in microseconds
+     */
+    void setMaximumAgeMicros(uint32_t micros) { maxAgeMicros = micros; }
+
+    /**
+     * Gets a result from the current buffer by its index in the group, without triggering a sweep.
+     * @param index the index of the pin in the group
+     * @return the last converted value
+     */
+    unsigned int getResult(uint8_t index) const { return (index < pinCount) ? results[readBuffer][index] : 0; }
+
+    /** @return the number of sweeps that have completed */
+    uint32_t getSweepCount() const { return sweepCount; }
+
+    /** @return the micros value at the time the last sweep completed */
+    unsigned long getLastSweepMicros() const { return lastSweepMicros; }
+
+    /** @return the device that this group converts on */
+    AnalogDevice* getUnderlyingDevice() { return device; }
+
+    int getMaximumRange(AnalogDirection direction, pinid_t pin) override { return device->getMaximumRange(direction, pin); }
+    int getBitDepth(AnalogDirection direction, pinid_t pin) override { return device->getBitDepth(direction, pin); }
+    void initPin(pinid_t pin, AnalogDirection direction) override { device->initPin(pin, direction); }
+    unsigned int getCurrentValue(pinid_t pin) override;
+    float getCurrentFloat(pinid_t pin) override;
+    void setCurrentValue(pinid_t pin, unsigned int newValue) override { device->setCurrentValue(pin, newValue); }
+    void setCurrentFloat(pinid_t pin, float newValue) override { device->setCurrentFloat(pin, newValue); }
+
+    /** called by task manager in continuous mode to perform a sweep */
+    void exec() override { sweep(); }
+
+protected:
+    /**
+     * Converts every pin in the group into the buffer provided, by default one conversion at a time on the device.
+     * Extend this class and override to use a hardware sequencer or DMA where available.
+     * @param buffer the buffer to fill, it has space for every registered pin in order.
+     */
+    virtual void convertAll(unsigned int* buffer);
+
+    /** @return the pin at an index within the group */
+    pinid_t getPin(uint8_t index) const { return pins[index]; }
+};
+
+#endif //_ANALOG_SCAN_GROUP_H_
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include <math.h>
+#include "AnalogWaveformEngine.h"
+#include "IoLogging.h"
+
+AnalogWaveformEngine::AnalogWaveformEngine() : channels() {
+    this->channelCount = 0;
+    this->tickCount = 0;
+    this->timerTask = TASKMGR_INVALIDID;
+}
+
+AnalogWaveformEngine::~AnalogWaveformEngine() {
+    clear();
+}
+
+int AnalogWaveformEngine::addChannel(AnalogDevice* device, pinid_t pin, AnalogWaveformType type, uint16_t samples,
+                                     float amplitude, float centre, uint16_t startPosition) {
+    if(channelCount >= ANALOG_WAVEFORM_MAX_CHANNELS || samples < 2) return -1;
+
+    // work out the lowest and highest raw values once, everything after this is integer
+    int32_t maxValue = device->getMaximumRange(DIR_OUT, pin);
+    float lowF = (centre - (amplitude / 2.0F)) * float(maxValue);
+    float highF = (centre + (amplitude / 2.0F)) * float(maxValue);
+    int32_t low = lowF < 0.0F ? 0 : int32_t(lowF + 0.5F);
+    int32_t high = highF > float(maxValue) ? maxValue : int32_t(highF + 0.5F);
+    int32_t span = high - low;
+
+    auto table = new uint16_t[samples];
+    uint16_t half = samples / 2;
+    for(uint16_t i = 0; i < samples; i++) {
+        int32_t val;
+        switch(type) {
+            case WAVEFORM_SINE:
+                val = low + int32_t((float(span) * (1.0F + sinf(6.2831853F * float(i) / float(samples))) / 2.0F) + 0.5F);
+                break;
+            case WAVEFORM_TRIANGLE:
+                val = (i < half) ? low + (span * i) / half : high - (span * (i - half)) / (samples - half);
+                break;
+            case WAVEFORM_SAWTOOTH:
+                val = low + (span * i) / (samples - 1);
+                break;
+            case WAVEFORM_SQUARE:
+            default:
+                val = (i < half) ? high : low;
+                break;
+        }
+        table[i] = (uint16_t)val;
+    }
+
+    int idx = addChannelInternal(device, pin, table, samples, startPosition, true);
+    if(idx < 0) delete[] table;
+    return idx;
+}
+
+int AnalogWaveformEngine::addCustomChannel(AnalogDevice* device, pinid_t pin, const uint16_t* table, uint16_t length,
+                                           uint16_t startPosition) {
+    if(length == 0) return -1;
+    return addChannelInternal(device, pin, table, length, startPosition, false);
+}
+
+int AnalogWaveformEngine::addChannelInternal(AnalogDevice* device, pinid_t pin, const uint16_t* table,
+                                             uint16_t length, uint16_t startPosition, bool ownsTable) {
+    if(channelCount >= ANALOG_WAVEFORM_MAX_CHANNELS) {
+        serdebugF2("Waveform engine full, pin ", pin);
+        return -1;
+    }
+    device->initPin(pin, DIR_OUT);
+    auto& ch = channels[channelCount];
+    ch.device = device;
+    ch.pin = pin;
+    ch.table = table;
+    ch.length = length;
+    ch.position = startPosition % length;
+    ch.lastWritten = -1;
+    ch.ownsTable = ownsTable;
+    return channelCount++;
+}
+
+void AnalogWaveformEngine::clear() {
+    stop();
+    for(uint8_t i = 0; i < channelCount; i++) {
+        if(channels[i].ownsTable) delete[] channels[i].table;
+        channels[i].table = nullptr;
+    }
+    channelCount = 0;
+}
+
+void AnalogWaveformEngine::start(uint32_t sampleMicros) {
+    stop();
+    tickCount = 0;
+    timerTask = taskManager.scheduleFixedRate(sampleMicros, this, TIME_MICROS);
+}
+
+void AnalogWaveformEngine::stop() {
+    if(timerTask == TASKMGR_INVALIDID) return;
+    taskManager.cancelTask(timerTask);
+    timerTask = TASKMGR_INVALIDID;
+}
+
+uint16_t AnalogWaveformEngine::getSample(uint8_t channel, uint16_t idx) const {
+    if(channel >= channelCount || idx >= channels[channel].length) return 0;
+    return channels[channel].table[idx];
+}
+
+void AnalogWaveformEngine::exec() {
+    for(uint8_t i = 0; i < channelCount; i++) {
+        auto& ch = channels[i];
+        uint16_t sample = ch.table[ch.position];
+        if(int32_t(sample) != ch.lastWritten) {
+            ch.device->setCurrentValue(ch.pin, sample);
+            ch.lastWritten = sample;
+        }
+        if(++ch.position >= ch.length) ch.position = 0;
+    }
+    tickCount++;
+}
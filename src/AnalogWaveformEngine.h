@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _ANALOG_WAVEFORM_ENGINE_H_
+#define _ANALOG_WAVEFORM_ENGINE_H_
+
+/**
+ * @file AnalogWaveformEngine.h
+ *
+ * Contains a waveform generator that plays precomputed sample tables out of analog outputs on a task manager timer.
+ */
+
+#include "AnalogDeviceAbstraction.h"
+#include "TaskManagerIO.h"
+
+/** the maximum number of output channels that the engine can drive */
+#ifndef ANALOG_WAVEFORM_MAX_CHANNELS
+#define ANALOG_WAVEFORM_MAX_CHANNELS 4
+#endif
+
+/**
+ * The shapes that can be generated into a table, each covers exactly one cycle.
+ */
+enum AnalogWaveformType : uint8_t {
+    /** a sine wave starting at the centre and rising */
+    WAVEFORM_SINE,
+    /** rises for the first half of the cycle and falls for the second */
+    WAVEFORM_TRIANGLE,
+    /** rises across the whole cycle then drops back to the lowest value */
+    WAVEFORM_SAWTOOTH,
+    /** high for the first half of the cycle, low for the second */
+    WAVEFORM_SQUARE
+};
+
+/**
+ * Holds the state of one output in the engine, the table contains one cycle of raw values for the output.
+ */
+struct AnalogWaveformChannel {
+    AnalogDevice* device;
+    const uint16_t* table;
+    uint16_t length;
+    uint16_t position;
+    int32_t lastWritten;
+    pinid_t pin;
+    bool ownsTable;
+};
+
+/**
+ * Generates waveforms on the outputs of any AnalogDevice, such as a DAC or PWM pin. All the float work is done up
+ * front when a channel is added, where one cycle of the waveform is calculated into a table of raw values at the
+ * bit depth of the output. From then on, each tick of a fixed rate microsecond timer on task manager writes the
+ * next entry of every channel with setCurrentValue, so all channels move in lockstep with no per sample maths.
+ * A sample that is the same as the one before is not written again, which helps outputs on a bus.
+ *
+ * The output frequency of a channel is 1000000 / (sampleMicros * samples), for example 64 samples at 500 micros
+ * gives 31.25Hz. Several channels can be phase shifted by starting them at a different position in the table.
+ *
+ * Example: `engine.addChannel(internalAnalogIo(), DAC1, WAVEFORM_SINE, 64); engine.start(500);`
+ */
+class AnalogWaveformEngine : public Executable {
+private:
+    AnalogWaveformChannel channels[ANALOG_WAVEFORM_MAX_CHANNELS];
+    uint8_t channelCount;
+    uint32_t tickCount;
+    taskid_t timerTask;
+public:
+    AnalogWaveformEngine();
+    ~AnalogWaveformEngine();
+
+    /**
+     * Add a channel that plays a generated waveform, a table of samples entries is allocated and filled in at the
+     * resolution of the output. The output is initialised by this call.
+     * @param device the device that owns the output
+     * @param pin the output pin
+     * @param type the shape of the waveform
+     * @param samples the number of samples in one cycle
+     * @param amplitude the peak to peak amplitude as a fraction of full scale
+     * @param centre the centre of the waveform as a fraction of full scale
+     * @param startPosition the table entry to start from, to shift the phase against other channels
+     * @return the channel index, or -1 if there is no room
+     */
+    int addChannel(AnalogDevice* device, pinid_t pin, AnalogWaveformType type, uint16_t samples,
+                   float amplitude = 1.0F, float centre = 0.5F, uint16_t startPosition = 0);
+
+    /**
+     * Add a channel that plays a table of raw values provided by you, it is not copied and must remain in scope.
+     * @param device the device that owns the output
+     * @param pin the output pin
+     * @param table the raw values for one cycle, already in the range of the output
+     * @param length the number of entries in the table
+     * @param startPosition the table entry to start from
+     * @return the channel index, or -1 if there is no room
+     */
+    int addCustomChannel(AnalogDevice* device, pinid_t pin, const uint16_t* table, uint16_t length,
+                         uint16_t startPosition = 0);
+
+    /** remove all channels, stopping the engine first */
+    void clear();
+
+    /**
+     * Start stepping all channels together on a fixed rate timer.
+     * @param sampleMicros the time between each sample in microseconds
+     */
+    void start(uint32_t sampleMicros);
+
+    /** stop the timer, the outputs stay at their last value */
+    void stop();
+
+    /** @return true if the timer is running */
+    bool isRunning() const { return timerTask != TASKMGR_INVALIDID; }
+
+    /** @return the number of channels */
+    uint8_t getChannelCount() const { return channelCount; }
+
+    /** @return the current position in the table of a channel */
+    uint16_t getPosition(uint8_t channel) const { return channel < channelCount ? channels[channel].position : 0; }
+
+    /** @return the raw table entry for a channel, useful for checking a generated table */
+    uint16_t getSample(uint8_t channel, uint16_t idx) const;
+
+    /** @return the number of timer ticks since the engine was started */
+    uint32_t getTickCount() const { return tickCount; }
+
+    /** called by task manager on every tick, writes the next sample to every channel */
+    void exec() override;
+
+private:
+    int addChannelInternal(AnalogDevice* device, pinid_t pin, const uint16_t* table, uint16_t length,
+                           uint16_t startPosition, bool ownsTable);
+};
+
+#endif //_ANALOG_WAVEFORM_ENGINE_H_
@@ -9,15 +9,23 @@
 #include <Arduino.h>
 #include "EEPROM.h"
 #include "EepromAbstraction.h"
+#include "TaskManagerIO.h"
 
 /**
  * @file ArduinoEEPROMAbstraction.h
  * A wrapper around the Arduino EEPROM support.
  */
 
+// The EEPROM class on these boards is emulated in FLASH, it holds a copy in RAM and needs commit to save it.
+// Define IOA_EEPROM_NEEDS_COMMIT yourself for any other board where EEPROMClass works this way.
+#if defined(ESP32) || defined(ESP8266) || defined(ARDUINO_ARCH_RP2040)
+# define IOA_EEPROM_NEEDS_COMMIT
+#endif
+
 /**
  * Provides a wrapper around the EEPROM class available on some Arduino boards. For AVR 8bit boards
- * such as Uno and Mega, there are no notes, it neatly wraps the class.
+ * such as Uno and Mega, there are no notes, it neatly wraps the class. On all boards, bytes are only
+ * written when their value changes, and arrays are read in bulk where the board allows.
  * 
  * Extra notes for ESP8266, ESP32 and any other FLASH emulated implementation:
  * When the ESP EEPROM wrapper is used, then you need to ensure that you call begin(size) before use and
@@ -26,13 +34,85 @@
  * AT24Cxxx EEPROM devices which cost about $1 and you will not risk damaging your FLASH. Me having 
  * implemented this is not an indicator that I agree with using FLASH as EEPROM, I personally wouldn't
  * do that on a production board.
+ *
+ * To keep FLASH writes down, commit() on this class only commits when something has changed since the
+ * last commit, and if commitIdleMillis is given in the constructor, a commit is made automatically once
+ * no changes have been made for that long. Saving a whole set of settings then costs one sector erase.
  */
-class ArduinoEEPROMAbstraction : public EepromAbstraction {
+class ArduinoEEPROMAbstraction : public EepromAbstraction, public Executable {
 private:
     EEPROMClass* eepromProxy;
+    uint32_t commitIdleMillis;
+    uint32_t lastChangeMillis;
+    uint32_t commitCount;
+    taskid_t commitTask;
+    bool changesPending;
+    bool errorFlag;
 public:
-    ArduinoEEPROMAbstraction(EEPROMClass* proxy) {
+    /**
+     * Create the wrapper around an EEPROM class
+     * @param proxy usually &EEPROM
+     * @param commitIdleMillis for FLASH emulated EEPROM, if not 0 commit automatically after no changes for this long
+     */
+    explicit ArduinoEEPROMAbstraction(EEPROMClass* proxy, uint32_t commitIdleMillis = 0) {
         this->eepromProxy = proxy;
+        this->commitIdleMillis = commitIdleMillis;
+        this->lastChangeMillis = 0;
+        this->commitCount = 0;
+        this->commitTask = TASKMGR_INVALIDID;
+        this->changesPending = false;
+        this->errorFlag = false;
+    }
+
+    /**
+     * Cancels any pending idle commit and commits any changes, so nothing is lost and task manager is not left
+     * holding this object.
+     */
+    ~ArduinoEEPROMAbstraction() override {
+        if(commitTask != TASKMGR_INVALIDID) taskManager.cancelTask(commitTask);
+        commit();
+    }
+
+    /**
+     * For FLASH emulated EEPROM, commits if there have been any changes since the last commit, on other boards
+     * it does nothing as writes are immediate.
+     * @return false if the commit failed
+     */
+    bool commit() {
+#ifdef IOA_EEPROM_NEEDS_COMMIT
+        if(!changesPending) return true;
+        changesPending = false;
+        commitCount++;
+        if(!eepromProxy->commit()) {
+            errorFlag = true;
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    /** @return true if there are changes that have not been committed */
+    bool isCommitPending() const { return changesPending; }
+
+    /** @return the number of commits made, on FLASH emulated EEPROM each is usually a sector erase */
+    uint32_t getCommitCount() const { return commitCount; }
+
+    /** called by task manager to commit once the idle time has passed */
+    void exec() override {
+        commitTask = TASKMGR_INVALIDID;
+        uint32_t idle = millis() - lastChangeMillis;
+        if(changesPending && idle < commitIdleMillis) {
+            commitTask = taskManager.scheduleOnce(commitIdleMillis - idle, this);
+        }
+        else {
+            commit();
+        }
+    }
+
+    bool hasErrorOccurred() override {
+        bool err = errorFlag;
+        errorFlag = false;
+        return err;
     }
 
    	uint8_t read8(EepromPosition position) override {
@@ -40,46 +120,72 @@ public:
     }
 
    	uint16_t read16(EepromPosition pos) override {
-        return eepromProxy->read(pos + 1) << 8 | eepromProxy->read(pos);
+        uint8_t data[2];
+        readIntoMemArray(data, pos, sizeof data);
+        return data[1] << 8 | data[0];
     }
 
    	uint32_t read32(EepromPosition pos) override {
-        return (uint32_t)eepromProxy->read(pos + 3) << 24 | (uint32_t)eepromProxy->read(pos + 2) << 16 |
-               (uint32_t)eepromProxy->read(pos + 1) << 8 | (uint32_t)eepromProxy->read(pos + 0);
+        uint8_t data[4];
+        readIntoMemArray(data, pos, sizeof data);
+        return (uint32_t)data[3] << 24 | (uint32_t)data[2] << 16 | (uint32_t)data[1] << 8 | (uint32_t)data[0];
     }
 
     void write8(EepromPosition pos, uint8_t val) override {
-        eepromProxy->write(pos, val);
+        writeArrayToRom(pos, &val, 1);
     }
 
     void write16(EepromPosition pos, uint16_t val) override {
-        eepromProxy->write(pos, val);
-        val >>= 8;
-        eepromProxy->write(pos + 1, (uint8_t)val);
+        uint8_t data[2] = { (uint8_t)val, (uint8_t)(val >> 8) };
+        writeArrayToRom(pos, data, sizeof data);
     }
 
    	void write32(EepromPosition pos, uint32_t val) override {
-        eepromProxy->write(pos, (uint8_t)val);
-        val >>= 8;
-        eepromProxy->write(pos + 1, (uint8_t)val);
-        val >>= 8;
-        eepromProxy->write(pos + 2, (uint8_t)val);
-        val >>= 8;
-        eepromProxy->write(pos + 3, (uint8_t)val);
+        uint8_t data[4] = { (uint8_t)val, (uint8_t)(val >> 8), (uint8_t)(val >> 16), (uint8_t)(val >> 24) };
+        writeArrayToRom(pos, data, sizeof data);
     }
 
 	void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override {
+#if defined(ESP32)
+        eepromProxy->readBytes(romSrc, memDest, len);
+#elif defined(IOA_EEPROM_NEEDS_COMMIT)
+        // the data is already in RAM, so copy it in one go
+        const uint8_t* data = eepromProxy->getConstDataPtr();
+        if(data == nullptr || (romSrc + len) > eepromProxy->length()) {
+            memset(memDest, 0, len);
+            errorFlag = true;
+            return;
+        }
+        memcpy(memDest, data + romSrc, len);
+#else
         for(int i=0;i<len;i++) {
             *memDest = eepromProxy->read(romSrc + i);
             memDest++;
         }
+#endif
     }
 
 	void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override {
+        // only write bytes that change, on FLASH emulated boards this avoids marking the EEPROM dirty for nothing.
+        bool changed = false;
         for(int i=0;i<len;i++) {
-            eepromProxy->write(romDest + i, *memSrc);
-            memSrc++;
+            if(eepromProxy->read(romDest + i) != memSrc[i]) {
+                eepromProxy->write(romDest + i, memSrc[i]);
+                changed = true;
+            }
+        }
+        if(changed) markChanged();
+    }
+
+private:
+    void markChanged() {
+#ifdef IOA_EEPROM_NEEDS_COMMIT
+        changesPending = true;
+        lastChangeMillis = millis();
+        if(commitIdleMillis != 0 && commitTask == TASKMGR_INVALIDID) {
+            commitTask = taskManager.scheduleOnce(commitIdleMillis, this);
         }
+#endif
     }
 };
 
@@ -105,6 +105,7 @@ typedef BasicIoAbstraction* IoAbstractionRef;
  */
 #ifdef IOA_USE_MBED
 #define pgm_read_byte_near(x) (*(x))
+#define pgm_read_word_near(x) (*(x))
 #elif defined(IOA_USE_ARDUINO)
 #define ioUsingArduino internalDigitalIo
 #endif
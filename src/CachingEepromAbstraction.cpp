@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "CachingEepromAbstraction.h"
+
+CachingEepromAbstraction::CachingEepromAbstraction(EepromAbstraction* underlying, uint8_t numberOfPages,
+                                                   uint32_t autoFlushMillis, uint8_t pageSize) {
+    if(pageSize == 0) {
+        uint16_t romPageSize = underlying->getPageSize();
+        pageSize = romPageSize > CACHING_EEPROM_MAX_PAGE_SIZE ? CACHING_EEPROM_MAX_PAGE_SIZE : romPageSize;
+    }
+    if(pageSize == 0) pageSize = CACHING_EEPROM_DEFAULT_PAGE_SIZE;
+    if(numberOfPages == 0) numberOfPages = 1;
+
+    this->underlying = underlying;
+    this->numberOfPages = numberOfPages;
+    this->pageSize = pageSize;
+    this->autoFlushMillis = autoFlushMillis;
+    this->flushTask = TASKMGR_INVALIDID;
+    this->accessCount = 0;
+    this->hits = this->misses = this->flushes = 0;
+    this->bigEndian = underlying->isBigEndian();
+    this->pages = new CachedEepromPage[numberOfPages];
+    this->pageData = new uint8_t[numberOfPages * pageSize];
+    for(uint8_t i = 0; i < numberOfPages; i++) {
+        pages[i].valid = false;
+        pages[i].dirty = false;
+    }
+}
+
+CachingEepromAbstraction::~CachingEepromAbstraction() {
+    commit();
+    delete[] pages;
+    delete[] pageData;
+}
+
+uint8_t CachingEepromAbstraction::findPage(EepromPosition position) {
+    EepromPosition start = position - (position % pageSize);
+    accessCount++;
+
+    // look for the page, remembering the best page to evict in case it's not there.
+    uint8_t victim = 0;
+    for(uint8_t i = 0; i < numberOfPages; i++) {
+        auto& pg = pages[i];
+        if(pg.valid && pg.start == start) {
+            hits++;
+            pg.lastUsed = accessCount;
+            return i;
+        }
+        if(!pages[victim].valid) continue;
+        if(!pg.valid || pg.lastUsed < pages[victim].lastUsed) victim = i;
+    }
+
+    misses++;
+    flushPage(victim);
+    auto& pg = pages[victim];
+    underlying->readIntoMemArray(dataFor(victim), start, pageSize);
+    pg.start = start;
+    pg.valid = true;
+    pg.dirty = false;
+    pg.lastUsed = accessCount;
+    return victim;
+}
+
+void CachingEepromAbstraction::flushPage(uint8_t idx) {
+    auto& pg = pages[idx];
+    if(!pg.valid || !pg.dirty) return;
+    underlying->writeArrayToRom(pg.start + pg.dirtyFrom, &dataFor(idx)[pg.dirtyFrom], pg.dirtyTo - pg.dirtyFrom + 1);
+    pg.dirty = false;
+    flushes++;
+}
+
+void CachingEepromAbstraction::commit() {
+    for(uint8_t i = 0; i < numberOfPages; i++) {
+        flushPage(i);
+    }
+    if(flushTask != TASKMGR_INVALIDID) {
+        taskManager.cancelTask(flushTask);
+        flushTask = TASKMGR_INVALIDID;
+    }
+}
+
+void CachingEepromAbstraction::invalidate() {
+    commit();
+    for(uint8_t i = 0; i < numberOfPages; i++) {
+        pages[i].valid = false;
+    }
+}
+
+uint8_t CachingEepromAbstraction::getDirtyPageCount() const {
+    uint8_t count = 0;
+    for(uint8_t i = 0; i < numberOfPages; i++) {
+        if(pages[i].valid && pages[i].dirty) count++;
+    }
+    return count;
+}
+
+void CachingEepromAbstraction::exec() {
+    flushTask = TASKMGR_INVALIDID;
+    commit();
+}
+
+void CachingEepromAbstraction::readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) {
+    while(len > 0) {
+        uint8_t idx = findPage(romSrc);
+        uint8_t offs = romSrc % pageSize;
+        uint8_t currentGo = min(uint8_t(pageSize - offs), len);
+        memcpy(memDest, &dataFor(idx)[offs], currentGo);
+        memDest += currentGo;
+        romSrc += currentGo;
+        len -= currentGo;
+    }
+}
+
+void CachingEepromAbstraction::writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) {
+    bool anyChanged = false;
+    while(len > 0) {
+        uint8_t idx = findPage(romDest);
+        uint8_t offs = romDest % pageSize;
+        uint8_t currentGo = min(uint8_t(pageSize - offs), len);
+        uint8_t* dest = &dataFor(idx)[offs];
+
+        // only mark the bytes that actually changed, so unchanged pages are never written back
+        for(uint8_t i = 0; i < currentGo; i++) {
+            if(dest[i] == memSrc[i]) continue;
+            dest[i] = memSrc[i];
+            auto& pg = pages[idx];
+            uint8_t pos = offs + i;
+            if(!pg.dirty) {
+                pg.dirty = true;
+                pg.dirtyFrom = pg.dirtyTo = pos;
+            }
+            else {
+                if(pos < pg.dirtyFrom) pg.dirtyFrom = pos;
+                if(pos > pg.dirtyTo) pg.dirtyTo = pos;
+            }
+            anyChanged = true;
+        }
+        memSrc += currentGo;
+        romDest += currentGo;
+        len -= currentGo;
+    }
+
+    if(anyChanged && autoFlushMillis != 0 && flushTask == TASKMGR_INVALIDID) {
+        flushTask = taskManager.scheduleOnce(autoFlushMillis, this);
+    }
+}
+
+uint8_t CachingEepromAbstraction::read8(EepromPosition position) {
+    uint8_t val;
+    readIntoMemArray(&val, position, 1);
+    return val;
+}
+
+void CachingEepromAbstraction::write8(EepromPosition position, uint8_t val) {
+    writeArrayToRom(position, &val, 1);
+}
+
+uint16_t CachingEepromAbstraction::read16(EepromPosition position) {
+    return uint16_t(readValue(position, 2));
+}
+
+void CachingEepromAbstraction::write16(EepromPosition position, uint16_t val) {
+    writeValue(position, val, 2);
+}
+
+uint32_t CachingEepromAbstraction::read32(EepromPosition position) {
+    return readValue(position, 4);
+}
+
+void CachingEepromAbstraction::write32(EepromPosition position, uint32_t val) {
+    writeValue(position, val, 4);
+}
+
+uint32_t CachingEepromAbstraction::readValue(EepromPosition position, uint8_t len) {
+    uint8_t data[4];
+    readIntoMemArray(data, position, len);
+    uint32_t val = 0;
+    for(uint8_t i = 0; i < len; i++) {
+        val = (val << 8U) | data[bigEndian ? i : (len - 1 - i)];
+    }
+    return val;
+}
+
+void CachingEepromAbstraction::writeValue(EepromPosition position, uint32_t val, uint8_t len) {
+    // the same byte order as the underlying rom, so wrapping it does not change the values already stored
+    uint8_t data[4];
+    for(uint8_t i = 0; i < len; i++) {
+        data[bigEndian ? (len - 1 - i) : i] = uint8_t(val >> (i * 8U));
+    }
+    writeArrayToRom(position, data, len);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _CACHING_EEPROM_ABSTRACTION_H_
+#define _CACHING_EEPROM_ABSTRACTION_H_
+
+/**
+ * @file CachingEepromAbstraction.h
+ *
+ * Contains a write back page cache that wraps another EepromAbstraction, so that many small writes become a few
+ * whole page writes.
+ */
+
+#include "EepromAbstraction.h"
+#include "TaskManagerIO.h"
+
+/** the page size used when neither the constructor nor the underlying rom provide one */
+#ifndef CACHING_EEPROM_DEFAULT_PAGE_SIZE
+#define CACHING_EEPROM_DEFAULT_PAGE_SIZE 32
+#endif
+
+/** the largest cache page, devices with larger pages are cached in parts of this size, each still one write cycle */
+#define CACHING_EEPROM_MAX_PAGE_SIZE 128
+
+/**
+ * The state of one page held in the cache, the data itself is held in a single buffer owned by the cache.
+ */
+struct CachedEepromPage {
+    /** the rom position of the first byte in the page */
+    EepromPosition start;
+    /** the access count when the page was last used, the lowest is evicted first */
+    uint32_t lastUsed;
+    /** the range of bytes changed since the page was last flushed, only valid when dirty */
+    uint8_t dirtyFrom, dirtyTo;
+    bool valid;
+    bool dirty;
+};
+
+/**
+ * An EepromAbstraction that holds a number of pages of another rom in RAM. Reads are served from the cache once a
+ * page is loaded, and writes only change RAM and mark the page dirty. Dirty pages are written back as one transfer
+ * per page when commit() is called, when the auto flush timer fires, or when the page is evicted to make room for
+ * another. Pages are evicted least recently used first.
+ *
+ * The page size is taken from the underlying rom's getPageSize(), for I2cAt24Eeprom that is the size given in its
+ * constructor, so that each flush is a single write cycle on the chip. Pages larger than CACHING_EEPROM_MAX_PAGE_SIZE
+ * are cached in parts. Multi byte values are stored in the byte order of the underlying rom, see isBigEndian(), so
+ * a rom that already holds values can be wrapped without changing its layout.
+ *
+ * Until commit is called, any changes are lost on reset, so commit before anything that could power down the board.
+ *
+ * Example: `CachingEepromAbstraction cache(&at24Rom, 4, 500);` then use cache as the rom and call `cache.commit()`
+ * after saving.
+ */
+class CachingEepromAbstraction : public EepromAbstraction, public Executable {
+private:
+    EepromAbstraction* underlying;
+    CachedEepromPage* pages;
+    uint8_t* pageData;
+    uint8_t numberOfPages;
+    uint8_t pageSize;
+    uint32_t accessCount;
+    uint32_t autoFlushMillis;
+    taskid_t flushTask;
+    uint32_t hits, misses, flushes;
+    bool bigEndian;
+public:
+    /**
+     * Create a cache over another rom
+     * @param underlying the rom that is cached
+     * @param numberOfPages the number of pages held in RAM
+     * @param autoFlushMillis if not 0, dirty pages are flushed this many millis after the first change
+     * @param pageSize the size of each page, 0 to use the page size of the underlying rom
+     */
+    explicit CachingEepromAbstraction(EepromAbstraction* underlying, uint8_t numberOfPages = 2,
+                                      uint32_t autoFlushMillis = 0, uint8_t pageSize = 0);
+    ~CachingEepromAbstraction() override;
+
+    /**
+     * Write all dirty pages to the underlying rom, call before anything that could power down the board.
+     */
+    void commit();
+
+    /**
+     * Flush any dirty pages and then drop everything from the cache, use if the rom was changed elsewhere.
+     */
+    void invalidate();
+
+    /** @return the number of dirty pages waiting to be written */
+    uint8_t getDirtyPageCount() const;
+
+    /** @return the number of page lookups that were already in the cache */
+    uint32_t getHitCount() const { return hits; }
+    /** @return the number of page lookups that needed the page to be read */
+    uint32_t getMissCount() const { return misses; }
+    /** @return the number of page writes made to the underlying rom */
+    uint32_t getFlushCount() const { return flushes; }
+    /** clear the hit, miss and flush counts */
+    void resetStatistics() { hits = misses = flushes = 0; }
+
+    bool hasErrorOccurred() override { return underlying->hasErrorOccurred(); }
+    uint16_t getPageSize() override { return pageSize; }
+    bool isBigEndian() override { return bigEndian; }
+
+    uint8_t read8(EepromPosition position) override;
+    void write8(EepromPosition position, uint8_t val) override;
+
+    uint16_t read16(EepromPosition position) override;
+    void write16(EepromPosition position, uint16_t val) override;
+
+    uint32_t read32(EepromPosition position) override;
+    void write32(EepromPosition position, uint32_t val) override;
+
+    void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override;
+    void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override;
+
+    /** called by task manager when the auto flush timer fires */
+    void exec() override;
+
+private:
+    uint8_t findPage(EepromPosition position);
+    void flushPage(uint8_t idx);
+    uint8_t* dataFor(uint8_t idx) { return &pageData[idx * pageSize]; }
+    uint32_t readValue(EepromPosition position, uint8_t len);
+    void writeValue(EepromPosition position, uint32_t val, uint8_t len);
+};
+
+#endif //_CACHING_EEPROM_ABSTRACTION_H_
@@ -14,6 +14,7 @@
 #include "TaskManagerIO.h"
 #include "PlatformDetermination.h"
 #include "AnalogDeviceAbstraction.h"
+#include "AnalogScanGroup.h"
 
 /**
  * An event that triggers when a certain analog condition is reached, based on a made and a threshold. It can either
@@ -25,7 +26,7 @@
  *
  * * ANALOGIN_EXCEEDS - the event is triggered when analog in exceeds threshold.
  * * ANALOGIN_BELOW - the event is triggered when analog in is below threshold.
- * * ANALOGIN_CHANGE - the event is triggered when analog in changes by more than threshold.
+ * * ANALOGIN_CHANGE - the event is triggered when analog in changes by more than threshold since it last triggered.
  */
 class AnalogInEvent : public BaseEvent {
 public:
@@ -46,8 +47,14 @@ private:
     uint32_t pollInterval;
     bool latched;
     pinid_t analogPin;
+    analogfixed_t fixedThreshold;
+    analogfixed_t fixedReading;
+    analogfixed_t referenceReading;
+    bool haveReference;
 protected:
+    /** the threshold as a float, kept for compatibility, the comparison is made in fixed point */
     float analogThreshold;
+    /** the reading as a float, updated only when the event triggers to avoid float work on every poll */
     float lastReading;
 public:
 
@@ -62,14 +69,30 @@ public:
     AnalogInEvent(AnalogDevice *device, pinid_t inputPin, float threshold, AnalogEventMode mode_,
                   uint32_t pollInterval_) : BaseEvent() {
         analogThreshold = threshold;
+        fixedThreshold = analogFixedFromFloat(threshold);
         analogPin = inputPin;
         lastReading = 0;
+        fixedReading = 0;
+        referenceReading = 0;
+        haveReference = false;
         pollInterval = pollInterval_;
         analogDevice = device;
         latched = false;
         mode = mode_;
     }
 
+    /**
+     * Change the threshold using a fixed point value, see AnalogDevice::getCurrentFixed
+     * @param threshold the new threshold from 0 to ANALOG_FIXED_MAX
+     */
+    void setThresholdFixed(analogfixed_t threshold) {
+        fixedThreshold = threshold;
+        analogThreshold = analogFixedToFloat(threshold);
+    }
+
+    /** @return the most recent reading in fixed point, see AnalogDevice::getCurrentFixed */
+    analogfixed_t getLastReadingFixed() const { return fixedReading; }
+
     /**
      * Change to another polling interval
      * @param micros the new polling interval in microseconds
@@ -81,13 +104,26 @@ public:
     /**
      * Implementation of the method that checks the analog reading against the condition for this instance. If the
      * condition is met, then it triggers the event, which stays latched until the condition  is no longer met, and
-     * then it is unlatched.
+     * then it is unlatched. In change mode it does not latch, it triggers whenever the reading has moved by more
+     * than the threshold since the last trigger.
      * @return the configured poll interval.
      */
     uint32_t timeOfNextCheck() override {
-        lastReading = analogDevice->getCurrentFloat(analogPin);
+        fixedReading = analogDevice->getCurrentFixed(analogPin);
+        if(!haveReference) {
+            referenceReading = fixedReading;
+            haveReference = true;
+        }
         auto analogTrigger = isConditionTrue();
-        if (analogTrigger && !latched) {
+        if (analogTrigger && mode == ANALOGIN_CHANGE) {
+            // change mode never latches, the next change is measured from the reading that triggered this one, so a
+            // fast moving input triggers on every poll that it moves by more than the threshold.
+            lastReading = analogFixedToFloat(fixedReading);
+            referenceReading = fixedReading;
+            setTriggered(true);
+        }
+        else if (analogTrigger && !latched) {
+            lastReading = analogFixedToFloat(fixedReading);
             setTriggered(true);
             latched = true;
         }
@@ -103,14 +139,14 @@ public:
      */
     bool isConditionTrue() {
         if (mode == ANALOGIN_BELOW) {
-            return lastReading < analogThreshold;
+            return fixedReading < fixedThreshold;
         }
         else if(mode == ANALOGIN_EXCEEDS) {
-            return lastReading > analogThreshold;
+            return fixedReading > fixedThreshold;
         }
         else {
-            auto change = abs(analogThreshold - lastReading);
-            return change > analogThreshold;
+            auto change = abs(int32_t(referenceReading) - int32_t(fixedReading));
+            return change > fixedThreshold;
         }
     }
 
@@ -125,4 +161,166 @@ public:
     }
 };
 
+/** the maximum number of channels that an AnalogMonitorEvent can watch, up to 32 as fired pins are a bitmask */
+#ifndef ANALOG_MONITOR_MAX_CHANNELS
+#define ANALOG_MONITOR_MAX_CHANNELS ANALOG_SCAN_MAX_PINS
+#endif
+
+/**
+ * Internally used by AnalogMonitorEvent to hold the condition and state of each channel.
+ */
+struct AnalogMonitorChannel {
+    pinid_t pin;
+    AnalogInEvent::AnalogEventMode mode;
+    uint8_t groupIndex;
+    uint8_t bitDepth;
+    bool latched;
+    analogfixed_t threshold;
+    analogfixed_t hysteresis;
+    analogfixed_t reference;
+};
+
+/**
+ * An event that watches many analog pins at once, all the pins are read in one sweep of an AnalogScanGroup on each
+ * poll, and every channel has its own condition. When one or more channels fire, the event is triggered and the
+ * exec method, which must be implemented, can find out which ones fired using getAndClearFiredMask. Bit N of the
+ * mask is set when the Nth channel added fired.
+ *
+ * The conditions are the same as AnalogInEvent, but with hysteresis:
+ *
+ * * ANALOGIN_EXCEEDS - fires when above threshold, and cannot fire again until it drops below threshold - hysteresis.
+ * * ANALOGIN_BELOW - fires when below threshold, and cannot fire again until it rises above threshold + hysteresis.
+ * * ANALOGIN_CHANGE - fires when the reading moves by more than threshold from the reading that last fired.
+ *
+ * All the comparisons are made in fixed point. If the scan group is running continuously, each poll uses the latest
+ * sweep, otherwise a sweep is made on each poll.
+ */
+class AnalogMonitorEvent : public BaseEvent {
+private:
+    AnalogScanGroup* group;
+    AnalogMonitorChannel channels[ANALOG_MONITOR_MAX_CHANNELS];
+    uint8_t channelCount;
+    uint32_t pollInterval;
+    uint32_t firedMask;
+public:
+    /**
+     * Create a monitor event that reads its pins through a scan group
+     * @param group the scan group to use, the pins are added to it as channels are added.
+     * @param pollInterval the interval in microseconds between checks
+     */
+    AnalogMonitorEvent(AnalogScanGroup* group, uint32_t pollInterval) : BaseEvent() {
+        this->group = group;
+        this->pollInterval = pollInterval;
+        this->channelCount = 0;
+        this->firedMask = 0;
+    }
+
+    /**
+     * Add a channel to be monitored
+     * @param pin the analog pin to watch
+     * @param mode the condition, see class documentation
+     * @param threshold the threshold between 0 and 1
+     * @param hysteresis for exceeds and below, how far back past the threshold the reading must go to re-arm
+     * @return the channel number, which is also the bit in the fired mask, or -1 if it could not be added.
+     */
+    int addChannel(pinid_t pin, AnalogInEvent::AnalogEventMode mode, float threshold, float hysteresis = 0.0F) {
+        if(channelCount >= ANALOG_MONITOR_MAX_CHANNELS || channelCount >= 32 || !group->addPin(pin)) return -1;
+        auto& ch = channels[channelCount];
+        ch.pin = pin;
+        ch.mode = mode;
+        ch.groupIndex = group->indexOf(pin);
+        ch.bitDepth = group->getBitDepth(DIR_IN, pin);
+        ch.latched = false;
+        ch.threshold = analogFixedFromFloat(threshold);
+        ch.hysteresis = analogFixedFromFloat(hysteresis);
+        ch.reference = 0;
+        return channelCount++;
+    }
+
+    /**
+     * Change to another polling interval
+     * @param micros the new polling interval in microseconds
+     */
+    void setPollInterval(uint32_t micros) {
+        pollInterval = micros;
+    }
+
+    /** @return the number of channels being monitored */
+    uint8_t getChannelCount() const { return channelCount; }
+
+    /**
+     * Gets the latest reading of a channel from the last sweep
+     * @param channel the channel number
+     * @return the reading in fixed point
+     */
+    analogfixed_t getReadingFixed(uint8_t channel) const {
+        if(channel >= channelCount) return 0;
+        return analogScaleToFixed(group->getResult(channels[channel].groupIndex), channels[channel].bitDepth);
+    }
+
+    /**
+     * Gets the channels that have fired since the last call, and clears them. Call from exec.
+     * @return a bitmask of channels that have fired, bit 0 being the first channel added.
+     */
+    uint32_t getAndClearFiredMask() {
+        uint32_t mask = firedMask;
+        firedMask = 0;
+        return mask;
+    }
+
+    /**
+     * Sweeps the pins and checks every channel against its condition, triggering the event if any fired.
+     * @return the poll interval
+     */
+    uint32_t timeOfNextCheck() override {
+        if(channelCount == 0) return pollInterval;
+        if(!group->isContinuous()) group->sweep();
+
+        uint32_t newlyFired = 0;
+        for(uint8_t i = 0; i < channelCount; i++) {
+            if(checkChannel(channels[i], getReadingFixed(i))) newlyFired |= (1UL << i);
+        }
+
+        if(newlyFired) {
+            firedMask |= newlyFired;
+            setTriggered(true);
+        }
+        return pollInterval;
+    }
+
+private:
+    static bool checkChannel(AnalogMonitorChannel& ch, analogfixed_t reading) {
+        int32_t value = reading;
+        int32_t threshold = ch.threshold;
+        switch(ch.mode) {
+            case AnalogInEvent::ANALOGIN_EXCEEDS:
+                if(ch.latched) {
+                    if(value < threshold - ch.hysteresis) ch.latched = false;
+                    return false;
+                }
+                ch.latched = value > threshold;
+                return ch.latched;
+            case AnalogInEvent::ANALOGIN_BELOW:
+                if(ch.latched) {
+                    if(value > threshold + ch.hysteresis) ch.latched = false;
+                    return false;
+                }
+                ch.latched = value < threshold;
+                return ch.latched;
+            default:
+                if(!ch.latched) {
+                    // the first reading becomes the reference for change detection.
+                    ch.latched = true;
+                    ch.reference = reading;
+                    return false;
+                }
+                if(abs(value - int32_t(ch.reference)) > threshold) {
+                    ch.reference = reading;
+                    return true;
+                }
+                return false;
+        }
+    }
+};
+
 #endif //IOABSTRACTION_DEVICEEVENTS_H
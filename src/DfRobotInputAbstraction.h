@@ -34,6 +34,7 @@ struct DfRobotAnalogRanges {
 };
 
 #define ALLOWABLE_RANGE 0.01F
+#define ALLOWABLE_RANGE_FIXED analogfixed_t(ALLOWABLE_RANGE * float(ANALOG_FIXED_MAX))
 #ifdef IOA_USE_MBED
 #define pgmAsFloat(x) ((float)(*x))
 #else
@@ -49,24 +50,33 @@ struct DfRobotAnalogRanges {
  * * pin2 = down (DF_KEY_DOWN)
  * * pin3 = left (DF_KEY_LEFT)
  * * pin4 = select (DF_KEY_SELECT)
+ *
+ * The ranges are read from program memory once during construction and held in fixed point, so that each
+ * reading is compared without any floating point operations.
  */
 class DfRobotInputAbstraction : public BasicIoAbstraction {
 private:
     pinid_t analogPin;
     uint8_t readCache;
-    float lastReading;
-    const DfRobotAnalogRanges* analogRanges;
+    analogfixed_t lastReading;
+    analogfixed_t fixedRanges[5];
     AnalogDevice* device;
 
 public:
     DfRobotInputAbstraction(const DfRobotAnalogRanges* ranges, pinid_t pin, AnalogDevice* device) {
-        analogRanges = ranges;
         analogPin = pin;
         this->device = device;
 
+        // held in ascending order of threshold, as the keys are checked in this order
+        fixedRanges[0] = analogFixedFromFloat(pgmAsFloat(&ranges->right));
+        fixedRanges[1] = analogFixedFromFloat(pgmAsFloat(&ranges->up));
+        fixedRanges[2] = analogFixedFromFloat(pgmAsFloat(&ranges->down));
+        fixedRanges[3] = analogFixedFromFloat(pgmAsFloat(&ranges->left));
+        fixedRanges[4] = analogFixedFromFloat(pgmAsFloat(&ranges->select));
+
         device->initPin(analogPin, DIR_IN);
-        lastReading = device->getCurrentValue(analogPin);
-        readCache = mapAnalogToPin(lastReading);
+        lastReading = device->getCurrentFixed(analogPin);
+        readCache = mapFixedToPin(lastReading);
     }
 
     uint8_t readValue(pinid_t pin) override {
@@ -78,21 +88,26 @@ public:
     }
 
 	bool runLoop() override { 
-        auto newReading = device->getCurrentFloat(analogPin);
-        if(abs(newReading - lastReading) > ALLOWABLE_RANGE) {
-            readCache = mapAnalogToPin(newReading);
+        auto newReading = device->getCurrentFixed(analogPin);
+        if(abs(int32_t(newReading) - int32_t(lastReading)) > int32_t(ALLOWABLE_RANGE_FIXED)) {
+            readCache = mapFixedToPin(newReading);
         }
         lastReading = newReading;
         return true;
     }
 
-    uint8_t mapAnalogToPin(float reading) {
+    /**
+     * Maps a fixed point reading onto the key that it represents
+     * @param reading the reading, see AnalogDevice::getCurrentFixed
+     * @return the port value with the bit for the key set, or 0 if no key.
+     */
+    uint8_t mapFixedToPin(analogfixed_t reading) {
         uint8_t ret = 0xff;
-        if(reading < pgmAsFloat(&analogRanges->right)) ret =  DF_KEY_RIGHT;
-        else if(reading < pgmAsFloat(&analogRanges->up)) ret =  DF_KEY_UP;
-        else if(reading < pgmAsFloat(&analogRanges->down)) ret = DF_KEY_DOWN;
-        else if(reading < pgmAsFloat(&analogRanges->left)) ret = DF_KEY_LEFT;
-        else if(reading < pgmAsFloat(&analogRanges->select)) ret = DF_KEY_SELECT;
+        if(reading < fixedRanges[0]) ret =  DF_KEY_RIGHT;
+        else if(reading < fixedRanges[1]) ret =  DF_KEY_UP;
+        else if(reading < fixedRanges[2]) ret = DF_KEY_DOWN;
+        else if(reading < fixedRanges[3]) ret = DF_KEY_LEFT;
+        else if(reading < fixedRanges[4]) ret = DF_KEY_SELECT;
 
         if(ret == 0xff) 
             return 0;
@@ -100,6 +115,15 @@ public:
             return 1 << ret;
     }
 
+    /**
+     * Maps a float reading onto the key that it represents, a convenience wrapper around mapFixedToPin
+     * @param reading the reading between 0 and 1
+     * @return the port value with the bit for the key set, or 0 if no key.
+     */
+    uint8_t mapAnalogToPin(float reading) {
+        return mapFixedToPin(analogFixedFromFloat(reading));
+    }
+
     // we ignore all non-input methods, as this is input only
 
     void pinDirection(pinid_t pin, uint8_t mode) override {
@@ -129,12 +153,12 @@ const PROGMEM DfRobotAnalogRanges dfRobotV1AvrRanges { 0.0488F, 0.1904F, 0.3710F
 
 
 inline IoAbstractionRef inputFromDfRobotShield(uint8_t pin = A0, AnalogDevice* device = nullptr) {
-    device = new ArduinoAnalogDevice();
+    if(device == nullptr) device = internalAnalogIo();
     return new DfRobotInputAbstraction(&dfRobotAvrRanges, pin, device);
 }
 
 inline IoAbstractionRef inputFromDfRobotShieldV1(uint8_t pin = A0, AnalogDevice* device = nullptr) {
-    device = new ArduinoAnalogDevice();
+    if(device == nullptr) device = internalAnalogIo();
     return new DfRobotInputAbstraction(&dfRobotV1AvrRanges, pin, device);
 }
 
@@ -4,6 +4,16 @@
  */
 #include <EepromAbstraction.h>
 
+uint16_t eepromCrc16(const uint8_t* data, size_t len, uint16_t crc) {
+    for(size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8U;
+        for(uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000U) ? (uint16_t)((crc << 1U) ^ 0x1021U) : (uint16_t)(crc << 1U);
+        }
+    }
+    return crc;
+}
+
 #ifdef __AVR__
 
 uint8_t AvrEeprom::read8(EepromPosition position) {
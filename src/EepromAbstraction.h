@@ -26,6 +26,22 @@
  */
 typedef uint16_t EepromPosition;
 
+/**
+ * Defines an address within eeprom storage for the wide functions, that can address devices larger than 64KB
+ */
+typedef uint32_t EepromWidePosition;
+
+/**
+ * Calculates a CRC-16/CCITT over a block of data, used by the storage layers that sit on top of an eeprom to detect
+ * records that were never written or were only partly written when power was lost. It is calculated bit by bit so
+ * that there is no table taking up flash. To continue a CRC over several blocks, pass the previous result as crc.
+ * @param data the data to check
+ * @param len the length of the data
+ * @param crc the starting value, leave as the default for a new CRC
+ * @return the CRC of the data
+ */
+uint16_t eepromCrc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFFU);
+
 /**
  * Provides an abstraction on eeprom storage, to allow either on chip or external I2c based eeprom storage, or even
  * No storage whatsoever. This helps no end with 32 bit boards that don't have eeprom!
@@ -40,6 +56,20 @@ public:
 	 */
 	virtual bool hasErrorOccurred() { return false;}
 
+	/**
+	 * Gets the size of the write page of the underlying storage, writes that stay within one page are done
+	 * in a single write cycle. Storage that has no concept of pages returns 0.
+	 * @return the page size in bytes, or 0 if not paged
+	 */
+	virtual uint16_t getPageSize() { return 0; }
+
+	/**
+	 * Gets the order that read16/read32 and write16/write32 store bytes in, so that anything layered on top of
+	 * this rom can keep the same layout. Most storage is least significant byte first.
+	 * @return true if multi byte values are stored most significant byte first
+	 */
+	virtual bool isBigEndian() { return false; }
+
 	/** 
 	 * Read an 8 bit (byte) value at a specified position 
 	 * @param position address at which to read
@@ -94,6 +124,42 @@ public:
 	 * @param len the length of the array
 	 */
 	virtual void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) = 0;
+
+	/**
+	 * Read a block of any length from a position that can be beyond 64KB into memory. Implementations that support
+	 * larger devices override this, the default calls readIntoMemArray in 255 byte parts, so it can only address
+	 * the first 64KB.
+	 * @param memDest the memory where the EEPROM data should be copied to
+	 * @param romSrc the source position in EEPROM storage
+	 * @param len the length of the block
+	 */
+	virtual void readIntoMemArrayWide(uint8_t* memDest, EepromWidePosition romSrc, size_t len) {
+		while(len > 0) {
+			uint8_t currentGo = len > 0xffU ? 0xffU : (uint8_t)len;
+			readIntoMemArray(memDest, (EepromPosition)romSrc, currentGo);
+			memDest += currentGo;
+			romSrc += currentGo;
+			len -= currentGo;
+		}
+	}
+
+	/**
+	 * Write a block of any length from memory to a position that can be beyond 64KB. Implementations that support
+	 * larger devices override this, the default calls writeArrayToRom in 255 byte parts, so it can only address
+	 * the first 64KB.
+	 * @param romDest the start position in eeprom storage that the block should be copied to
+	 * @param memSrc the memory where the block should be copied from
+	 * @param len the length of the block
+	 */
+	virtual void writeArrayToRomWide(EepromWidePosition romDest, const uint8_t* memSrc, size_t len) {
+		while(len > 0) {
+			uint8_t currentGo = len > 0xffU ? 0xffU : (uint8_t)len;
+			writeArrayToRom((EepromPosition)romDest, memSrc, currentGo);
+			memSrc += currentGo;
+			romDest += currentGo;
+			len -= currentGo;
+		}
+	}
 };
 
 // only include the atmel AVR support if it's available on this platform.
@@ -9,11 +9,26 @@
 
 #define READY_TRIES_COUNT 100
 
-I2cAt24Eeprom::I2cAt24Eeprom(uint8_t address, uint8_t pageSize, WireType wireImpl) {
+I2cAt24Eeprom::I2cAt24Eeprom(uint8_t address, uint16_t pageSize, WireType wireImpl, uint8_t highAddressBits)
+        : writeEvent(this) {
 	this->wireImpl = wireImpl;
 	this->eepromAddr = address;
+	this->highAddressMask = (1U << highAddressBits) - 1U;
+	this->highAddressShift = AT24_HIGH_ADDRESS_SHIFT;
 	this->pageSize = pageSize;
     this->errorOccurred = false;
+    this->writeQueue = nullptr;
+    this->queueSize = this->queueHead = this->queueCount = this->pollCount = 0;
+    this->writeInFlight = this->holdQueue = this->queueFailed = this->completionPending = false;
+    this->completionFn = nullptr;
+    this->writeEventTask = TASKMGR_INVALIDID;
+}
+
+I2cAt24Eeprom::~I2cAt24Eeprom() {
+    if(writeQueue == nullptr) return;
+    waitForPendingWrites();
+    taskManager.cancelTask(writeEventTask);
+    delete[] writeQueue;
 }
 
 bool I2cAt24Eeprom::hasErrorOccurred() {
@@ -22,15 +37,17 @@ bool I2cAt24Eeprom::hasErrorOccurred() {
     return ret;
 }
 
-uint8_t I2cAt24Eeprom::findMaximumInPage(uint16_t destEeprom, uint8_t len) const {
-	// We can read/write in bulk, but do no exceed the page size or we will read / write
-	// the wrong bytes
-	uint16_t offs = destEeprom % pageSize;
-    uint16_t currentGo = min((uint16_t)pageSize, uint16_t(offs + len)) - offs;
+size_t I2cAt24Eeprom::findMaximumInPage(EepromWidePosition destEeprom, size_t len, size_t maxBurst) const {
+	// We can write in bulk, but do no exceed the page size or we will write the wrong bytes
+	size_t offs = destEeprom % pageSize;
+    size_t currentGo = min(size_t(pageSize - offs), len);
 
 	// dont exceed the buffer length of the  wire library
-    auto absoluteMax = WIRE_BUFFER_SIZE - 2;
-	return min(currentGo, (uint16_t) absoluteMax);
+	return min(currentGo, maxBurst);
+}
+
+uint8_t I2cAt24Eeprom::deviceAddressFor(EepromWidePosition memAddr) const {
+    return eepromAddr | (((memAddr >> 16U) & highAddressMask) << highAddressShift);
 }
 
 uint8_t I2cAt24Eeprom::read8(EepromPosition position) {
@@ -43,85 +60,238 @@ void I2cAt24Eeprom::write8(EepromPosition position, uint8_t val) {
 }
 
 uint16_t I2cAt24Eeprom::read16(EepromPosition position) {
-    uint16_t ret = ((uint16_t)readByte(position++) << 8U);
-    ret |= readByte(position);
-    return ret;
+    uint8_t data[2] = {0};
+    readIntoMemArray(data, position, sizeof data);
+    return ((uint16_t)data[0] << 8U) | data[1];
 }
 
 void I2cAt24Eeprom::write16(EepromPosition position, uint16_t val) {
-    if(read16(position) == val) return;
-
-    auto hiByte = (uint8_t)(val >> 8U);
-    auto loByte = (uint8_t)val;
-    writeByte(position, hiByte);
-    writeByte(position + 1,   loByte);
+    uint8_t data[2];
+    data[0] = (uint8_t)(val >> 8U);
+    data[1] = (uint8_t)val;
+    writeIfChanged(position, data, sizeof data);
 }
 
 uint32_t I2cAt24Eeprom::read32(EepromPosition position) {
-    uint32_t ret = ((uint32_t)readByte(position++)) << 24U;
-    ret |= ((uint32_t)readByte(position++)) << 16U;
-    ret |= ((uint32_t)readByte(position++)) << 8U;
-    ret |= (readByte(position));
-    return ret;
+    uint8_t data[4] = {0};
+    readIntoMemArray(data, position, sizeof data);
+    return ((uint32_t)data[0] << 24U) | ((uint32_t)data[1] << 16U) | ((uint32_t)data[2] << 8U) | data[3];
 }
 
 void I2cAt24Eeprom::write32(EepromPosition position, uint32_t val) {
-    if(read32(position) == val) return;
+    uint8_t data[4];
+    data[0] = (uint8_t)(val >> 24U);
+    data[1] = (uint8_t)(val >> 16U);
+    data[2] = (uint8_t)(val >> 8U);
+    data[3] = (uint8_t)val;
+    writeIfChanged(position, data, sizeof data);
+}
 
-    writeByte(position++, (uint8_t)(val >> 24U));
-    writeByte(position++, (uint8_t)(val >> 16U));
-    writeByte(position++, (uint8_t)(val >> 8U));
-    writeByte(position,   (uint8_t)val);
+void I2cAt24Eeprom::writeIfChanged(EepromPosition position, const uint8_t* data, uint8_t len) {
+    // read the whole span in one go, then only write the bytes from the first to the last that differ.
+    uint8_t current[4];
+    for(uint8_t i = 0; i < len; i++) current[i] = ~data[i];
+    readIntoMemArray(current, position, len);
+
+    int first = -1, last = -1;
+    for(uint8_t i = 0; i < len; i++) {
+        if(current[i] == data[i]) continue;
+        if(first < 0) first = i;
+        last = i;
+    }
+    if(first < 0) return;
+    writeArrayToRom(position + first, &data[first], uint8_t(last - first + 1));
 }
 
 uint8_t I2cAt24Eeprom::readByte(EepromPosition position) {
-    writeAddressWire(position);
     uint8_t data = 0;
-    errorOccurred = errorOccurred || !ioaWireRead(wireImpl, eepromAddr, &data, 1);
-
+    readChunk(&data, position, 1);
     return data;
 }
 
+bool I2cAt24Eeprom::readChunk(uint8_t* memDest, EepromWidePosition romSrc, size_t len) {
+    // when every byte is still waiting in the write queue, there is no need to go to the device at all. Coverage
+    // is only tracked for the first 32 bytes, so longer reads always go to the device.
+    uint32_t allBytes = len < 32 ? (1UL << len) - 1UL : 0xffffffffUL;
+    uint32_t queued = (queueCount != 0) ? overlayQueuedWrites(nullptr, romSrc, len) : 0;
+
+    bool ok = true;
+    if(queued != allBytes || len > 32) {
+        // don't let a queued write start between setting the address and reading
+        bool wasHeld = holdQueue;
+        holdQueue = true;
+        ok = writeAddressWire(romSrc) && wireRead(deviceAddressFor(romSrc), memDest, len);
+        errorOccurred = errorOccurred || !ok;
+        holdQueue = wasHeld;
+    }
+    if(queued != 0) overlayQueuedWrites(memDest, romSrc, len);
+    return ok;
+}
+
 void I2cAt24Eeprom::writeByte(EepromPosition position, uint8_t val) {
     uint8_t data[1];
     data[0] = (char)val;
     writeAddressWire(position, data, 1);
 }
 
-void I2cAt24Eeprom::writeAddressWire(EepromPosition memAddr, const uint8_t *data, int len) {
-    if(len > 32)
-    {
-        errorOccurred = true;
-        return;
+bool I2cAt24Eeprom::writeAddressWire(EepromWidePosition memAddr, const uint8_t *data, size_t len) {
+    if(writeQueue != nullptr && data != nullptr && len > 0) {
+        // any failure of a queued write is reported later, when it is started
+        queueWrite(memAddr, data, len);
+        return true;
     }
-    uint8_t ch[34];
-    ch[0] = memAddr >> 8U;
-    ch[1] = memAddr & 0xffU;
-    if(data != nullptr && len > 0) {
-        memcpy(ch + 2, data, len);
-    }
-    errorOccurred = errorOccurred || ioaWireWriteWithRetry(wireImpl, eepromAddr, ch, len + 2, READY_TRIES_COUNT) == false;
+    bool ok = wireWrite(deviceAddressFor(memAddr), memAddr & 0xffffU, data, len, READY_TRIES_COUNT);
+    errorOccurred = errorOccurred || !ok;
+    return ok;
 }
 
 void I2cAt24Eeprom::readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) {
-    int romOffset = 0;
-    while(len > 0 && !errorOccurred) {
-        int currentGo = findMaximumInPage(romSrc + romOffset, len);
+    readIntoMemArrayWide(memDest, romSrc, len);
+}
+
+void I2cAt24Eeprom::writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) {
+    writeArrayToRomWide(romDest, memSrc, len);
+}
 
-        writeAddressWire(romSrc + romOffset);
-        errorOccurred = errorOccurred || !ioaWireRead(wireImpl, eepromAddr, &memDest[romOffset], currentGo);
-        romOffset += currentGo;
+void I2cAt24Eeprom::readIntoMemArrayWide(uint8_t* memDest, EepromWidePosition romSrc, size_t len) {
+    // only a failure during this call stops the transfer, an earlier error waiting in errorOccurred does not
+    bool ok = true;
+    while(len > 0 && ok) {
+        // reads are sequential across pages, but the high address bits are in the device address so don't cross 64KB
+        size_t currentGo = min(len, size_t(AT24_MAX_READ_BURST));
+        currentGo = min(currentGo, size_t(0x10000UL - (romSrc & 0xffffUL)));
+
+        ok = readChunk(memDest, romSrc, currentGo);
+        memDest += currentGo;
+        romSrc += currentGo;
         len -= currentGo;
     }
 }
 
-void I2cAt24Eeprom::writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t origLen) {
-    int romOffset = 0;
-    int leftToGo = origLen;
-    while(leftToGo > 0 && !errorOccurred) {
-        int currentGo = findMaximumInPage(romDest + romOffset, leftToGo);
-        writeAddressWire(romDest + romOffset, &memSrc[romOffset], currentGo);
-        leftToGo -= currentGo;
-        romOffset += currentGo;
+void I2cAt24Eeprom::writeArrayToRomWide(EepromWidePosition romDest, const uint8_t* memSrc, size_t len) {
+    size_t maxBurst = writeQueue != nullptr ? AT24_ASYNC_WRITE_SIZE : AT24_MAX_WRITE_BURST;
+    bool ok = true;
+    while(len > 0 && ok) {
+        size_t currentGo = findMaximumInPage(romDest, len, maxBurst);
+        ok = writeAddressWire(romDest, memSrc, currentGo);
+        memSrc += currentGo;
+        romDest += currentGo;
+        len -= currentGo;
     }
 }
+
+bool I2cAt24Eeprom::wireWrite(uint8_t deviceAddr, uint16_t memAddr, const uint8_t* data, size_t len, int retries) {
+    uint8_t addr[2];
+    addr[0] = memAddr >> 8U;
+    addr[1] = memAddr & 0xffU;
+    return ioaWireWritePrefixed(wireImpl, deviceAddr, addr, sizeof addr, data, len, retries);
+}
+
+bool I2cAt24Eeprom::wireRead(uint8_t deviceAddr, uint8_t* data, size_t len) {
+    return ioaWireRead(wireImpl, deviceAddr, data, len);
+}
+
+bool I2cAt24Eeprom::wireReady() {
+    return ioaWireReady(wireImpl, eepromAddr);
+}
+
+void I2cAt24Eeprom::enableAsyncWrites(EepromWriteCompleteFn completeFn, uint8_t queueSize) {
+    this->completionFn = completeFn;
+    if(writeQueue != nullptr) return;
+    this->queueSize = queueSize == 0 ? 1 : queueSize;
+    writeQueue = new At24QueuedWrite[this->queueSize];
+    writeEventTask = taskManager.registerEvent(&writeEvent);
+}
+
+void I2cAt24Eeprom::waitForPendingWrites() {
+    while(queueCount != 0) {
+        if(processWriteQueue()) taskManager.yieldForMicros(AT24_ASYNC_POLL_MICROS);
+    }
+}
+
+void I2cAt24Eeprom::queueWrite(EepromWidePosition position, const uint8_t* data, uint8_t len) {
+    while(queueCount == queueSize) {
+        if(processWriteQueue() && queueCount == queueSize) taskManager.yieldForMicros(AT24_ASYNC_POLL_MICROS);
+    }
+
+    auto& entry = writeQueue[(queueHead + queueCount) % queueSize];
+    entry.position = position;
+    entry.len = len;
+    memcpy(entry.data, data, len);
+    queueCount++;
+
+    // start straight away if the device is idle, and make sure the event starts polling for the end of the cycle
+    if(!writeInFlight && !holdQueue) {
+        if(!startQueuedWrite()) processWriteQueue();
+    }
+    taskManager.triggerEvents();
+}
+
+bool I2cAt24Eeprom::startQueuedWrite() {
+    auto& entry = writeQueue[queueHead];
+    pollCount = 0;
+
+    // the device has already acknowledged, so there's no need to retry
+    writeInFlight = wireWrite(deviceAddressFor(entry.position), entry.position & 0xffffU, entry.data, entry.len, 0);
+    if(!writeInFlight) {
+        serdebugF2("AT24 queued write failed ", entry.position);
+        queueFailed = errorOccurred = true;
+    }
+    return writeInFlight;
+}
+
+bool I2cAt24Eeprom::processWriteQueue() {
+    if(queueCount == 0) return false;
+
+    if(writeInFlight) {
+        if(!wireReady()) {
+            if(++pollCount < AT24_ASYNC_MAX_POLLS) return true;
+            serdebugF2("AT24 write cycle timeout ", writeQueue[queueHead].position);
+            queueFailed = errorOccurred = true;
+        }
+        writeInFlight = false;
+        queueHead = (queueHead + 1) % queueSize;
+        queueCount--;
+    }
+
+    while(queueCount != 0 && !writeInFlight && !holdQueue) {
+        if(startQueuedWrite()) break;
+        // a write that could not be started is dropped, it has already been reported as an error
+        queueHead = (queueHead + 1) % queueSize;
+        queueCount--;
+    }
+
+    if(queueCount == 0) {
+        completionPending = true;
+        return false;
+    }
+    return true;
+}
+
+uint32_t I2cAt24Eeprom::overlayQueuedWrites(uint8_t* memDest, EepromWidePosition romSrc, size_t len) {
+    // apply oldest first, so that the most recent write to each byte wins
+    uint32_t covered = 0;
+    for(uint8_t i = 0; i < queueCount; i++) {
+        auto& entry = writeQueue[(queueHead + i) % queueSize];
+        for(uint8_t j = 0; j < entry.len; j++) {
+            if((entry.position + j) < romSrc || (entry.position + j) >= (romSrc + len)) continue;
+            uint32_t offs = entry.position + j - romSrc;
+            if(memDest != nullptr) memDest[offs] = entry.data[j];
+            if(offs < 32) covered |= (1UL << offs);
+        }
+    }
+    return covered;
+}
+
+uint32_t At24WriteQueueEvent::timeOfNextCheck() {
+    bool busy = eeprom->processWriteQueue();
+    if(eeprom->completionPending) setTriggered(true);
+    return busy ? AT24_ASYNC_POLL_MICROS : AT24_ASYNC_IDLE_MICROS;
+}
+
+void At24WriteQueueEvent::exec() {
+    eeprom->completionPending = false;
+    bool success = !eeprom->queueFailed;
+    eeprom->queueFailed = false;
+    if(eeprom->completionFn != nullptr) eeprom->completionFn(success);
+}
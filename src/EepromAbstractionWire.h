@@ -27,6 +27,10 @@
 #define PAGESIZE_AT24C256  64
 /** the page size for 512bit (64KB) roms */
 #define PAGESIZE_AT24C512 128
+/** the page size for 1Mbit (128KB) roms, construct with 1 high address bit */
+#define PAGESIZE_AT24CM01 256
+/** the page size for 2Mbit (256KB) roms, construct with 2 high address bits */
+#define PAGESIZE_AT24CM02 256
 
 /**
  * An implementation of eeprom that works with the very well known At24CXXX chips over i2c. Before
@@ -48,19 +52,136 @@
 #define WIRE_BUFFER_SIZE 32
 #endif
 
+/** the most data that is written in one transaction, on Arduino the two address bytes must also fit the buffer */
+#ifndef AT24_MAX_WRITE_BURST
+#ifdef IOA_USE_MBED
+#define AT24_MAX_WRITE_BURST 256
+#else
+#define AT24_MAX_WRITE_BURST (WIRE_BUFFER_SIZE - 2)
+#endif
+#endif
+
+/** the most data that is read in one transaction, reads are not limited by the page size */
+#ifndef AT24_MAX_READ_BURST
+#ifdef IOA_USE_MBED
+#define AT24_MAX_READ_BURST 256
+#else
+#define AT24_MAX_READ_BURST WIRE_BUFFER_SIZE
+#endif
+#endif
+
+/**
+ * How far the high memory address bits are shifted within the device address. On mbed the address is the 8 bit form
+ * where bit 0 is the read/write bit, so the memory bits start at bit 1.
+ */
+#ifdef IOA_USE_MBED
+#define AT24_HIGH_ADDRESS_SHIFT 1
+#else
+#define AT24_HIGH_ADDRESS_SHIFT 0
+#endif
+
+/** the number of page writes that can be waiting when asynchronous writes are enabled */
+#ifndef AT24_ASYNC_QUEUE_SIZE
+#define AT24_ASYNC_QUEUE_SIZE 4
+#endif
+
+/** how often the device is polled for the end of a write cycle, in microseconds */
+#ifndef AT24_ASYNC_POLL_MICROS
+#define AT24_ASYNC_POLL_MICROS 500
+#endif
+
+/** how often the queue is checked when there is nothing to write, in microseconds */
+#define AT24_ASYNC_IDLE_MICROS 100000
+
+/** the number of polls after which a write cycle that has not finished is treated as failed */
+#define AT24_ASYNC_MAX_POLLS 40
+
+/** the largest write that is held in one queue entry, a page write including the address must fit the wire buffer */
+#define AT24_ASYNC_WRITE_SIZE (WIRE_BUFFER_SIZE - 2)
+
+/**
+ * The callback used when all the queued writes have completed, success is false if any write failed.
+ */
+typedef void (*EepromWriteCompleteFn)(bool success);
+
+/**
+ * Internally used by I2cAt24Eeprom to hold a page write that is waiting or in progress.
+ */
+struct At24QueuedWrite {
+    EepromWidePosition position;
+    uint8_t len;
+    uint8_t data[AT24_ASYNC_WRITE_SIZE];
+};
+
+class I2cAt24Eeprom;
+
+/**
+ * Internally used by I2cAt24Eeprom to poll the device during write cycles and start the next queued write once the
+ * device acknowledges, it also calls the completion callback.
+ */
+class At24WriteQueueEvent : public BaseEvent {
+private:
+    I2cAt24Eeprom* eeprom;
+public:
+    explicit At24WriteQueueEvent(I2cAt24Eeprom* eeprom) : BaseEvent() {
+        this->eeprom = eeprom;
+    }
+    uint32_t timeOfNextCheck() override;
+    void exec() override;
+};
+
 
 class I2cAt24Eeprom : public EepromAbstraction {
 	WireType wireImpl;
 	uint8_t  eepromAddr;
-	uint8_t  pageSize;
+	uint8_t  highAddressMask;
+	uint16_t pageSize;
 	bool     errorOccurred;
+	At24QueuedWrite* writeQueue;
+	uint8_t  queueSize;
+	uint8_t  queueHead;
+	uint8_t  queueCount;
+	uint8_t  pollCount;
+	bool     writeInFlight;
+	bool     holdQueue;
+	bool     queueFailed;
+	bool     completionPending;
+	EepromWriteCompleteFn completionFn;
+	At24WriteQueueEvent writeEvent;
+	taskid_t writeEventTask;
 public:
 	/**
 	 * Create an I2C EEPROM object giving it's address and the page size of the device.
-	 * Page sizes are defined in this header file.
+	 * Page sizes are defined in this header file. Devices larger than 64KB, such as the AT24CM01 and AT24CM02,
+	 * take the highest memory address bits in the lowest bits of the device address (above the read/write bit on mbed,
+	 * see AT24_HIGH_ADDRESS_SHIFT), for these provide the number
+	 * of high address bits, 1 for the AT24CM01 and 2 for the AT24CM02, and use the wide functions to access memory
+	 * beyond 64KB.
+	 * @param address the I2C address of the device, with the high address bits as 0
+	 * @param pageSize the page size of the device
+	 * @param wireImpl the wire implementation to use
+	 * @param highAddressBits the number of memory address bits carried in the device address
+	 */
+    I2cAt24Eeprom(uint8_t address, uint16_t pageSize, WireType wireImpl = defaultWireTypePtr, uint8_t highAddressBits = 0);
+	~I2cAt24Eeprom() override;
+
+	/**
+	 * Turns on asynchronous writes. From then on, each page write is added to a queue and the call returns straight
+	 * away, instead of waiting for the write cycle of the device to finish. A task manager event polls the device
+	 * until it acknowledges and then starts the next queued write. Reads of data that is still queued are served
+	 * from the queue. Should the queue fill up, the write waits for space while yielding to task manager.
+	 * @param completeFn optionally, called each time the queue has been fully written
+	 * @param queueSize the number of page writes that can be queued
 	 */
-    I2cAt24Eeprom(uint8_t address, uint8_t pageSize, WireType wireImpl = defaultWireTypePtr);
-	~I2cAt24Eeprom() override = default;
+	void enableAsyncWrites(EepromWriteCompleteFn completeFn = nullptr, uint8_t queueSize = AT24_ASYNC_QUEUE_SIZE);
+
+	/** @return true if there are queued writes that have not yet completed */
+	bool isWritePending() const { return queueCount != 0; }
+
+	/**
+	 * Waits for all queued writes to complete while yielding to task manager, call before power down.
+	 */
+	void waitForPendingWrites();
 
 	/** 
 	 * This indicates if an I2C error has ocrrued at any point since the last call to error.
@@ -68,6 +189,12 @@ public:
 	 */
 	bool hasErrorOccurred() override;
 
+	/** @return the page size of the device that was provided in the constructor */
+	uint16_t getPageSize() override { return pageSize; }
+
+	/** @return true, multi byte values are stored most significant byte first */
+	bool isBigEndian() override { return true; }
+
 	uint8_t read8(EepromPosition position) override;
 	void write8(EepromPosition position, uint8_t val) override;
 
@@ -79,11 +206,58 @@ public:
 
 	void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override;
 	void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override;
+
+	/**
+	 * Reads directly into memDest in bursts of up to AT24_MAX_READ_BURST, without any intermediate buffer.
+	 */
+	void readIntoMemArrayWide(uint8_t* memDest, EepromWidePosition romSrc, size_t len) override;
+
+	/**
+	 * Writes in page sized bursts, limited by AT24_MAX_WRITE_BURST, the data is sent from memSrc without copying.
+	 */
+	void writeArrayToRomWide(EepromWidePosition romDest, const uint8_t* memSrc, size_t len) override;
+
+protected:
+    /** the shift applied to the high memory address bits, AT24_HIGH_ADDRESS_SHIFT unless changed for testing */
+    uint8_t highAddressShift;
+
+    /**
+     * Writes the memory address followed by the data in one transaction, retrying while the device is busy with a
+     * write cycle. Overridden to simulate the device in tests.
+     * @param deviceAddr the I2C address including any high memory address bits
+     * @param memAddr the lower 16 bits of the memory address
+     * @return true if the device acknowledged the write
+     */
+    virtual bool wireWrite(uint8_t deviceAddr, uint16_t memAddr, const uint8_t* data, size_t len, int retries);
+
+    /**
+     * Reads from the current address of the device in one transaction. Overridden to simulate the device in tests.
+     * @param deviceAddr the I2C address including any high memory address bits
+     * @return true if the read succeeded
+     */
+    virtual bool wireRead(uint8_t deviceAddr, uint8_t* data, size_t len);
+
+    /**
+     * Checks if the device acknowledges its address, which it does not do during a write cycle. Overridden to
+     * simulate the device in tests.
+     * @return true if the device is ready
+     */
+    virtual bool wireReady();
+
 private:
-	uint8_t findMaximumInPage(uint16_t romDest, uint8_t len) const;
+    friend class At24WriteQueueEvent;
+    bool processWriteQueue();
+    bool startQueuedWrite();
+    void queueWrite(EepromWidePosition position, const uint8_t* data, uint8_t len);
+    uint32_t overlayQueuedWrites(uint8_t* memDest, EepromWidePosition romSrc, size_t len);
+    bool readChunk(uint8_t* memDest, EepromWidePosition romSrc, size_t len);
+
+	size_t findMaximumInPage(EepromWidePosition romDest, size_t len, size_t maxBurst) const;
+	uint8_t deviceAddressFor(EepromWidePosition memAddr) const;
 	void writeByte(EepromPosition position, uint8_t val);
 	uint8_t readByte(EepromPosition position);
-    void writeAddressWire(uint16_t memAddr, const uint8_t* data = nullptr, int len = 0);
+    bool writeAddressWire(EepromWidePosition memAddr, const uint8_t* data = nullptr, size_t len = 0);
+    void writeIfChanged(EepromPosition position, const uint8_t* data, uint8_t len);
 };
 
 #endif /* IOABSTRACTION_EEPROMABSTRACTIONWIRE_H_ */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "EepromLogStore.h"
+#include "IoLogging.h"
+
+// the layout of a record within its slot
+#define LOG_REC_SEQUENCE 0
+#define LOG_REC_KEY 2
+#define LOG_REC_LENGTH 3
+#define LOG_REC_VALUE 4
+#define LOG_REC_CRC (EEPROM_LOG_SLOT_SIZE - 2)
+
+EepromLogStore::EepromLogStore(EepromAbstraction* rom, EepromPosition start, uint16_t length) : index() {
+    this->rom = rom;
+    this->start = start;
+    this->slotCount = length / EEPROM_LOG_SLOT_SIZE;
+    this->head = 0;
+    this->nextSequence = 0;
+    this->keyCount = 0;
+    this->compactTask = TASKMGR_INVALIDID;
+    this->recordsWritten = this->recordsRelocated = 0;
+}
+
+void EepromLogStore::begin() {
+    keyCount = 0;
+    head = 0;
+    nextSequence = 0;
+
+    // one pass through the area, keeping the latest record of each key, and the latest record overall which is
+    // just before the write position. Sequences are compared allowing for wrap around.
+    bool anyFound = false;
+    uint16_t newestSlot = 0, newestSequence = 0;
+    uint8_t record[EEPROM_LOG_SLOT_SIZE];
+    for(uint16_t slot = 0; slot < slotCount; slot++) {
+        if(!readSlot(slot, record)) continue;
+        uint16_t seq = (record[LOG_REC_SEQUENCE] << 8U) | record[LOG_REC_SEQUENCE + 1];
+        if(!anyFound || int16_t(seq - newestSequence) > 0) {
+            newestSequence = seq;
+            newestSlot = slot;
+            anyFound = true;
+        }
+
+        int idx = indexOf(record[LOG_REC_KEY]);
+        if(idx < 0 && keyCount < EEPROM_LOG_MAX_KEYS) {
+            idx = keyCount++;
+            index[idx].key = record[LOG_REC_KEY];
+        }
+        else if(idx < 0 || int16_t(seq - index[idx].sequence) <= 0) {
+            continue;
+        }
+        index[idx].slot = slot;
+        index[idx].sequence = seq;
+    }
+
+    if(anyFound) {
+        head = (newestSlot + 1) % slotCount;
+        nextSequence = newestSequence + 1;
+    }
+    serdebugF3("Log store keys, write slot ", keyCount, head);
+}
+
+int EepromLogStore::indexOf(uint8_t key) const {
+    for(uint8_t i = 0; i < keyCount; i++) {
+        if(index[i].key == key) return i;
+    }
+    return -1;
+}
+
+int EepromLogStore::indexForSlot(uint16_t slot) const {
+    for(uint8_t i = 0; i < keyCount; i++) {
+        if(index[i].slot == slot) return i;
+    }
+    return -1;
+}
+
+bool EepromLogStore::isLiveAhead(uint8_t slotsAhead) const {
+    for(uint8_t i = 1; i <= slotsAhead && i < slotCount; i++) {
+        if(indexForSlot((head + i) % slotCount) >= 0) return true;
+    }
+    return false;
+}
+
+bool EepromLogStore::readSlot(uint16_t slot, uint8_t* record) {
+    rom->readIntoMemArray(record, slotPosition(slot), EEPROM_LOG_SLOT_SIZE);
+    uint16_t crc = (record[LOG_REC_CRC] << 8U) | record[LOG_REC_CRC + 1];
+    return record[LOG_REC_LENGTH] <= EEPROM_LOG_VALUE_SIZE && eepromCrc16(record, LOG_REC_CRC) == crc;
+}
+
+void EepromLogStore::appendRecord(uint8_t key, const uint8_t* data, uint8_t len) {
+    // the slot at head is never the latest record of any key, so it can always be written
+    uint8_t record[EEPROM_LOG_SLOT_SIZE];
+    memset(record, 0, sizeof record);
+    uint16_t seq = nextSequence++;
+    record[LOG_REC_SEQUENCE] = seq >> 8U;
+    record[LOG_REC_SEQUENCE + 1] = seq & 0xffU;
+    record[LOG_REC_KEY] = key;
+    record[LOG_REC_LENGTH] = len;
+    memcpy(&record[LOG_REC_VALUE], data, len);
+    uint16_t crc = eepromCrc16(record, LOG_REC_CRC);
+    record[LOG_REC_CRC] = crc >> 8U;
+    record[LOG_REC_CRC + 1] = crc & 0xffU;
+    rom->writeArrayToRom(slotPosition(head), record, EEPROM_LOG_SLOT_SIZE);
+
+    int idx = indexOf(key);
+    if(idx < 0) {
+        idx = keyCount++;
+        index[idx].key = key;
+    }
+    index[idx].slot = head;
+    index[idx].sequence = seq;
+    head = (head + 1) % slotCount;
+}
+
+void EepromLogStore::relocate(uint8_t idx) {
+    uint8_t record[EEPROM_LOG_SLOT_SIZE];
+    if(readSlot(index[idx].slot, record)) {
+        appendRecord(record[LOG_REC_KEY], &record[LOG_REC_VALUE], record[LOG_REC_LENGTH]);
+        recordsRelocated++;
+    }
+    else {
+        // the record has been damaged outside of the store, it cannot be recovered so drop the key.
+        serdebugF2("Log store dropped damaged key ", index[idx].key);
+        index[idx] = index[--keyCount];
+    }
+}
+
+void EepromLogStore::compact(uint8_t slotsAhead) {
+    // each relocation moves the write position on by one, the guard stops a misconfigured store looping forever.
+    for(uint16_t guard = 0; guard < slotCount; guard++) {
+        int idx = -1;
+        for(uint8_t i = 1; i <= slotsAhead && i < slotCount && idx < 0; i++) {
+            idx = indexForSlot((head + i) % slotCount);
+        }
+        if(idx < 0) return;
+        relocate(idx);
+    }
+}
+
+void EepromLogStore::exec() {
+    compactTask = TASKMGR_INVALIDID;
+    compact();
+}
+
+bool EepromLogStore::writeValue(uint8_t key, const uint8_t* data, uint8_t len) {
+    if(len > EEPROM_LOG_VALUE_SIZE) return false;
+
+    int idx = indexOf(key);
+    if(idx < 0) {
+        if(keyCount >= EEPROM_LOG_MAX_KEYS || (keyCount + 2) > slotCount) return false;
+    }
+    else {
+        uint8_t record[EEPROM_LOG_SLOT_SIZE];
+        if(readSlot(index[idx].slot, record) && record[LOG_REC_LENGTH] == len &&
+                memcmp(&record[LOG_REC_VALUE], data, len) == 0) {
+            return true;
+        }
+    }
+
+    // make sure that the slot after the write position is free, then write the record.
+    compact(1);
+    appendRecord(key, data, len);
+    recordsWritten++;
+
+    if(compactTask == TASKMGR_INVALIDID && isLiveAhead(EEPROM_LOG_COMPACT_AHEAD)) {
+        compactTask = taskManager.execute(this);
+    }
+    return true;
+}
+
+uint8_t EepromLogStore::readValue(uint8_t key, uint8_t* data, uint8_t maxLen) {
+    int idx = indexOf(key);
+    if(idx < 0) return 0;
+    uint8_t record[EEPROM_LOG_SLOT_SIZE];
+    if(!readSlot(index[idx].slot, record)) return 0;
+    uint8_t len = min(record[LOG_REC_LENGTH], maxLen);
+    memcpy(data, &record[LOG_REC_VALUE], len);
+    return len;
+}
+
+bool EepromLogStore::writeUint32(uint8_t key, uint32_t val) {
+    uint8_t data[4];
+    data[0] = (uint8_t)(val >> 24U);
+    data[1] = (uint8_t)(val >> 16U);
+    data[2] = (uint8_t)(val >> 8U);
+    data[3] = (uint8_t)val;
+    return writeValue(key, data, sizeof data);
+}
+
+uint32_t EepromLogStore::readUint32(uint8_t key, uint32_t defaultValue) {
+    uint8_t data[4];
+    if(readValue(key, data, sizeof data) != sizeof data) return defaultValue;
+    return ((uint32_t)data[0] << 24U) | ((uint32_t)data[1] << 16U) | ((uint32_t)data[2] << 8U) | data[3];
+}
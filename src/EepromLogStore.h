@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _EEPROM_LOG_STORE_H_
+#define _EEPROM_LOG_STORE_H_
+
+/**
+ * @file EepromLogStore.h
+ *
+ * Contains a wear levelling key value store that appends records to a ring of slots in any EepromAbstraction,
+ * instead of rewriting the same position each time a value changes.
+ */
+
+#include "EepromAbstraction.h"
+#include "TaskManagerIO.h"
+
+/** the largest value that can be stored against a key, in bytes */
+#ifndef EEPROM_LOG_VALUE_SIZE
+#define EEPROM_LOG_VALUE_SIZE 10
+#endif
+
+/** the maximum number of different keys, each one takes a few bytes of RAM for the index */
+#ifndef EEPROM_LOG_MAX_KEYS
+#define EEPROM_LOG_MAX_KEYS 16
+#endif
+
+/** the number of slots ahead of the write position that background compaction keeps free */
+#ifndef EEPROM_LOG_COMPACT_AHEAD
+#define EEPROM_LOG_COMPACT_AHEAD 2
+#endif
+
+/**
+ * The size of each record in the rom, a 16 bit sequence, the key, the length, the value and a 16 bit CRC. With the
+ * default value size this is 16 bytes, so that records never straddle a page on the usual eeprom devices.
+ */
+#define EEPROM_LOG_SLOT_SIZE (EEPROM_LOG_VALUE_SIZE + 6)
+
+/** indicates that there is no slot */
+#define EEPROM_LOG_NO_SLOT 0xffffU
+
+/**
+ * Internally used by EepromLogStore to find the latest record for each key.
+ */
+struct EepromLogIndexEntry {
+    uint16_t slot;
+    uint16_t sequence;
+    uint8_t key;
+};
+
+/**
+ * A log structured key value store that spreads wear over an area of an EepromAbstraction. The area is divided into
+ * slots that are used as a ring, every change to a value is appended at the write position with the next sequence
+ * number, so the same bytes are only written once for each trip around the ring. Each record has a CRC, so records
+ * that were only partly written when power was lost are ignored, and the previous value is used.
+ *
+ * A small index in RAM holds the slot of the latest record for each key, it is rebuilt by begin() in a single
+ * sequential read of the area. When the write position catches up with the latest record for a key, that record is
+ * copied to the write position first so that it is never lost. To keep this work off the write path, a background
+ * task relocates records just ahead of the write position after each write.
+ *
+ * The area needs at least two slots more than the number of keys, the more slots there are the less often each
+ * byte is written. The area should start on a page boundary of the device.
+ *
+ * Example: `EepromLogStore store(&rom, 256, 512); store.begin(); store.writeUint32(KEY_COUNTER, counter);`
+ */
+class EepromLogStore : public Executable {
+private:
+    EepromAbstraction* rom;
+    EepromPosition start;
+    uint16_t slotCount;
+    uint16_t head;
+    uint16_t nextSequence;
+    EepromLogIndexEntry index[EEPROM_LOG_MAX_KEYS];
+    uint8_t keyCount;
+    taskid_t compactTask;
+    uint32_t recordsWritten;
+    uint32_t recordsRelocated;
+public:
+    /**
+     * Create a log store over an area of rom, call begin() before use.
+     * @param rom the rom to store values in
+     * @param start the first position of the area, ideally on a page boundary
+     * @param length the length of the area, it is divided into EEPROM_LOG_SLOT_SIZE slots
+     */
+    EepromLogStore(EepromAbstraction* rom, EepromPosition start, uint16_t length);
+
+    /**
+     * Reads the whole area once to rebuild the index and find the write position, must be called before use.
+     */
+    void begin();
+
+    /**
+     * Store a value against a key, nothing is written if the value is unchanged.
+     * @param key the key to store the value under
+     * @param data the value
+     * @param len the length of the value, up to EEPROM_LOG_VALUE_SIZE
+     * @return true if stored, false if the value is too long or there is no room for another key
+     */
+    bool writeValue(uint8_t key, const uint8_t* data, uint8_t len);
+
+    /**
+     * Read the latest value of a key
+     * @param key the key to read
+     * @param data where to copy the value
+     * @param maxLen the size of data
+     * @return the length of the value copied, 0 if the key is not present
+     */
+    uint8_t readValue(uint8_t key, uint8_t* data, uint8_t maxLen);
+
+    /** store a 32 bit value against a key, see writeValue */
+    bool writeUint32(uint8_t key, uint32_t val);
+
+    /** read a 32 bit value, or defaultValue if the key is not present */
+    uint32_t readUint32(uint8_t key, uint32_t defaultValue = 0);
+
+    /** @return true if there is a value for the key */
+    bool hasKey(uint8_t key) const { return indexOf(key) >= 0; }
+
+    /** @return the number of keys stored */
+    uint8_t getKeyCount() const { return keyCount; }
+
+    /** @return the number of slots in the area */
+    uint16_t getSlotCount() const { return slotCount; }
+
+    /** @return the number of records written for calls to writeValue */
+    uint32_t getRecordsWritten() const { return recordsWritten; }
+
+    /** @return the number of records copied forward to stop them being overwritten */
+    uint32_t getRecordsRelocated() const { return recordsRelocated; }
+
+    /**
+     * Relocates any latest records in the slots just ahead of the write position, this is normally done in the
+     * background after each write but can be called directly.
+     * @param slotsAhead the number of slots ahead of the write position to keep free
+     */
+    void compact(uint8_t slotsAhead = EEPROM_LOG_COMPACT_AHEAD);
+
+    /** called by task manager to compact in the background */
+    void exec() override;
+
+private:
+    int indexOf(uint8_t key) const;
+    int indexForSlot(uint16_t slot) const;
+    bool isLiveAhead(uint8_t slotsAhead) const;
+    EepromPosition slotPosition(uint16_t slot) const { return start + (slot * EEPROM_LOG_SLOT_SIZE); }
+    bool readSlot(uint16_t slot, uint8_t* record);
+    void appendRecord(uint8_t key, const uint8_t* data, uint8_t len);
+    void relocate(uint8_t idx);
+};
+
+#endif //_EEPROM_LOG_STORE_H_
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "EepromRecordStore.h"
+#include "IoLogging.h"
+
+// the layout of each copy of a record, the data follows the header and the CRC follows the data
+#define REC_VERSION 0
+#define REC_GENERATION 1
+#define REC_SIZE 2
+#define REC_HEADER_SIZE 4
+
+EepromRecordStore::EepromRecordStore(EepromAbstraction* rom, EepromPosition start) : records() {
+    this->rom = rom;
+    this->start = start;
+    this->nextPosition = start;
+    this->recordCount = 0;
+}
+
+int EepromRecordStore::addRecord(void* data, uint16_t size, uint8_t version) {
+    if(recordCount >= EEPROM_RECORD_MAX_RECORDS) return -1;
+    EepromRecord& rec = records[recordCount];
+    rec.data = data;
+    rec.size = size;
+    rec.version = version;
+    rec.position = nextPosition;
+    rec.generation = 0;
+    rec.crc = 0;
+    rec.activeCopy = EEPROM_RECORD_NO_COPY;
+    nextPosition += copySize(rec) * 2;
+    return recordCount++;
+}
+
+uint8_t EepromRecordStore::begin() {
+    uint16_t largest = 0;
+    for(uint8_t i = 0; i < recordCount; i++) {
+        largest = max(largest, uint16_t(copySize(records[i]) * 2));
+    }
+    if(largest == 0) return 0;
+
+    // the records are laid out one after another, so reading each pair of copies in turn is one sequential pass
+    // over the whole area, and each CRC is calculated over the buffer that was just read.
+    auto buffer = new uint8_t[largest];
+    uint8_t loaded = 0;
+    for(uint8_t i = 0; i < recordCount; i++) {
+        EepromRecord& rec = records[i];
+        uint16_t len = copySize(rec);
+        rom->readIntoMemArrayWide(buffer, rec.position, len * 2);
+
+        rec.activeCopy = EEPROM_RECORD_NO_COPY;
+        for(uint8_t copy = 0; copy < 2; copy++) {
+            const uint8_t* stored = &buffer[copy * len];
+            uint16_t size = (stored[REC_SIZE] << 8U) | stored[REC_SIZE + 1];
+            uint16_t crc = (stored[len - 2] << 8U) | stored[len - 1];
+            if(stored[REC_VERSION] != rec.version || size != rec.size || eepromCrc16(stored, len - 2) != crc) continue;
+
+            // generations are compared allowing for wrap around, the newest valid copy is the active one.
+            uint8_t gen = stored[REC_GENERATION];
+            if(rec.activeCopy == EEPROM_RECORD_NO_COPY || int8_t(gen - rec.generation) > 0) {
+                rec.activeCopy = copy;
+                rec.generation = gen;
+                rec.crc = crc;
+            }
+        }
+
+        if(rec.activeCopy != EEPROM_RECORD_NO_COPY) {
+            memcpy(rec.data, &buffer[(rec.activeCopy * len) + REC_HEADER_SIZE], rec.size);
+            loaded++;
+        }
+        else {
+            serdebugF2("Record store no valid copy for ", i);
+        }
+    }
+    delete[] buffer;
+    return loaded;
+}
+
+void EepromRecordStore::fillHeader(const EepromRecord& rec, uint8_t generation, uint8_t* header) const {
+    header[REC_VERSION] = rec.version;
+    header[REC_GENERATION] = generation;
+    header[REC_SIZE] = rec.size >> 8U;
+    header[REC_SIZE + 1] = rec.size & 0xffU;
+}
+
+uint16_t EepromRecordStore::calculateCrc(const EepromRecord& rec, uint8_t generation) const {
+    uint8_t header[REC_HEADER_SIZE];
+    fillHeader(rec, generation, header);
+    return eepromCrc16((const uint8_t*)rec.data, rec.size, eepromCrc16(header, REC_HEADER_SIZE));
+}
+
+bool EepromRecordStore::save(int id) {
+    if(id < 0 || id >= recordCount) return false;
+    EepromRecord& rec = records[id];
+    uint16_t len = copySize(rec);
+
+    // when the CRC matches the active copy the record is almost certainly unchanged, confirm against the rom
+    // before skipping the write, so that a CRC collision never loses a change.
+    if(rec.activeCopy != EEPROM_RECORD_NO_COPY && calculateCrc(rec, rec.generation) == rec.crc) {
+        uint8_t stored[16];
+        EepromWidePosition pos = rec.position + (rec.activeCopy * len) + REC_HEADER_SIZE;
+        bool same = true;
+        for(uint16_t i = 0; i < rec.size && same; i += sizeof stored) {
+            uint16_t chunk = min(uint16_t(rec.size - i), uint16_t(sizeof stored));
+            rom->readIntoMemArrayWide(stored, pos + i, chunk);
+            same = memcmp(stored, (const uint8_t*)rec.data + i, chunk) == 0;
+        }
+        if(same) return true;
+    }
+
+    // write the whole of the inactive copy, the active copy is untouched until this has completed.
+    uint8_t target = (rec.activeCopy == 0) ? 1 : 0;
+    uint8_t generation = (rec.activeCopy == EEPROM_RECORD_NO_COPY) ? 0 : uint8_t(rec.generation + 1);
+    EepromWidePosition pos = rec.position + (target * len);
+
+    uint8_t header[REC_HEADER_SIZE];
+    fillHeader(rec, generation, header);
+    uint16_t crc = calculateCrc(rec, generation);
+    uint8_t crcBytes[2] = { uint8_t(crc >> 8U), uint8_t(crc & 0xffU) };
+    rom->writeArrayToRomWide(pos, header, sizeof header);
+    rom->writeArrayToRomWide(pos + REC_HEADER_SIZE, (const uint8_t*)rec.data, rec.size);
+    rom->writeArrayToRomWide(pos + REC_HEADER_SIZE + rec.size, crcBytes, sizeof crcBytes);
+    if(rom->hasErrorOccurred()) {
+        serdebugF2("Record store write failed ", id);
+        return false;
+    }
+
+    rec.activeCopy = target;
+    rec.generation = generation;
+    rec.crc = crc;
+    return true;
+}
+
+void EepromRecordStore::saveAll() {
+    for(uint8_t i = 0; i < recordCount; i++) {
+        save(i);
+    }
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _EEPROM_RECORD_STORE_H_
+#define _EEPROM_RECORD_STORE_H_
+
+/**
+ * @file EepromRecordStore.h
+ *
+ * Contains a record store that saves structures to an EepromAbstraction with a version, a CRC and two copies, so
+ * that a record is never lost by a power cut part way through saving it.
+ */
+
+#include "EepromAbstraction.h"
+
+/** the maximum number of records in a store */
+#ifndef EEPROM_RECORD_MAX_RECORDS
+#define EEPROM_RECORD_MAX_RECORDS 8
+#endif
+
+/** the bytes added to each copy of a record, the version, generation and size before it and the CRC after it */
+#define EEPROM_RECORD_OVERHEAD 6
+
+/** the active copy of a record that has not been loaded or saved */
+#define EEPROM_RECORD_NO_COPY 0xffU
+
+/**
+ * Internally used by EepromRecordStore to hold the layout and state of each record.
+ */
+struct EepromRecord {
+    void* data;
+    uint16_t size;
+    EepromPosition position;
+    uint16_t crc;
+    uint8_t version;
+    uint8_t generation;
+    uint8_t activeCopy;
+};
+
+/**
+ * A store for structures that are saved to an EepromAbstraction. Each record is kept twice, and each copy has a
+ * version, a generation that goes up by one on each save, and a CRC over the whole copy. Saving always writes the
+ * copy that is not in use, and only once that write has completed does it become the active copy, so if power is
+ * lost while saving, the CRC of the partly written copy is wrong and the previous copy is used on the next start.
+ *
+ * Records are added in order, and are laid out one after another from the start position. Each record takes twice
+ * its size plus EEPROM_RECORD_OVERHEAD for each copy. On begin, the whole area is read in one sequential pass, each
+ * record's copies are read in one transfer and their CRCs calculated over that buffer, then the newest valid copy
+ * is copied into the record's memory. Records that have no valid copy, or were saved with another version, keep
+ * whatever the memory held before, usually the defaults.
+ *
+ * Example: `store.addRecord(&settings, SETTINGS_VERSION); store.begin();` then `store.save(0)` after a change.
+ */
+class EepromRecordStore {
+private:
+    EepromAbstraction* rom;
+    EepromPosition start;
+    EepromPosition nextPosition;
+    EepromRecord records[EEPROM_RECORD_MAX_RECORDS];
+    uint8_t recordCount;
+public:
+    /**
+     * Create a record store that lays out records from start.
+     * @param rom the rom to store the records in
+     * @param start the position of the first record
+     */
+    EepromRecordStore(EepromAbstraction* rom, EepromPosition start);
+
+    /**
+     * Add a record to the store, this must be done before begin, and in the same order each time.
+     * @param data the memory that holds the record, it is loaded into and saved from here
+     * @param size the size of the record
+     * @param version the version of the record, a record saved with another version is not loaded
+     * @return the id of the record, or -1 if there are too many records.
+     */
+    int addRecord(void* data, uint16_t size, uint8_t version = 0);
+
+    /**
+     * Add a structure as a record, see addRecord above.
+     */
+    template<class T> int addRecord(T* data, uint8_t version = 0) {
+        return addRecord((void*)data, sizeof(T), version);
+    }
+
+    /**
+     * Reads the store and loads every record that has a valid copy.
+     * @return the number of records loaded
+     */
+    uint8_t begin();
+
+    /**
+     * Saves a record into its inactive copy and then makes that copy active, nothing is written if the record has
+     * not changed since it was last loaded or saved.
+     * @param id the id of the record
+     * @return true if the record is now stored
+     */
+    bool save(int id);
+
+    /** saves every record, see save */
+    void saveAll();
+
+    /** @return true if the record has a valid copy in the rom */
+    bool isStored(int id) const { return id >= 0 && id < recordCount && records[id].activeCopy != EEPROM_RECORD_NO_COPY; }
+
+    /** @return the generation of the active copy, it goes up by one on each save */
+    uint8_t getGeneration(int id) const { return (id >= 0 && id < recordCount) ? records[id].generation : 0; }
+
+    /** @return the position after the last record, where any other data can be stored */
+    EepromPosition getEndPosition() const { return nextPosition; }
+
+private:
+    uint16_t copySize(const EepromRecord& rec) const { return rec.size + EEPROM_RECORD_OVERHEAD; }
+    uint16_t calculateCrc(const EepromRecord& rec, uint8_t generation) const;
+    void fillHeader(const EepromRecord& rec, uint8_t generation, uint8_t* header) const;
+};
+
+#endif //_EEPROM_RECORD_STORE_H_
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "FilteredAnalogDevice.h"
+#include "IoLogging.h"
+
+FilteredAnalogDevice::FilteredAnalogDevice(AnalogDevice* device) {
+    this->device = device;
+    this->filterCount = 0;
+    this->cacheMicros = ANALOG_FILTER_DEFAULT_CACHE_MICROS;
+}
+
+AnalogFilterState* FilteredAnalogDevice::findFilter(pinid_t pin) {
+    for(uint8_t i=0; i<filterCount; i++) {
+        if(filters[i].pin == pin) return &filters[i];
+    }
+    return nullptr;
+}
+
+bool FilteredAnalogDevice::addPin(pinid_t pin, const AnalogFilterConfig& config) {
+    uint8_t shift = 0;
+    while((1U << shift) < config.oversampleCount) shift++;
+    if(config.oversampleCount == 0 || shift > 6 || (1U << shift) != config.oversampleCount || config.extraBits > shift
+            || config.medianSize == 0 || config.medianSize > ANALOG_FILTER_MEDIAN_MAX || (config.medianSize % 2) == 0) {
+        serdebugF2("Invalid filter for pin ", pin);
+        return false;
+    }
+
+    // samples are held in 16 bits through the median and EMA stages, the extra bits must fit within that, and the
+    // EMA accumulator holds a sample scaled by 2^emaShift in 32 bits.
+    if(device->getBitDepth(DIR_IN, pin) + config.extraBits > 16 || config.emaShift > 16) {
+        serdebugF2("Filter exceeds 16 bits for pin ", pin);
+        return false;
+    }
+
+    auto state = findFilter(pin);
+    if(state == nullptr) {
+        if(filterCount >= ANALOG_FILTER_MAX_PINS) {
+            serdebugF2("No room to filter pin ", pin);
+            return false;
+        }
+        state = &filters[filterCount++];
+    }
+    state->pin = pin;
+    state->config = config;
+    state->oversampleShift = shift;
+    resetState(*state);
+    device->initPin(pin, DIR_IN);
+    return true;
+}
+
+void FilteredAnalogDevice::resetState(AnalogFilterState& state) {
+    state.medianPos = 0;
+    state.medianFill = 0;
+    state.emaPrimed = false;
+    state.outputValid = false;
+    state.emaAccumulator = 0;
+    state.output = 0;
+    state.outputMicros = 0;
+}
+
+void FilteredAnalogDevice::resetFilters() {
+    for(uint8_t i=0; i<filterCount; i++) resetState(filters[i]);
+}
+
+int FilteredAnalogDevice::getBitDepth(AnalogDirection direction, pinid_t pin) {
+    auto state = (direction == DIR_IN) ? findFilter(pin) : nullptr;
+    int depth = device->getBitDepth(direction, pin);
+    return (state != nullptr) ? depth + state->config.extraBits : depth;
+}
+
+int FilteredAnalogDevice::getMaximumRange(AnalogDirection direction, pinid_t pin) {
+    auto state = (direction == DIR_IN) ? findFilter(pin) : nullptr;
+    if(state == nullptr || state->config.extraBits == 0) return device->getMaximumRange(direction, pin);
+    return (1 << getBitDepth(direction, pin)) - 1;
+}
+
+unsigned int FilteredAnalogDevice::getCurrentValue(pinid_t pin) {
+    auto state = findFilter(pin);
+    if(state == nullptr) return device->getCurrentValue(pin);
+
+    unsigned long now = micros();
+    if(!state->outputValid || cacheMicros == 0 || (now - state->outputMicros) >= cacheMicros) {
+        state->output = runPipeline(*state);
+        state->outputMicros = now;
+        state->outputValid = true;
+    }
+    return state->output;
+}
+
+float FilteredAnalogDevice::getCurrentFloat(pinid_t pin) {
+    return float(getCurrentValue(pin)) / float(getMaximumRange(DIR_IN, pin));
+}
+
+unsigned int FilteredAnalogDevice::runPipeline(AnalogFilterState& state) {
+    auto& config = state.config;
+
+    // oversample and decimate, the sum is shifted down leaving the requested number of extra bits.
+    uint32_t sum = 0;
+    for(uint8_t i=0; i<config.oversampleCount; i++) sum += device->getCurrentValue(state.pin);
+    auto sample = uint16_t(sum >> (state.oversampleShift - config.extraBits));
+
+    // median of N over a small ring buffer, until the window fills the median is over what is there.
+    if(config.medianSize > 1) {
+        state.medianWindow[state.medianPos] = sample;
+        state.medianPos = (state.medianPos + 1) % config.medianSize;
+        if(state.medianFill < config.medianSize) state.medianFill++;
+
+        uint16_t sorted[ANALOG_FILTER_MEDIAN_MAX];
+        for(uint8_t i=0; i<state.medianFill; i++) {
+            uint16_t val = state.medianWindow[i];
+            int j = i - 1;
+            while(j >= 0 && sorted[j] > val) {
+                sorted[j + 1] = sorted[j];
+                j--;
+            }
+            sorted[j + 1] = val;
+        }
+        sample = sorted[state.medianFill / 2];
+    }
+
+    // integer EMA, the accumulator holds the average scaled up by 2^emaShift to keep the fractional part.
+    if(config.emaShift) {
+        if(!state.emaPrimed) {
+            state.emaAccumulator = uint32_t(sample) << config.emaShift;
+            state.emaPrimed = true;
+        }
+        else {
+            state.emaAccumulator = state.emaAccumulator - (state.emaAccumulator >> config.emaShift) + sample;
+        }
+        sample = uint16_t(state.emaAccumulator >> config.emaShift);
+    }
+
+    // hysteresis, hold the previous output unless the value has moved far enough.
+    if(state.outputValid) {
+        unsigned int diff = (sample > state.output) ? sample - state.output : state.output - sample;
+        if(diff <= config.hysteresis) return state.output;
+    }
+    return sample;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _FILTERED_ANALOG_DEVICE_H_
+#define _FILTERED_ANALOG_DEVICE_H_
+
+/**
+ * @file FilteredAnalogDevice.h
+ *
+ * Contains an AnalogDevice decorator that applies a configurable integer filter pipeline to the readings of each pin.
+ */
+
+#include "AnalogDeviceAbstraction.h"
+
+/** the maximum number of pins that can be filtered by one device, the state for each is preallocated */
+#ifndef ANALOG_FILTER_MAX_PINS
+#define ANALOG_FILTER_MAX_PINS 4
+#endif
+
+/** the largest median window that can be configured, it must be odd */
+#ifndef ANALOG_FILTER_MEDIAN_MAX
+#define ANALOG_FILTER_MEDIAN_MAX 7
+#endif
+
+/** by default, the filtered value is reused for repeat reads within this many microseconds */
+#ifndef ANALOG_FILTER_DEFAULT_CACHE_MICROS
+#define ANALOG_FILTER_DEFAULT_CACHE_MICROS 1000
+#endif
+
+/**
+ * The configuration of the filter pipeline for a pin, each stage is applied in order of the fields below. A stage
+ * with its default value is skipped. All the stages work in integer arithmetic.
+ */
+struct AnalogFilterConfig {
+    /** oversampling, the number of raw conversions summed for each sample, must be a power of 2 up to 64 */
+    uint8_t oversampleCount;
+    /**
+     * decimation, the number of extra bits of resolution kept from the oversampled sum, 0 gives a plain average
+     * at the device resolution. Each extra bit needs four times the samples to be meaningful.
+     */
+    uint8_t extraBits;
+    /** median of N, the size of the median window, 1 to disable or an odd number up to ANALOG_FILTER_MEDIAN_MAX */
+    uint8_t medianSize;
+    /** integer EMA, each new sample contributes 1 / 2^emaShift of the output, 0 to disable, at most 16 */
+    uint8_t emaShift;
+    /** hysteresis, the output only changes when the filtered value moves by more than this */
+    uint16_t hysteresis;
+};
+
+/**
+ * Creates a filter configuration, only the stages that are needed have to be provided.
+ */
+inline AnalogFilterConfig analogFilter(uint8_t oversampleCount = 1, uint8_t extraBits = 0, uint8_t medianSize = 1,
+                                       uint8_t emaShift = 0, uint16_t hysteresis = 0) {
+    return AnalogFilterConfig { oversampleCount, extraBits, medianSize, emaShift, hysteresis };
+}
+
+/**
+ * Internally used by FilteredAnalogDevice to hold the state of the pipeline for one pin.
+ */
+struct AnalogFilterState {
+    AnalogFilterConfig config;
+    pinid_t pin;
+    uint8_t oversampleShift;
+    uint8_t medianPos;
+    uint8_t medianFill;
+    bool emaPrimed;
+    bool outputValid;
+    uint16_t medianWindow[ANALOG_FILTER_MEDIAN_MAX];
+    uint32_t emaAccumulator;
+    unsigned int output;
+    unsigned long outputMicros;
+};
+
+/**
+ * An AnalogDevice that wraps any other analog device and filters the readings of configured pins, pins that are not
+ * configured, and all outputs, are passed straight through. Each pin has its own pipeline of oversampling, decimation,
+ * median of N, integer exponential moving average and hysteresis, with the state held in a fixed array. When extra
+ * bits are configured, the range and bit depth of that pin grow to match. The filtered value is cached, so reads
+ * from several consumers within the cache time cost no conversions.
+ *
+ * Example: filtered.addPin(A0, analogFilter(4, 0, 3, 2, 2)); averages 4 conversions, takes a median of 3, smooths
+ * with an EMA of 1/4 and ignores changes of 2 or less.
+ */
+class FilteredAnalogDevice : public AnalogDevice {
+private:
+    AnalogDevice* device;
+    AnalogFilterState filters[ANALOG_FILTER_MAX_PINS];
+    uint8_t filterCount;
+    uint32_t cacheMicros;
+public:
+    /**
+     * Create a filtered device that wraps another device
+     * @param device the device to take readings from
+     */
+    explicit FilteredAnalogDevice(AnalogDevice* device);
+
+    /**
+     * Add a pin to be filtered with the given pipeline, calling again for the same pin changes the configuration
+     * and resets its state. The pin is initialised as an input.
+     * @param pin the pin to filter
+     * @param config the pipeline configuration, see analogFilter
+     * @return true if the pin was added, false if there is no room or the configuration is invalid, including when
+     * the bit depth of the device plus the extra bits is over 16, or emaShift is over 16.
+     */
+    bool addPin(pinid_t pin, const AnalogFilterConfig& config);
+
+    /**
+     * Set how long a filtered value is reused for, set to 0 to filter on every read.
+     * @param micros the cache time in microseconds
+     */
+    void setCacheMicros(uint32_t micros) { cacheMicros = micros; }
+
+    /** reset the state of every pipeline, for example after the input has been switched */
+    void resetFilters();
+
+    int getMaximumRange(AnalogDirection direction, pinid_t pin) override;
+    int getBitDepth(AnalogDirection direction, pinid_t pin) override;
+    void initPin(pinid_t pin, AnalogDirection direction) override { device->initPin(pin, direction); }
+    unsigned int getCurrentValue(pinid_t pin) override;
+    float getCurrentFloat(pinid_t pin) override;
+    void setCurrentValue(pinid_t pin, unsigned int newValue) override { device->setCurrentValue(pin, newValue); }
+    void setCurrentFloat(pinid_t pin, float newValue) override { device->setCurrentFloat(pin, newValue); }
+private:
+    AnalogFilterState* findFilter(pinid_t pin);
+    unsigned int runPipeline(AnalogFilterState& state);
+    static void resetState(AnalogFilterState& state);
+};
+
+#endif //_FILTERED_ANALOG_DEVICE_H_
@@ -6,6 +6,12 @@
 
 #define MAX_JOYSTICK_ACCEL 10.1F
 
+/** the acceleration above scaled by 2^8 so that it can be applied to a fixed point reading with a shift */
+#define MAX_JOYSTICK_ACCEL_FIXED uint32_t(MAX_JOYSTICK_ACCEL * 256.0F)
+
+/** the distance either side of the centre point that AnalogJoystickToButtons treats as no direction */
+#define JOYSTICK_BUTTON_DEADBAND 0.15F
+
 /**
  * @file JoystickSwitchInput.h
  * Provides a rotary encoder emulation based on an analog joystick. Normally used with
@@ -29,9 +35,9 @@ class JoystickSwitchInput : public RotaryEncoder, public Executable {
 private:
     pinid_t analogPin;
     AnalogDevice* analogDevice;
-    float tolerance = 0.03F;
-    float midPoint = 0.5F;
-    float accelerationFactor = 1000.0F;
+    analogfixed_t tolerance = analogFixedFromFloat(0.03F);
+    analogfixed_t midPoint = analogFixedFromFloat(0.5F);
+    uint16_t accelerationFactor = 1000;
 public:
     /** 
      * Constructor that initialises the class for use, prefer to use the set up method setupAnalogJoystickEncoder
@@ -54,8 +60,8 @@ public:
      * @param tolerance_ the size change to ignore around midpoint.
      */
     void setTolerance(float midPoint_, float tolerance_) {
-        tolerance = tolerance_;
-        midPoint = midPoint_;
+        tolerance = analogFixedFromFloat(tolerance_);
+        midPoint = analogFixedFromFloat(midPoint_);
     }
 
     int nextInterval(int forceApplied) {
@@ -73,25 +79,27 @@ public:
      * Called by taskManager on a frequent basis. Ususally about every 250-500 millis
      */
     void exec() override {
-        float readVal = analogDevice->getCurrentFloat(analogPin) - midPoint;
+        int32_t readVal = int32_t(analogDevice->getCurrentFixed(analogPin)) - int32_t(midPoint);
 
-        if(readVal > tolerance) {
+        if(readVal > int32_t(tolerance)) {
             int dir = (switches.getEncoder()->getUserIntention() == SCROLL_THROUGH_ITEMS) ? -1 : 1;
             increment(dir);
         }
-        else if(readVal < (-tolerance)) {
+        else if(readVal < -int32_t(tolerance)) {
             int dir = (switches.getEncoder()->getUserIntention() == SCROLL_THROUGH_ITEMS) ? 1 : -1;
             increment(dir);
         }
         else {
-            accelerationFactor = 750.0F;
+            accelerationFactor = 750;
             taskManager.scheduleOnce(250, this);
             return;
         }
 
-        auto delay = nextInterval(abs(readVal * MAX_JOYSTICK_ACCEL)) + accelerationFactor;
+        // the reading is Q0.16, so the force applied is the reading times the acceleration shifted back down.
+        auto force = int((uint32_t(abs(readVal)) * MAX_JOYSTICK_ACCEL_FIXED) >> 24U);
+        auto delay = nextInterval(force) + accelerationFactor;
         taskManager.scheduleOnce(delay, this);
-        accelerationFactor /= 3.0;
+        accelerationFactor /= 3;
     }
 };
 
@@ -107,12 +115,14 @@ private:
     bool errorOccurred = false;
     bool initialisedYet = false;
     bool inverted = false;
-    float centrePoint;
+    analogfixed_t offLowest;
+    analogfixed_t offHighest;
 public:
     AnalogJoystickToButtons(AnalogDevice* device, pinid_t pin, float centre) {
         joystickPin = pin;
         analogDevice = device;
-        centrePoint = centre;
+        offLowest = analogFixedFromFloat(centre - JOYSTICK_BUTTON_DEADBAND);
+        offHighest = analogFixedFromFloat(centre + JOYSTICK_BUTTON_DEADBAND);
     }
 
     ~AnalogJoystickToButtons() override = default;
@@ -128,9 +138,7 @@ public:
     }
 
     bool runLoop() override {
-        auto value = analogDevice->getCurrentFloat(joystickPin);
-        auto offLowest = centrePoint - 0.15;
-        auto offHighest = centrePoint + 0.15;
+        auto value = analogDevice->getCurrentFixed(joystickPin);
         if(value < offLowest) {
             currentDir = LEFT;
         }
@@ -9,10 +9,42 @@
 #include "KeyboardManager.h"
 #include "IoLogging.h"
 
-MatrixKeyboardManager::MatrixKeyboardManager() {
+// raw interrupt handlers have no context, so the keyboard using idle interrupts is stored here.
+static MatrixKeyboardManager* idleKeyboard = nullptr;
+
+static void onKeyboardRowInterrupt() {
+    if(idleKeyboard != nullptr) idleKeyboard->rowInterrupt();
+}
+
+void KeyboardWakeEvent::exec() {
+    keyboard->wakeFromIdle();
+}
+
+MatrixKeyboardManager::MatrixKeyboardManager() : wakeEvent(this) {
     this->ioRef = NULL;
     this->layout = NULL;
     this->listener = NULL;
+    this->currentKey = 0;
+    this->keyMode = KEYMODE_NOT_PRESSED;
+    this->counter = 0;
+    this->scanMode = KEYBOARD_SCAN_PIN_BY_PIN;
+    this->settleMicros = 0;
+    this->repeatRow = 0xff;
+    this->repeatCol = 0xff;
+    this->ghostDetected = false;
+    this->idleInterrupts = false;
+    this->wakeArmed = false;
+    this->idleScanCount = 0;
+    this->scanTaskId = TASKMGR_INVALIDID;
+    this->wakeTaskId = TASKMGR_INVALIDID;
+    memset(keyState, 0, sizeof keyState);
+    memset(lastScan, 0, sizeof lastScan);
+}
+
+MatrixKeyboardManager::~MatrixKeyboardManager() {
+    if(idleKeyboard == this) idleKeyboard = nullptr;
+    if(wakeTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(wakeTaskId);
+    if(scanTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(scanTaskId);
 }
 
 void MatrixKeyboardManager::initialise(IoAbstractionRef ref, KeyboardLayout* layout, KeyboardListener* listener) {
@@ -20,6 +52,11 @@ void MatrixKeyboardManager::initialise(IoAbstractionRef ref, KeyboardLayout* lay
     this->layout = layout;
     this->listener = listener;
 
+    if(scanMode == KEYBOARD_SCAN_PORT_WIDE && !isPortWideLayoutValid()) {
+        serdebugF("Keyboard layout not suitable for port scan");
+        scanMode = KEYBOARD_SCAN_PIN_BY_PIN;
+    }
+
     for(int i=0; i<layout->numColumns(); i++) {
         ioDevicePinMode(ioRef, layout->getColPin(i), OUTPUT);
         ioDeviceDigitalWrite(ioRef, layout->getColPin(i), HIGH);
@@ -29,7 +66,89 @@ void MatrixKeyboardManager::initialise(IoAbstractionRef ref, KeyboardLayout* lay
     ioDeviceSync(ioRef);
 
     currentKey = 0;
-    taskManager.scheduleFixedRate(KEYBOARD_TASK_MILLIS, this);
+    idleScanCount = 0;
+    if(scanTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(scanTaskId);
+    scanTaskId = taskManager.scheduleFixedRate(KEYBOARD_TASK_MILLIS, this);
+
+    if(idleInterrupts) {
+        idleKeyboard = this;
+        // the event must only be registered once, even if initialise is called again
+        if(wakeTaskId == TASKMGR_INVALIDID) wakeTaskId = taskManager.registerEvent(&wakeEvent);
+        for(int i=0; i<layout->numRows(); i++) {
+            ioDeviceAttachInterrupt(ioRef, layout->getRowPin(i), onKeyboardRowInterrupt, CHANGE);
+        }
+    }
+}
+
+bool MatrixKeyboardManager::isMatrixIdle() {
+    if(scanMode == KEYBOARD_SCAN_PIN_BY_PIN) return keyMode != KEYMODE_PRESSED && currentKey == 0;
+
+    for(int r=0; r<layout->numRows(); r++) {
+        if(keyState[r] || lastScan[r]) return false;
+    }
+    return true;
+}
+
+void MatrixKeyboardManager::checkForIdle() {
+    if(!idleInterrupts || scanTaskId == TASKMGR_INVALIDID) return;
+
+    if(!isMatrixIdle()) {
+        idleScanCount = 0;
+        return;
+    }
+    if(++idleScanCount < KEYBOARD_IDLE_SCANS) return;
+
+    // drive all columns low, so that pressing any key pulls its row low and raises the interrupt.
+    for(int i=0; i<layout->numColumns(); i++) {
+        ioDeviceDigitalWrite(ioRef, layout->getColPin(i), LOW);
+    }
+    ioDeviceSync(ioRef);
+
+    // arm before checking the rows, so a key pressed in between is never missed.
+    wakeArmed = true;
+    for(int r=0; r<layout->numRows(); r++) {
+        if(!ioDeviceDigitalRead(ioRef, layout->getRowPin(r))) {
+            wakeArmed = false;
+            idleScanCount = 0;
+            return;
+        }
+    }
+
+    serdebugF("Keyboard idle, waiting for interrupt");
+    taskManager.cancelTask(scanTaskId);
+    scanTaskId = TASKMGR_INVALIDID;
+}
+
+void MatrixKeyboardManager::rowInterrupt() {
+    if(wakeArmed) {
+        wakeArmed = false;
+        wakeEvent.markTriggeredAndNotify();
+    }
+}
+
+void MatrixKeyboardManager::wakeFromIdle() {
+    if(scanTaskId != TASKMGR_INVALIDID) return;
+
+    serdebugF("Keyboard woken by interrupt");
+    idleScanCount = 0;
+    scanTaskId = taskManager.scheduleFixedRate(KEYBOARD_TASK_MILLIS, this);
+    exec();
+}
+
+bool MatrixKeyboardManager::isPortWideLayoutValid() {
+    // board pins do not map to ports as pin / 8, writePort on them would drive the whole hardware port instead.
+    if(ioRef == internalDigitalIo()) return false;
+    if(layout->numColumns() > KEYBOARD_PORT_WIDE_MAX || layout->numRows() > KEYBOARD_PORT_WIDE_MAX) return false;
+
+    int colPort = layout->getColPin(0) / 8;
+    for(int i=1; i<layout->numColumns(); i++) {
+        if(layout->getColPin(i) / 8 != colPort) return false;
+    }
+    int rowPort = layout->getRowPin(0) / 8;
+    for(int i=1; i<layout->numRows(); i++) {
+        if(layout->getRowPin(i) / 8 != rowPort) return false;
+    }
+    return true;
 }
 
 void MatrixKeyboardManager::setToOuput(int col) {
@@ -46,6 +165,12 @@ void MatrixKeyboardManager::setRepeatKeyMillis(int startAfterMillis, int repeatM
 void MatrixKeyboardManager::exec() {
     if(ioRef == NULL) return;
 
+    if(scanMode == KEYBOARD_SCAN_PORT_WIDE) {
+        scanPortWide();
+        checkForIdle();
+        return;
+    }
+
     char pressThisTime = 0;
 
     // then we read back the right state
@@ -91,4 +216,211 @@ void MatrixKeyboardManager::exec() {
         if(pressThisTime != 0) keyMode = KEYMODE_DEBOUNCE;
         currentKey = pressThisTime;
     }
+
+    checkForIdle();
+}
+
+void MatrixKeyboardManager::scanPortWide() {
+    pinid_t colPortPin = layout->getColPin(0);
+    pinid_t rowPortPin = layout->getRowPin(0);
+    uint8_t thisScan[KEYBOARD_PORT_WIDE_MAX] = { 0 };
+
+    for(int c=0; c<layout->numColumns(); c++) {
+        // drive only this column low in one port write, then a single sync writes it and reads the rows back.
+        ioDeviceDigitalWritePort(ioRef, colPortPin, ~(1U << (layout->getColPin(c) % 8)));
+        ioDeviceSync(ioRef);
+        if(settleMicros) {
+            taskManager.yieldForMicros(settleMicros);
+            ioDeviceSync(ioRef);
+        }
+
+        uint8_t rowsLow = ~ioDeviceDigitalReadPort(ioRef, rowPortPin);
+        for(int r=0; r<layout->numRows(); r++) {
+            if(bitRead(rowsLow, layout->getRowPin(r) % 8)) bitSet(thisScan[r], c);
+        }
+    }
+
+    // if any two rows share two or more columns, there could be a ghost key at the corner of the rectangle,
+    // we cannot tell which of the keys are real so the scan is ignored until the keys are released.
+    ghostDetected = false;
+    for(int r1=0; r1<layout->numRows(); r1++) {
+        for(int r2=r1+1; r2<layout->numRows(); r2++) {
+            uint8_t common = thisScan[r1] & thisScan[r2];
+            if(common & (common - 1)) ghostDetected = true;
+        }
+    }
+    if(ghostDetected) return;
+
+    // a key only changes state once it has read the same in two consecutive scans.
+    for(int r=0; r<layout->numRows(); r++) {
+        uint8_t stable = (thisScan[r] & lastScan[r]) | (keyState[r] & (thisScan[r] | lastScan[r]));
+        lastScan[r] = thisScan[r];
+        thisScan[r] = stable;
+    }
+
+    for(int r=0; r<layout->numRows(); r++) {
+        uint8_t changed = thisScan[r] ^ keyState[r];
+        keyState[r] = thisScan[r];
+        if(!changed) continue;
+        for(int c=0; c<layout->numColumns(); c++) {
+            if(!bitRead(changed, c)) continue;
+            char key = layout->keyFor(r, c);
+            if(bitRead(keyState[r], c)) {
+                serdebugF4("Pressed: ", r, c, (int)key);
+                repeatRow = r;
+                repeatCol = c;
+                counter = repeatStartTicks;
+                listener->keyPressed(key, false);
+            }
+            else {
+                if(repeatRow == r && repeatCol == c) repeatRow = repeatCol = 0xff;
+                listener->keyReleased(key);
+            }
+        }
+    }
+
+    // only the most recently pressed key repeats, as with a regular keyboard.
+    if(repeatRow != 0xff && counter-- == 0) {
+        counter = repeatTicks;
+        listener->keyPressed(layout->keyFor(repeatRow, repeatCol), true);
+    }
+}
+
+LargeMatrixKeyboardManager::LargeMatrixKeyboardManager() {
+    this->ioRef = NULL;
+    this->layout = NULL;
+    this->listener = NULL;
+    this->scanBits = this->keyState = this->countLow = this->countHigh = this->repeatCounters = NULL;
+    this->bitmapSize = 0;
+    this->scanMillis = 10;
+    this->settleMicros = 0;
+    this->repeatStartTicks = 85;
+    this->repeatTicks = 35;
+    this->scanTaskId = TASKMGR_INVALIDID;
+}
+
+LargeMatrixKeyboardManager::~LargeMatrixKeyboardManager() {
+    if(scanTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(scanTaskId);
+    freeMatrix();
+}
+
+void LargeMatrixKeyboardManager::freeMatrix() {
+    delete[] scanBits;
+    delete[] keyState;
+    delete[] countLow;
+    delete[] countHigh;
+    delete[] repeatCounters;
+    scanBits = keyState = countLow = countHigh = repeatCounters = NULL;
+}
+
+void LargeMatrixKeyboardManager::initialise(IoAbstractionRef ref, KeyboardLayout* layout, KeyboardListener* listener,
+                                            uint16_t scanMillis) {
+    this->ioRef = ref;
+    this->layout = layout;
+    this->listener = listener;
+    this->scanMillis = scanMillis;
+
+    // a second initialise replaces the matrix and the scan task of the first
+    if(scanTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(scanTaskId);
+    freeMatrix();
+
+    uint16_t numKeys = layout->numRows() * layout->numColumns();
+    bitmapSize = (numKeys + 7) / 8;
+    scanBits = new uint8_t[bitmapSize];
+    keyState = new uint8_t[bitmapSize];
+    countLow = new uint8_t[bitmapSize];
+    countHigh = new uint8_t[bitmapSize];
+    repeatCounters = new uint8_t[numKeys];
+    memset(keyState, 0, bitmapSize);
+    memset(countLow, 0, bitmapSize);
+    memset(countHigh, 0, bitmapSize);
+    memset(repeatCounters, 0, numKeys);
+
+    for(int i=0; i<layout->numColumns(); i++) {
+        ioDevicePinMode(ioRef, layout->getColPin(i), OUTPUT);
+        ioDeviceDigitalWrite(ioRef, layout->getColPin(i), HIGH);
+    }
+    for(int i=0; i<layout->numRows(); i++) ioDevicePinMode(ioRef, layout->getRowPin(i), INPUT_PULLUP);
+
+    ioDeviceSync(ioRef);
+
+    scanTaskId = taskManager.scheduleFixedRate(scanMillis, this);
+}
+
+void LargeMatrixKeyboardManager::setRepeatKeyMillis(int startAfterMillis, int repeatMillis) {
+    // the per key counters are 8 bit to keep memory down on large matrices
+    repeatStartTicks = min(startAfterMillis / scanMillis, 255);
+    repeatTicks = min(repeatMillis / scanMillis, 255);
+}
+
+bool LargeMatrixKeyboardManager::isKeyDown(uint8_t row, uint8_t col) {
+    if(keyState == NULL || row >= layout->numRows() || col >= layout->numColumns()) return false;
+    uint16_t idx = (row * layout->numColumns()) + col;
+    return bitRead(keyState[idx / 8], idx % 8);
+}
+
+void LargeMatrixKeyboardManager::scanMatrix() {
+    memset(scanBits, 0, bitmapSize);
+    int cols = layout->numColumns();
+
+    for(int c=0; c<cols; c++) {
+        // only the previous column and this one change, so two writes per column regardless of matrix size.
+        ioDeviceDigitalWrite(ioRef, layout->getColPin((c == 0) ? cols - 1 : c - 1), HIGH);
+        ioDeviceDigitalWrite(ioRef, layout->getColPin(c), LOW);
+        ioDeviceSync(ioRef);
+        if(settleMicros) {
+            taskManager.yieldForMicros(settleMicros);
+            ioDeviceSync(ioRef);
+        }
+
+        for(int r=0; r<layout->numRows(); r++) {
+            if(!ioDeviceDigitalRead(ioRef, layout->getRowPin(r))) {
+                uint16_t idx = (r * cols) + c;
+                bitSet(scanBits[idx / 8], idx % 8);
+            }
+        }
+    }
+}
+
+void LargeMatrixKeyboardManager::exec() {
+    if(ioRef == NULL) return;
+
+    scanMatrix();
+
+    for(uint16_t i=0; i<bitmapSize; i++) {
+        // two bit vertical counters, one per key, a key's counter runs while it differs from the debounced state
+        // and is reset as soon as it matches again. The state toggles once the counter wraps after four scans.
+        uint8_t delta = scanBits[i] ^ keyState[i];
+        countHigh[i] = (countHigh[i] ^ countLow[i]) & delta;
+        countLow[i] = ~countLow[i] & delta;
+        uint8_t toggle = delta & ~(countLow[i] | countHigh[i]);
+        keyState[i] ^= toggle;
+
+        uint8_t active = toggle | keyState[i];
+        if(active == 0) continue;
+        for(uint8_t b=0; b<8; b++) {
+            if(!bitRead(active, b)) continue;
+            uint16_t keyIndex = (i * 8) + b;
+            if(bitRead(toggle, b)) {
+                keyChanged(keyIndex, bitRead(keyState[i], b));
+            }
+            else if(repeatCounters[keyIndex]-- == 0) {
+                repeatCounters[keyIndex] = repeatTicks;
+                uint8_t cols = layout->numColumns();
+                listener->keyCodePressed(layout->keyCodeFor(keyIndex / cols, keyIndex % cols), true);
+            }
+        }
+    }
+}
+
+void LargeMatrixKeyboardManager::keyChanged(uint16_t keyIndex, bool pressed) {
+    uint8_t cols = layout->numColumns();
+    uint16_t code = layout->keyCodeFor(keyIndex / cols, keyIndex % cols);
+    if(pressed) {
+        repeatCounters[keyIndex] = repeatStartTicks;
+        listener->keyCodePressed(code, false);
+    }
+    else {
+        listener->keyCodeReleased(code);
+    }
 }
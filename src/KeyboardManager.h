@@ -29,6 +29,21 @@ public:
      * @param key the character code of the key
      */
     virtual void keyReleased(char key)=0;
+
+    /**
+     * A key has been pressed or held down on a keyboard that has 16 bit key codes, by default this calls
+     * keyPressed with the code truncated to a char, override it when using 16 bit key code layouts.
+     * @param keyCode the 16 bit key code of the key
+     * @param held if held down
+     */
+    virtual void keyCodePressed(uint16_t keyCode, bool held) { keyPressed((char)keyCode, held); }
+
+    /**
+     * A key has been released on a keyboard that has 16 bit key codes, by default this calls keyReleased
+     * with the code truncated to a char, override it when using 16 bit key code layouts.
+     * @param keyCode the 16 bit key code of the key
+     */
+    virtual void keyCodeReleased(uint16_t keyCode) { keyReleased((char)keyCode); }
 };
 
 /**
@@ -37,14 +52,16 @@ public:
  * matrix. There are two standard ones defined in this file. They are LAYOUT_3X4, LAYOUT_4X4.
  * When creating a class of this type, be sure that your string of keyCode mappings is defined as
  * PROGMEM and at rows * cols in size. You can either use one of the standard defined layouts or
- * generate your own.
+ * generate your own. For larger keyboards, the key codes can instead be a PROGMEM array of 16 bit
+ * values, and the pins can span several devices by using a MultiIoAbstraction.
  */
 class KeyboardLayout {
 private:
     uint8_t rows;
     uint8_t cols;
     const char *pgmLayout;
-    uint8_t *pins;
+    const uint16_t *pgmKeyCodes;
+    pinid_t *pins;
 public:
     /**
      * Create a keyboard layout with a number of rows and columns, the characters that are associated
@@ -57,36 +74,64 @@ public:
         this->rows = rows;
         this->cols = cols;
         this->pgmLayout = pgmLayout;
-        this->pins = new uint8_t[rows + cols];
+        this->pgmKeyCodes = nullptr;
+        this->pins = new pinid_t[rows + cols];
+    }
+
+    /**
+     * Create a keyboard layout with a number of rows and columns, where each key has a 16 bit key code
+     * provided in a PROGMEM array of rows * cols in size.
+     * @param rows the number of rows in the keyboard
+     * @param cols the number of columns in the keyboard.
+     * @param pgmKeyCodes the 16 bit key codes for each position in the keyboard
+     */
+    KeyboardLayout(uint8_t rows, uint8_t cols, const uint16_t* pgmKeyCodes) {
+        this->rows = rows;
+        this->cols = cols;
+        this->pgmLayout = nullptr;
+        this->pgmKeyCodes = pgmKeyCodes;
+        this->pins = new pinid_t[rows + cols];
     }
 
     ~KeyboardLayout() {
-        delete pins;
+        delete[] pins;
     }
 
     int numColumns() { return cols; }
 
     int numRows() { return rows; }
 
-    void setColPin(int col, int pin) {
+    void setColPin(int col, pinid_t pin) {
         if(col < cols) pins[rows + col] = pin;
     }
 
-    void setRowPin(int row, int pin) {
+    void setRowPin(int row, pinid_t pin) {
         if(row < rows) pins[row] = pin;
     }
 
-    int getRowPin(int row) {
+    pinid_t getRowPin(int row) {
         return pins[row];
     }
 
-    int getColPin(int col) {
+    pinid_t getColPin(int col) {
         return pins[rows + col];
     }
 
     char keyFor(uint8_t row, uint8_t col) {
-        if(row < rows && col < cols) return pgm_read_byte_near(&pgmLayout[(row * cols)+col]);
-        else return 0;
+        return (char)keyCodeFor(row, col);
+    }
+
+    /**
+     * Gets the key code for a position in the keyboard, for char layouts this is the character.
+     * @param row the row of the key
+     * @param col the column of the key
+     * @return the key code, or 0 if the position is outside of the keyboard.
+     */
+    uint16_t keyCodeFor(uint8_t row, uint8_t col) {
+        if(row >= rows || col >= cols) return 0;
+        uint16_t idx = (row * cols) + col;
+        if(pgmKeyCodes != nullptr) return pgm_read_word_near(&pgmKeyCodes[idx]);
+        return pgm_read_byte_near(&pgmLayout[idx]);
     }
 };
 
@@ -102,6 +147,62 @@ enum KeyMode: uint8_t {
 
 #define KEYBOARD_TASK_MILLIS 50
 
+/**
+ * The largest number of rows or columns that can be handled in port wide scanning, as both the
+ * rows and columns must each be on a single 8 bit port.
+ */
+#define KEYBOARD_PORT_WIDE_MAX 8
+
+/**
+ * When idle interrupt mode is enabled, this is the number of scans with no keys pressed before scanning stops
+ * and the keyboard waits for an interrupt from the row pins.
+ */
+#ifndef KEYBOARD_IDLE_SCANS
+#define KEYBOARD_IDLE_SCANS 4
+#endif
+
+/**
+ * The way in which the keyboard manager scans the matrix, either one pin at a time, or a whole port at once.
+ */
+enum KeyboardScanMode : uint8_t {
+    /**
+     * The default mode, each column is written and each row is read one pin at a time with two syncs and a
+     * settle time per column. Only one key can be pressed at once, it works with any arrangement of pins.
+     */
+    KEYBOARD_SCAN_PIN_BY_PIN,
+    /**
+     * All columns are written in one go using writePort and all rows read back using readPort, with one sync
+     * per column. The full key matrix is tracked so every key pressed is reported (n-key rollover), scans where
+     * ghost keys could be present are ignored. The columns must all be on one port, as must the rows, ports
+     * are in groups of 8 pins as on the IO expanders (pin / 8 is the port, pin % 8 the bit). Any bits on the
+     * column port that are not columns are written high. Board pins from internalDigitalIo() are not numbered in
+     * this way, so this mode is not available on them.
+     */
+    KEYBOARD_SCAN_PORT_WIDE
+};
+
+class MatrixKeyboardManager;
+
+/**
+ * Internally used by the keyboard manager in idle interrupt mode, it is triggered from the row interrupt
+ * and restarts scanning on task manager outside of the interrupt.
+ */
+class KeyboardWakeEvent : public BaseEvent {
+private:
+    MatrixKeyboardManager* keyboard;
+public:
+    explicit KeyboardWakeEvent(MatrixKeyboardManager* keyboard) : BaseEvent() {
+        this->keyboard = keyboard;
+    }
+
+    uint32_t timeOfNextCheck() override {
+        // only ever triggered by the interrupt, so we just check back very infrequently.
+        return 60UL * 1000000UL;
+    }
+
+    void exec() override;
+};
+
 /**
  * A keyboard manager that can determine if a key is pressed or released for a given
  * layout of keyboard. It is configured during initialisation with an IoAbstraction
@@ -118,13 +219,156 @@ private:
     char currentKey;
     KeyMode keyMode;
     uint8_t counter;
+    KeyboardScanMode scanMode;
+    uint16_t settleMicros;
+    uint8_t keyState[KEYBOARD_PORT_WIDE_MAX];
+    uint8_t lastScan[KEYBOARD_PORT_WIDE_MAX];
+    uint8_t repeatRow;
+    uint8_t repeatCol;
+    bool ghostDetected;
+    bool idleInterrupts;
+    volatile bool wakeArmed;
+    uint8_t idleScanCount;
+    taskid_t scanTaskId;
+    taskid_t wakeTaskId;
+    KeyboardWakeEvent wakeEvent;
 public:
     MatrixKeyboardManager();
+
+    /**
+     * Stops scanning and removes the wake event from task manager, if this keyboard was using idle interrupts the
+     * row interrupt no longer refers to it, so that nothing is left pointing at this object.
+     */
+    ~MatrixKeyboardManager();
     void initialise(IoAbstractionRef ref, KeyboardLayout* layout, KeyboardListener* listener);
     void setRepeatKeyMillis(int startAfterMillis, int repeatMillis);
+
+    /**
+     * Choose how the keyboard is scanned, this should be called before initialise. If port wide scanning is
+     * requested but the layout does not fit within one column port and one row port, or the device is
+     * internalDigitalIo() (ioUsingArduino() on Arduino), initialise falls back to pin by pin scanning.
+     * @param mode the scanning mode, see KeyboardScanMode
+     * @param settleMicros port wide only, an optional delay between writing each column and reading the rows,
+     *        when not zero an extra sync is needed per column.
+     */
+    void setScanMode(KeyboardScanMode mode, uint16_t settleMicros = 0) {
+        this->scanMode = mode;
+        this->settleMicros = settleMicros;
+    }
+
+    /**
+     * Turn on idle interrupt mode, this should be called before initialise. Once no keys have been pressed for
+     * KEYBOARD_IDLE_SCANS scans, all columns are driven low and scanning stops until any row pin interrupts,
+     * at which point regular scanning resumes until the keys are released again. The interrupt is attached to
+     * the row pins on the IoAbstraction, so for an expander, it must have been created with an interrupt pin.
+     * Only one keyboard manager can use idle interrupts at once.
+     * @param useInterrupts true to stop scanning while the keyboard is idle.
+     */
+    void setUsingIdleInterrupt(bool useInterrupts) { idleInterrupts = useInterrupts; }
+
+    /** @return true if idle interrupt mode is on and scanning is currently stopped waiting for a key press */
+    bool isIdle() { return idleInterrupts && scanTaskId == TASKMGR_INVALIDID; }
+
+    /** @return the scan mode that is in use */
+    KeyboardScanMode getScanMode() { return scanMode; }
+
+    /**
+     * Port wide mode only, gets the debounced state of a key in the matrix.
+     * @param row the row of the key
+     * @param col the column of the key
+     * @return true if the key is currently pressed
+     */
+    bool isKeyDown(uint8_t row, uint8_t col) {
+        return row < KEYBOARD_PORT_WIDE_MAX && col < KEYBOARD_PORT_WIDE_MAX && bitRead(keyState[row], col);
+    }
+
+    /** @return port wide mode only, true if the last scan was ignored because ghost keys could be present */
+    bool isGhostDetected() { return ghostDetected; }
+
     void exec();
+
+    /** Internal use, called when the keyboard is woken by an interrupt to restart scanning */
+    void wakeFromIdle();
+
+    /** Internal use, called from the row interrupt */
+    void rowInterrupt();
 private:
     void setToOuput(int i);
+    bool isPortWideLayoutValid();
+    void scanPortWide();
+    bool isMatrixIdle();
+    void checkForIdle();
+};
+
+/**
+ * A keyboard manager for large matrix keyboards such as control surfaces, that tracks every key in the matrix
+ * independently. The state of the whole matrix is held in bitmaps and debounced using vertical counters, so each key
+ * must read the same for four consecutive scans before it changes state, regardless of what other keys are doing.
+ * Every key that is held repeats on its own schedule. Reading and debouncing the matrix takes the same work no matter
+ * how many keys are pressed, each key that is held or changing then adds its repeat handling and listener calls, and
+ * bytes of the matrix with no keys held are skipped. Key codes are 16 bit, see KeyboardListener::keyCodePressed.
+ *
+ * The columns are driven low one at a time with a single sync each, and the rows are read back pin by pin, so
+ * the rows and columns can be spread across several devices using a MultiIoAbstraction. Memory for the
+ * matrix is allocated during initialise, around 4 bits and one byte per key. As every key is reported, the
+ * matrix should have a diode per key to avoid ghosting.
+ */
+class LargeMatrixKeyboardManager : public Executable {
+private:
+    KeyboardListener* listener;
+    KeyboardLayout* layout;
+    IoAbstractionRef ioRef;
+    uint8_t* scanBits;
+    uint8_t* keyState;
+    uint8_t* countLow;
+    uint8_t* countHigh;
+    uint8_t* repeatCounters;
+    uint16_t bitmapSize;
+    uint16_t scanMillis;
+    uint16_t settleMicros;
+    uint8_t repeatStartTicks;
+    uint8_t repeatTicks;
+    taskid_t scanTaskId;
+public:
+    LargeMatrixKeyboardManager();
+    ~LargeMatrixKeyboardManager();
+
+    /**
+     * Initialise the keyboard and start scanning it on task manager, it can be called again to change the layout.
+     * @param ref the IoAbstraction that the rows and columns are on, for multiple devices use MultiIoAbstraction
+     * @param layout the keyboard layout, usually with 16 bit key codes
+     * @param listener the listener that will be notified of key presses
+     * @param scanMillis the interval between each scan, a key needs four consistent scans to change state
+     */
+    void initialise(IoAbstractionRef ref, KeyboardLayout* layout, KeyboardListener* listener, uint16_t scanMillis = 10);
+
+    /**
+     * Set the time after which a held key starts repeating, and the interval between repeats
+     * @param startAfterMillis the time before repeating starts
+     * @param repeatMillis the interval between each repeat
+     */
+    void setRepeatKeyMillis(int startAfterMillis, int repeatMillis);
+
+    /**
+     * Set an optional settle time between driving each column and reading the rows, when not zero an extra sync
+     * is needed for each column.
+     * @param micros the settle time in microseconds.
+     */
+    void setSettleMicros(uint16_t micros) { settleMicros = micros; }
+
+    /**
+     * Gets the debounced state of a key in the matrix.
+     * @param row the row of the key
+     * @param col the column of the key
+     * @return true if the key is currently pressed
+     */
+    bool isKeyDown(uint8_t row, uint8_t col);
+
+    void exec() override;
+private:
+    void scanMatrix();
+    void keyChanged(uint16_t keyIndex, bool pressed);
+    void freeMatrix();
 };
 
 #define MAKE_KEYBOARD_LAYOUT_3X4(varName) const char KEYBOARD_STD_3X4_KEYS[] PROGMEM = "123456789*0#"; KeyboardLayout varName(4, 3, KEYBOARD_STD_3X4_KEYS);
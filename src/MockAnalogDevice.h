@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _MOCK_ANALOG_DEVICE_H_
+#define _MOCK_ANALOG_DEVICE_H_
+
+/**
+ * @file MockAnalogDevice.h
+ *
+ * Contains a simulated analog device that is useful for testing code that uses AnalogDevice without any hardware,
+ * it is not designed for use in production.
+ */
+
+#include "AnalogDeviceAbstraction.h"
+
+/** the number of pins that the mock analog device can simulate, pins are numbered from 0. */
+#ifndef MOCK_ANALOG_PINS
+#define MOCK_ANALOG_PINS 16
+#endif
+
+/**
+ * A simulated analog device, the value that each input pin reads is set up front with setReadValue, and each value
+ * written to an output can be checked with getWrittenValue. Every conversion is counted so that tests can check how
+ * much ADC time a piece of code uses. Pins outside of the range read as 0.
+ */
+class MockAnalogDevice : public AnalogDevice {
+private:
+    unsigned int inputValues[MOCK_ANALOG_PINS];
+    unsigned int outputValues[MOCK_ANALOG_PINS];
+    uint32_t conversions;
+    uint8_t bitDepth;
+public:
+    /**
+     * Create a mock analog device with a given bit depth for both input and output
+     * @param bitDepth the number of bits in both directions
+     */
+    explicit MockAnalogDevice(uint8_t bitDepth = 10) {
+        this->bitDepth = bitDepth;
+        this->conversions = 0;
+        for(int i=0; i<MOCK_ANALOG_PINS; i++) {
+            inputValues[i] = 0;
+            outputValues[i] = 0;
+        }
+    }
+
+    int getMaximumRange(AnalogDirection /*direction*/, pinid_t /*pin*/) override { return (1 << bitDepth) - 1; }
+
+    int getBitDepth(AnalogDirection /*direction*/, pinid_t /*pin*/) override { return bitDepth; }
+
+    void initPin(pinid_t /*pin*/, AnalogDirection /*direction*/) override { }
+
+    unsigned int getCurrentValue(pinid_t pin) override {
+        conversions++;
+        return (pin < MOCK_ANALOG_PINS) ? inputValues[pin] : 0;
+    }
+
+    float getCurrentFloat(pinid_t pin) override {
+        return float(getCurrentValue(pin)) / float(getMaximumRange(DIR_IN, pin));
+    }
+
+    void setCurrentValue(pinid_t pin, unsigned int newValue) override {
+        if(pin < MOCK_ANALOG_PINS) outputValues[pin] = newValue;
+    }
+
+    void setCurrentFloat(pinid_t pin, float newValue) override {
+        setCurrentValue(pin, (unsigned int)(newValue * float(getMaximumRange(DIR_OUT, pin))));
+    }
+
+    /** set the value that will be read from a pin on every following conversion */
+    void setReadValue(pinid_t pin, unsigned int value) { if(pin < MOCK_ANALOG_PINS) inputValues[pin] = value; }
+
+    /** @return the last value written to an output pin */
+    unsigned int getWrittenValue(pinid_t pin) { return (pin < MOCK_ANALOG_PINS) ? outputValues[pin] : 0; }
+
+    /** @return the number of conversions that have been made since creation or the last reset */
+    uint32_t getConversionCount() { return conversions; }
+
+    /** reset the conversion count back to 0 */
+    void resetConversionCount() { conversions = 0; }
+};
+
+#endif //_MOCK_ANALOG_DEVICE_H_
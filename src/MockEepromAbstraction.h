@@ -109,4 +109,67 @@ public:
     }
 };
 
+/**
+ * A mock eeprom that also counts how many times each byte has been written, so that the wear caused by a storage
+ * scheme can be measured in tests. A write counts as wear even if the value did not change. It can also report a
+ * page size so that it behaves like a paged device.
+ */
+class WearCountingEepromAbstraction : public MockEepromAbstraction {
+private:
+    uint32_t *wear;
+    unsigned int memSize;
+    uint16_t pageSize;
+    uint32_t bytesWritten;
+public:
+    explicit WearCountingEepromAbstraction(unsigned int size = 128, uint16_t pageSize = 0) : MockEepromAbstraction(size) {
+        wear = new uint32_t[size];
+        memSize = size;
+        this->pageSize = pageSize;
+        resetWear();
+    }
+    ~WearCountingEepromAbstraction() override {
+        delete[] wear;
+    }
+
+    void resetWear() {
+        memset(wear, 0, memSize * sizeof(uint32_t));
+        bytesWritten = 0;
+    }
+
+    uint16_t getPageSize() override { return pageSize; }
+
+    void write8(EepromPosition position, uint8_t val) override {
+        if(position < memSize) wear[position]++;
+        bytesWritten++;
+        MockEepromAbstraction::write8(position, val);
+    }
+
+    void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override {
+        for(uint8_t i = 0; i < len; i++) {
+            if(uint16_t(romDest + i) < memSize) wear[romDest + i]++;
+        }
+        bytesWritten += len;
+        MockEepromAbstraction::writeArrayToRom(romDest, memSrc, len);
+    }
+
+    /** @return the number of times the byte at position has been written */
+    uint32_t getWearAt(EepromPosition position) const { return position < memSize ? wear[position] : 0; }
+
+    /** @return the total number of bytes written since the last reset */
+    uint32_t getBytesWritten() const { return bytesWritten; }
+
+    /**
+     * Gets the most and least worn bytes within a range, the least worn is usually the best guide to how evenly
+     * the wear is spread.
+     */
+    void getWearRange(EepromPosition start, unsigned int len, uint32_t& minWear, uint32_t& maxWear) const {
+        minWear = 0xffffffffUL;
+        maxWear = 0;
+        for(unsigned int i = start; i < start + len && i < memSize; i++) {
+            if(wear[i] < minWear) minWear = wear[i];
+            if(wear[i] > maxWear) maxWear = wear[i];
+        }
+    }
+};
+
 #endif
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "Pca9685AnalogDevice.h"
+#include "IoLogging.h"
+
+#define PCA9685_OSCILLATOR_HZ 25000000UL
+#define PCA9685_MAX_VALUE 4095U
+
+Pca9685AnalogDevice::Pca9685AnalogDevice(uint8_t address, uint16_t pwmFrequency, bool totemPole, WireType wireImpl) {
+    this->wireImpl = wireImpl;
+    this->address = address;
+    this->pwmFrequency = pwmFrequency;
+    this->totemPole = totemPole;
+    this->dirtyChannels = 0;
+    this->initialised = false;
+    this->errorOccurred = false;
+    for(auto& v : values) v = 0;
+}
+
+bool Pca9685AnalogDevice::begin() {
+    // the prescaler can only be changed while the oscillator is asleep
+    uint32_t prescale = (PCA9685_OSCILLATOR_HZ + (2048UL * pwmFrequency)) / (4096UL * pwmFrequency) - 1;
+    if(prescale < 3) prescale = 3;
+    if(prescale > 255) prescale = 255;
+
+    bool ok = writeRegister(PCA9685_MODE1_REG, PCA9685_MODE1_SLEEP | PCA9685_MODE1_AUTO_INC);
+    ok = ok && writeRegister(PCA9685_PRESCALE_REG, (uint8_t)prescale);
+    ok = ok && writeRegister(PCA9685_MODE2_REG, totemPole ? PCA9685_MODE2_TOTEM_POLE : 0);
+    ok = ok && writeRegister(PCA9685_MODE1_REG, PCA9685_MODE1_AUTO_INC);
+    delayMicroseconds(500);
+    ok = ok && writeRegister(PCA9685_MODE1_REG, PCA9685_MODE1_AUTO_INC | PCA9685_MODE1_RESTART);
+
+    if(!ok) {
+        serdebugF2("PCA9685 did not respond at ", address);
+        errorOccurred = true;
+        return false;
+    }
+    initialised = true;
+    dirtyChannels = 0xffff;
+    return true;
+}
+
+int Pca9685AnalogDevice::getMaximumRange(AnalogDirection direction, pinid_t /*pin*/) {
+    return direction == DIR_OUT ? PCA9685_MAX_VALUE : 0;
+}
+
+int Pca9685AnalogDevice::getBitDepth(AnalogDirection direction, pinid_t /*pin*/) {
+    return direction == DIR_OUT ? 12 : 0;
+}
+
+void Pca9685AnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
+    if(direction != DIR_OUT || pin >= PCA9685_CHANNELS) {
+        serdebugF2("PCA9685 only supports output on pins 0-15, pin ", pin);
+        return;
+    }
+    if(!initialised) begin();
+}
+
+unsigned int Pca9685AnalogDevice::getCurrentValue(pinid_t pin) {
+    return pin < PCA9685_CHANNELS ? values[pin] : 0;
+}
+
+float Pca9685AnalogDevice::getCurrentFloat(pinid_t pin) {
+    return float(getCurrentValue(pin)) / float(PCA9685_MAX_VALUE);
+}
+
+void Pca9685AnalogDevice::setCurrentValue(pinid_t pin, unsigned int newValue) {
+    if(pin >= PCA9685_CHANNELS) return;
+    if(newValue > PCA9685_MAX_VALUE) newValue = PCA9685_MAX_VALUE;
+    if(values[pin] == newValue) return;
+    values[pin] = newValue;
+    bitSet(dirtyChannels, pin);
+}
+
+void Pca9685AnalogDevice::setCurrentFloat(pinid_t pin, float newValue) {
+    if(newValue < 0.0F) newValue = 0.0F;
+    setCurrentValue(pin, (unsigned int)(newValue * float(PCA9685_MAX_VALUE) + 0.5F));
+}
+
+void Pca9685AnalogDevice::encodeChannel(uint8_t* dest, uint16_t value) {
+    // the output always turns on at count 0 and off at the value, the extremes use the full on and off bits.
+    if(value == 0) {
+        dest[0] = 0; dest[1] = 0; dest[2] = 0; dest[3] = PCA9685_FULL_ON_OFF;
+    }
+    else if(value >= PCA9685_MAX_VALUE) {
+        dest[0] = 0; dest[1] = PCA9685_FULL_ON_OFF; dest[2] = 0; dest[3] = 0;
+    }
+    else {
+        dest[0] = 0; dest[1] = 0; dest[2] = uint8_t(value); dest[3] = uint8_t(value >> 8U);
+    }
+}
+
+bool Pca9685AnalogDevice::sync() {
+    if(dirtyChannels == 0) return true;
+
+    bool allSame = dirtyChannels == 0xffff;
+    for(uint8_t i = 1; allSame && i < PCA9685_CHANNELS; i++) allSame = values[i] == values[0];
+    if(allSame) {
+        uint8_t data[5];
+        data[0] = PCA9685_ALL_LED_REG;
+        encodeChannel(&data[1], values[0]);
+        if(!writeBurst(data, sizeof data)) {
+            errorOccurred = true;
+            return false;
+        }
+        dirtyChannels = 0;
+        return true;
+    }
+
+    bool ok = true;
+    uint8_t ch = 0;
+    while(ch < PCA9685_CHANNELS) {
+        if(!bitRead(dirtyChannels, ch)) {
+            ch++;
+            continue;
+        }
+        uint8_t count = 1;
+        while(ch + count < PCA9685_CHANNELS && count < PCA9685_MAX_BURST_CHANNELS && bitRead(dirtyChannels, ch + count)) {
+            count++;
+        }
+        ok = writeRun(ch, count) && ok;
+        ch += count;
+    }
+    return ok;
+}
+
+bool Pca9685AnalogDevice::writeRun(uint8_t first, uint8_t count) {
+    uint8_t data[1 + (PCA9685_MAX_BURST_CHANNELS * 4)];
+    data[0] = PCA9685_LED0_REG + (first * 4);
+    for(uint8_t i = 0; i < count; i++) {
+        encodeChannel(&data[1 + (i * 4)], values[first + i]);
+    }
+    if(!writeBurst(data, 1 + (count * 4))) {
+        errorOccurred = true;
+        return false;
+    }
+    for(uint8_t i = 0; i < count; i++) bitClear(dirtyChannels, first + i);
+    return true;
+}
+
+bool Pca9685AnalogDevice::writeRegister(uint8_t reg, uint8_t value) {
+    uint8_t data[2];
+    data[0] = reg;
+    data[1] = value;
+    return writeBurst(data, sizeof data);
+}
+
+bool Pca9685AnalogDevice::writeBurst(const uint8_t* data, size_t len) {
+    return ioaWireWriteWithRetry(wireImpl, address, data, len);
+}
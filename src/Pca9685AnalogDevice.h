@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _PCA9685_ANALOG_DEVICE_H_
+#define _PCA9685_ANALOG_DEVICE_H_
+
+/**
+ * @file Pca9685AnalogDevice.h
+ *
+ * Contains an AnalogDevice for the PCA9685 16 channel, 12 bit I2C PWM controller often used for LEDs and servos.
+ */
+
+#include "PlatformDeterminationWire.h"
+#include "AnalogDeviceAbstraction.h"
+
+/** the number of PWM outputs on the device */
+#define PCA9685_CHANNELS 16
+/** the default I2C address with all address pins connected to ground */
+#define PCA9685_DEFAULT_ADDRESS 0x40
+
+/** the register addresses used by this driver, see the datasheet for details */
+#define PCA9685_MODE1_REG 0x00
+#define PCA9685_MODE2_REG 0x01
+#define PCA9685_LED0_REG 0x06
+#define PCA9685_ALL_LED_REG 0xFA
+#define PCA9685_PRESCALE_REG 0xFE
+
+/** the bits in the mode registers */
+#define PCA9685_MODE1_RESTART 0x80
+#define PCA9685_MODE1_AUTO_INC 0x20
+#define PCA9685_MODE1_SLEEP 0x10
+#define PCA9685_MODE2_TOTEM_POLE 0x04
+/** in the high byte of the on or off registers, forces the output fully on or off */
+#define PCA9685_FULL_ON_OFF 0x10
+
+/**
+ * The maximum number of channels that are written in one auto increment burst, each channel is 4 bytes and the
+ * register address takes one more, so the default of 7 fits in the 32 byte buffer of most Wire libraries.
+ */
+#ifndef PCA9685_MAX_BURST_CHANNELS
+#define PCA9685_MAX_BURST_CHANNELS 7
+#endif
+
+/**
+ * An output only AnalogDevice for the PCA9685 PWM controller. Calls to setCurrentValue and setCurrentFloat only
+ * update a buffer on the device object, nothing is sent until sync() is called. During sync each run of adjacent
+ * changed channels is written in a single auto increment burst, and unchanged channels are not written at all, so
+ * a frame that changes three neighbouring LEDs costs one transaction instead of three. When every channel changes
+ * to the same value, a single write to the all LED register is used instead.
+ *
+ * Values are 12 bit, 0 is fully off and 4095 fully on. The device is set up on the first call to initPin, or
+ * by calling begin() directly, after Wire has been started.
+ *
+ * Example: `Pca9685AnalogDevice pwm(0x40); pwm.initPin(0, DIR_OUT); pwm.setCurrentValue(0, 2048); pwm.sync();`
+ */
+class Pca9685AnalogDevice : public AnalogDevice {
+private:
+    WireType wireImpl;
+    uint16_t values[PCA9685_CHANNELS];
+    uint16_t dirtyChannels;
+    uint16_t pwmFrequency;
+    uint8_t address;
+    bool totemPole;
+    bool initialised;
+    bool errorOccurred;
+public:
+    /**
+     * Create the device at the given address.
+     * @param address the I2C address of the controller
+     * @param pwmFrequency the PWM frequency in Hz, between 24 and 1526, 50 is typical for servos
+     * @param totemPole true for totem pole outputs (LEDs directly driven), false for open drain
+     * @param wireImpl the wire instance to use, defaults to the standard one
+     */
+    explicit Pca9685AnalogDevice(uint8_t address = PCA9685_DEFAULT_ADDRESS, uint16_t pwmFrequency = 200,
+                                 bool totemPole = true, WireType wireImpl = defaultWireTypePtr);
+
+    /**
+     * Sets up the modes and PWM frequency of the controller with auto increment turned on, all outputs are
+     * marked as changed so the next sync writes the buffered values.
+     * @return true if the device responded
+     */
+    bool begin();
+
+    int getMaximumRange(AnalogDirection direction, pinid_t pin) override;
+    int getBitDepth(AnalogDirection direction, pinid_t pin) override;
+    void initPin(pinid_t pin, AnalogDirection direction) override;
+
+    /** @return the value that is buffered for the output, it is not read back from the device */
+    unsigned int getCurrentValue(pinid_t pin) override;
+    float getCurrentFloat(pinid_t pin) override;
+
+    /** buffers a new value for the output, it is written on the next sync if it has changed */
+    void setCurrentValue(pinid_t pin, unsigned int newValue) override;
+    void setCurrentFloat(pinid_t pin, float newValue) override;
+
+    /**
+     * Writes all the changed channels to the device in as few transactions as possible.
+     * @return true if all writes succeeded, failed channels are retried on the next sync.
+     */
+    bool sync();
+
+    /** @return true if there are changed values that have not been written yet */
+    bool isSyncNeeded() const { return dirtyChannels != 0; }
+
+    /**
+     * This indicates if an I2C error has occurred at any point since the last call.
+     * Side effect: Every call clears it's state.
+     */
+    bool hasErrorOccurred() {
+        bool ret = errorOccurred;
+        errorOccurred = false;
+        return ret;
+    }
+
+protected:
+    /**
+     * Writes a buffer to the device in one transaction, the first byte is the register. Overridden to simulate
+     * the device in tests.
+     * @return true if the device acknowledged the write
+     */
+    virtual bool writeBurst(const uint8_t* data, size_t len);
+
+private:
+    static void encodeChannel(uint8_t* dest, uint16_t value);
+    bool writeRegister(uint8_t reg, uint8_t value);
+    bool writeRun(uint8_t first, uint8_t count);
+};
+
+#endif //_PCA9685_ANALOG_DEVICE_H_
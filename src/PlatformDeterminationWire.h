@@ -54,6 +54,22 @@ bool ioaWireRead(WireType wire, int address, uint8_t* buffer, size_t len);
  */
 bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, size_t len, int retriesAllowed = 0, bool sendStop = true);
 
+/**
+ * Writes a prefix, such as a register or memory address, followed by the data in a single transaction, without first
+ * copying them into one buffer. Apart from that it is the same as ioaWireWriteWithRetry. On Arduino, the combined
+ * length must not exceed the wire library's buffer size.
+ * @param pI2c the wire implementation
+ * @param address the address to write to
+ * @param prefix the bytes to send first
+ * @param prefixLen the number of prefix bytes
+ * @param buffer the data to send after the prefix
+ * @param len the length of the data
+ * @param retriesAllowed the number of retries before failing
+ * @return true if successful, otherwise false.
+ */
+bool ioaWireWritePrefixed(WireType pI2c, int address, const uint8_t* prefix, size_t prefixLen,
+                          const uint8_t* buffer, size_t len, int retriesAllowed = 0);
+
 /**
  * Sets the frequency of the selected I2C bus.
  * @param pI2c the I2C that the frequency is to be adjusted
@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "RecordingIoAbstraction.h"
+#include "IoLogging.h"
+
+//
+// Trace buffer
+//
+
+IoTraceBuffer::IoTraceBuffer(size_t capacity) {
+    this->data = new uint8_t[capacity];
+    this->capacity = capacity;
+    this->used = 0;
+    this->readPosition = 0;
+    this->overflowed = false;
+    this->ownsData = true;
+}
+
+IoTraceBuffer::IoTraceBuffer(uint8_t* existingTrace, size_t length) {
+    this->data = existingTrace;
+    this->capacity = length;
+    this->used = length;
+    this->readPosition = 0;
+    this->overflowed = false;
+    this->ownsData = false;
+}
+
+IoTraceBuffer::~IoTraceBuffer() {
+    if(ownsData) delete[] data;
+}
+
+bool IoTraceBuffer::append(IoTraceEventType type, uint8_t pin, uint8_t value, uint32_t deltaMicros) {
+    size_t needed = (deltaMicros > 0xffffUL) ? IOTRACE_RECORD_SIZE * 2 : IOTRACE_RECORD_SIZE;
+    if(used + needed > capacity) {
+        overflowed = true;
+        return false;
+    }
+
+    if(deltaMicros > 0xffffUL) {
+        // the whole delta goes into a gap record, the record that follows it has no delta of its own.
+        data[used++] = IOTRACE_TIME_GAP;
+        data[used++] = uint8_t(deltaMicros >> 24U);
+        data[used++] = uint8_t(deltaMicros >> 16U);
+        data[used++] = uint8_t(deltaMicros >> 8U);
+        data[used++] = uint8_t(deltaMicros);
+        deltaMicros = 0;
+    }
+
+    data[used++] = type;
+    data[used++] = pin;
+    data[used++] = value;
+    data[used++] = uint8_t(deltaMicros >> 8U);
+    data[used++] = uint8_t(deltaMicros);
+    return true;
+}
+
+bool IoTraceBuffer::next(IoTraceRecord& rec) {
+    uint32_t gap = 0;
+    while(readPosition + IOTRACE_RECORD_SIZE <= used) {
+        const uint8_t* rd = &data[readPosition];
+        readPosition += IOTRACE_RECORD_SIZE;
+        if(rd[0] == IOTRACE_TIME_GAP) {
+            gap += ((uint32_t)rd[1] << 24U) | ((uint32_t)rd[2] << 16U) | ((uint32_t)rd[3] << 8U) | rd[4];
+            continue;
+        }
+        rec.type = (IoTraceEventType)rd[0];
+        rec.pin = rd[1];
+        rec.value = rd[2];
+        rec.deltaMicros = gap + (((uint32_t)rd[3] << 8U) | rd[4]);
+        return true;
+    }
+    return false;
+}
+
+static bool tracePinRead(const uint8_t* bits, pinid_t pin) {
+    return (bits[pin / 8] >> (pin % 8)) & 1U;
+}
+
+static void tracePinWrite(uint8_t* bits, pinid_t pin, bool value) {
+    if(value) bits[pin / 8] |= uint8_t(1U << (pin % 8));
+    else bits[pin / 8] &= uint8_t(~(1U << (pin % 8)));
+}
+
+//
+// Recording decorator, interrupts are captured using a small table of trampolines as the raw handlers take no
+// parameters, each slot counts the interrupt and then calls on to the original handler. The trace must not be
+// appended to in interrupt context, so the count is turned into records by the next call on the recorder. Only
+// the trampoline writes isrCount and only the recorder writes drainedCount, so no locking is needed.
+//
+
+struct IoTraceInterruptSlot {
+    RecordingIoAbstraction* recorder;
+    RawIntHandler handler;
+    pinid_t pin;
+    uint8_t mode;
+    volatile uint8_t isrCount;
+    uint8_t drainedCount;
+};
+
+static IoTraceInterruptSlot traceInterruptSlots[IOTRACE_MAX_INTERRUPTS];
+
+template<int SLOT> void traceInterruptTrampoline() {
+    auto& slot = traceInterruptSlots[SLOT];
+    slot.isrCount++;
+    if(slot.handler != nullptr) slot.handler();
+}
+
+static RawIntHandler traceTrampolineFor(uint8_t slot) {
+    switch(slot) {
+        case 0: return traceInterruptTrampoline<0>;
+#if IOTRACE_MAX_INTERRUPTS > 1
+        case 1: return traceInterruptTrampoline<1>;
+#endif
+#if IOTRACE_MAX_INTERRUPTS > 2
+        case 2: return traceInterruptTrampoline<2>;
+#endif
+#if IOTRACE_MAX_INTERRUPTS > 3
+        case 3: return traceInterruptTrampoline<3>;
+#endif
+        default: return nullptr;
+    }
+}
+
+RecordingIoAbstraction::RecordingIoAbstraction(IoAbstractionRef delegate, IoTraceBuffer* trace) {
+    this->delegate = delegate;
+    this->trace = trace;
+    this->lastRecordMicros = micros();
+    this->changesOnly = true;
+    this->recording = true;
+    this->unrecordedPins = false;
+    memset(lastReadPins, 0, sizeof lastReadPins);
+    memset(knownReadPins, 0, sizeof knownReadPins);
+}
+
+RecordingIoAbstraction::~RecordingIoAbstraction() {
+    for(auto& slot : traceInterruptSlots) {
+        if(slot.recorder != this) continue;
+        delegate->attachInterrupt(slot.pin, slot.handler, slot.mode);
+        slot.recorder = nullptr;
+        slot.handler = nullptr;
+    }
+}
+
+void RecordingIoAbstraction::record(IoTraceEventType type, pinid_t pin, uint8_t value) {
+    // any interrupts since the last call are recorded first, so they stay in order with the reads that follow them
+    drainInterrupts();
+    appendRecord(type, pin, value);
+}
+
+void RecordingIoAbstraction::appendRecord(IoTraceEventType type, pinid_t pin, uint8_t value) {
+    if(!recording) return;
+    if(pin >= IOTRACE_MAX_PINS) {
+        // neither the trace nor the replay can hold this pin, so flag it rather than store a truncated pin
+        unrecordedPins = true;
+        return;
+    }
+    unsigned long now = micros();
+    trace->append(type, (uint8_t)pin, value, now - lastRecordMicros);
+    lastRecordMicros = now;
+}
+
+void RecordingIoAbstraction::drainInterrupts() {
+    for(auto& slot : traceInterruptSlots) {
+        if(slot.recorder != this) continue;
+        uint8_t count = slot.isrCount;
+        while(slot.drainedCount != count) {
+            slot.drainedCount++;
+            appendRecord(IOTRACE_INTERRUPT, slot.pin, 0);
+        }
+    }
+}
+
+void RecordingIoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
+    record(IOTRACE_PIN_MODE, pin, mode);
+    delegate->pinDirection(pin, mode);
+}
+
+void RecordingIoAbstraction::writeValue(pinid_t pin, uint8_t value) {
+    record(IOTRACE_WRITE_VALUE, pin, value);
+    delegate->writeValue(pin, value);
+}
+
+void RecordingIoAbstraction::writePort(pinid_t pin, uint8_t portVal) {
+    record(IOTRACE_WRITE_PORT, pin, portVal);
+    delegate->writePort(pin, portVal);
+}
+
+uint8_t RecordingIoAbstraction::readValue(pinid_t pin) {
+    uint8_t val = delegate->readValue(pin);
+    if(changesOnly && pin < IOTRACE_MAX_PINS) {
+        if(tracePinRead(knownReadPins, pin) && tracePinRead(lastReadPins, pin) == (val != 0)) return val;
+        tracePinWrite(knownReadPins, pin, true);
+        tracePinWrite(lastReadPins, pin, val != 0);
+    }
+    record(IOTRACE_READ_VALUE, pin, val);
+    return val;
+}
+
+uint8_t RecordingIoAbstraction::readPort(pinid_t pin) {
+    uint8_t val = delegate->readPort(pin);
+    // each byte of the pin bitmaps is one port, so a port read updates the same state as reading its pins
+    pinid_t port = pin / 8;
+    if(changesOnly && port < IOTRACE_PIN_BYTES) {
+        if(knownReadPins[port] == 0xffU && lastReadPins[port] == val) return val;
+        knownReadPins[port] = 0xffU;
+        lastReadPins[port] = val;
+    }
+    record(IOTRACE_READ_PORT, pin, val);
+    return val;
+}
+
+bool RecordingIoAbstraction::runLoop() {
+    bool ret = delegate->runLoop();
+    record(IOTRACE_SYNC, 0, ret);
+    return ret;
+}
+
+void RecordingIoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler interruptHandler, uint8_t mode) {
+    for(uint8_t i = 0; i < IOTRACE_MAX_INTERRUPTS; i++) {
+        auto& slot = traceInterruptSlots[i];
+        if(slot.recorder == nullptr || (slot.recorder == this && slot.pin == pin)) {
+            slot.recorder = this;
+            slot.handler = interruptHandler;
+            slot.pin = pin;
+            slot.mode = mode;
+            slot.drainedCount = slot.isrCount;
+            delegate->attachInterrupt(pin, traceTrampolineFor(i), mode);
+            return;
+        }
+    }
+    serdebugF2("No trace interrupt slot for ", pin);
+    delegate->attachInterrupt(pin, interruptHandler, mode);
+}
+
+//
+// Replay device
+//
+
+ReplayIoAbstraction::ReplayIoAbstraction(IoTraceBuffer* trace) : pending() {
+    this->trace = trace;
+    this->pendingTraceTime = 0;
+    memset(pinState, 0, sizeof pinState);
+    this->startMicros = 0;
+    this->maxLatenessMicros = 0;
+    this->recordsReplayed = 0;
+    this->recordedSyncs = 0;
+    this->replaySyncs = 0;
+    this->speed = 1;
+    this->havePending = false;
+    for(uint8_t i = 0; i < IOTRACE_MAX_INTERRUPTS; i++) {
+        intHandlers[i] = nullptr;
+        intPins[i] = 0xff;
+    }
+}
+
+void ReplayIoAbstraction::start(uint8_t speedMultiplier) {
+    speed = speedMultiplier == 0 ? 1 : speedMultiplier;
+    memset(pinState, 0, sizeof pinState);
+    maxLatenessMicros = 0;
+    recordsReplayed = recordedSyncs = replaySyncs = 0;
+    trace->rewind();
+    havePending = trace->next(pending);
+    pendingTraceTime = havePending ? pending.deltaMicros : 0;
+    startMicros = micros();
+    taskManager.execute(this);
+}
+
+uint32_t ReplayIoAbstraction::traceTimeNow() const {
+    return uint32_t(micros() - startMicros) * speed;
+}
+
+uint32_t ReplayIoAbstraction::applyDueRecords() {
+    uint32_t now = traceTimeNow();
+    while(havePending && pendingTraceTime <= now) {
+        uint32_t lateness = (now - pendingTraceTime) / speed;
+        if(lateness > maxLatenessMicros) maxLatenessMicros = lateness;
+
+        switch(pending.type) {
+            case IOTRACE_READ_VALUE:
+                if(pending.pin < IOTRACE_MAX_PINS) tracePinWrite(pinState, pending.pin, pending.value != 0);
+                break;
+            case IOTRACE_READ_PORT:
+                if((pending.pin / 8) < IOTRACE_PIN_BYTES) pinState[pending.pin / 8] = pending.value;
+                break;
+            case IOTRACE_SYNC:
+                recordedSyncs++;
+                break;
+            case IOTRACE_INTERRUPT:
+                fireInterrupt(pending.pin);
+                break;
+            default:
+                break;
+        }
+        recordsReplayed++;
+
+        havePending = trace->next(pending);
+        if(havePending) pendingTraceTime += pending.deltaMicros;
+    }
+    return now;
+}
+
+void ReplayIoAbstraction::fireInterrupt(uint8_t pin) {
+    for(uint8_t i = 0; i < IOTRACE_MAX_INTERRUPTS; i++) {
+        if(intHandlers[i] != nullptr && intPins[i] == pin) {
+            intHandlers[i]();
+            return;
+        }
+    }
+}
+
+void ReplayIoAbstraction::exec() {
+    uint32_t now = applyDueRecords();
+    if(!havePending) {
+        serdebugF2("Replay complete, records ", recordsReplayed);
+        return;
+    }
+    // measured against the same time as the records applied, reading the clock again could pass the due time
+    uint32_t waitMicros = (pendingTraceTime > now) ? (pendingTraceTime - now) / speed : 0;
+    taskManager.scheduleOnce(waitMicros, this, TIME_MICROS);
+}
+
+uint8_t ReplayIoAbstraction::readValue(pinid_t pin) {
+    return (pin < IOTRACE_MAX_PINS && tracePinRead(pinState, pin)) ? HIGH : LOW;
+}
+
+uint8_t ReplayIoAbstraction::readPort(pinid_t pin) {
+    return (pin / 8) < IOTRACE_PIN_BYTES ? pinState[pin / 8] : 0;
+}
+
+bool ReplayIoAbstraction::runLoop() {
+    replaySyncs++;
+    applyDueRecords();
+    return true;
+}
+
+void ReplayIoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler interruptHandler, uint8_t /*mode*/) {
+    // the recorder never stores these pins, so there is nothing to raise
+    if(pin >= IOTRACE_MAX_PINS) return;
+    for(uint8_t i = 0; i < IOTRACE_MAX_INTERRUPTS; i++) {
+        if(intHandlers[i] == nullptr || intPins[i] == pin) {
+            intHandlers[i] = interruptHandler;
+            intPins[i] = pin;
+            return;
+        }
+    }
+}
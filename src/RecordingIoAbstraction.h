@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _RECORDING_IO_ABSTRACTION_H_
+#define _RECORDING_IO_ABSTRACTION_H_
+
+/**
+ * @file RecordingIoAbstraction.h
+ *
+ * Contains an IoAbstraction decorator that records every read, write and interrupt into a compact binary trace,
+ * and a replay device that feeds such a trace back into switches, keyboard manager or an encoder. This allows an
+ * input problem captured in the field to be reproduced deterministically, at original or accelerated speed.
+ */
+
+#include "BasicIoAbstraction.h"
+
+/**
+ * The maximum number of distinct interrupt registrations that the recorder can capture, each one needs a static
+ * trampoline function because raw interrupt handlers have no context.
+ */
+#ifndef IOTRACE_MAX_INTERRUPTS
+#define IOTRACE_MAX_INTERRUPTS 4
+#endif
+
+/**
+ * The number of pins that the recorder and replay track, pins 0 up to one less than this are supported. It must be
+ * a multiple of 8, and no more than 256 as pins are stored as 8 bits in the trace. The default covers ESP32 GPIO
+ * 0-39 and every pin on a Mega 2560, each 8 pins costs a byte in the recorder and a byte in the replay.
+ */
+#ifndef IOTRACE_MAX_PINS
+#define IOTRACE_MAX_PINS 72
+#endif
+
+/** the number of bytes needed to hold one bit for each pin, each byte is also one port of 8 pins */
+#define IOTRACE_PIN_BYTES (IOTRACE_MAX_PINS / 8)
+
+/** the size of each record in the trace buffer, type, pin, value and 16 bit time delta */
+#define IOTRACE_RECORD_SIZE 5
+
+/**
+ * The type of each entry in the trace.
+ */
+enum IoTraceEventType : uint8_t {
+    /** a pin direction was changed, value holds the mode */
+    IOTRACE_PIN_MODE = 1,
+    /** a single pin was read, value holds the pin state */
+    IOTRACE_READ_VALUE,
+    /** a whole port was read, value holds the port */
+    IOTRACE_READ_PORT,
+    /** a single pin was written */
+    IOTRACE_WRITE_VALUE,
+    /** a whole port was written */
+    IOTRACE_WRITE_PORT,
+    /** the device was synchronised, value holds the sync status */
+    IOTRACE_SYNC,
+    /** an interrupt occurred on the pin */
+    IOTRACE_INTERRUPT,
+    /** internal, extends the time delta of the next record beyond 16 bits */
+    IOTRACE_TIME_GAP
+};
+
+/**
+ * A single decoded entry from the trace, the delta is the number of micros since the previous record.
+ */
+struct IoTraceRecord {
+    IoTraceEventType type;
+    uint8_t pin;
+    uint8_t value;
+    uint32_t deltaMicros;
+};
+
+/**
+ * Holds a trace in a fixed size byte buffer. Each record is stored in 5 bytes with the time stored as a delta from
+ * the previous record, gaps longer than 65535 micros take an extra record. Pins are stored as 8 bits. The buffer can
+ * either be allocated by this class or wrap an existing trace, for example one that has been loaded from a capture.
+ */
+class IoTraceBuffer {
+private:
+    uint8_t* data;
+    size_t capacity;
+    size_t used;
+    size_t readPosition;
+    bool overflowed;
+    bool ownsData;
+public:
+    /**
+     * Create an empty trace buffer that can hold up to capacity bytes of trace data.
+     * @param capacity the size of the buffer in bytes
+     */
+    explicit IoTraceBuffer(size_t capacity);
+
+    /**
+     * Wrap an existing trace that was previously captured, the data is not copied and must remain in scope.
+     * @param existingTrace the trace data
+     * @param length the length of the trace in bytes
+     */
+    IoTraceBuffer(uint8_t* existingTrace, size_t length);
+
+    ~IoTraceBuffer();
+
+    /**
+     * Append a record to the trace, if there is no room the overflow flag is set and the record lost.
+     * @return true if the record was stored, otherwise false.
+     */
+    bool append(IoTraceEventType type, uint8_t pin, uint8_t value, uint32_t deltaMicros);
+
+    /**
+     * Decode the next record from the read position into rec, time gap records are folded into the delta.
+     * @param rec the record to be filled in
+     * @return true if a record was available, false at the end of the trace.
+     */
+    bool next(IoTraceRecord& rec);
+
+    /** move the read position back to the start of the trace */
+    void rewind() { readPosition = 0; }
+
+    /** clear down the trace ready for recording again */
+    void clear() { used = readPosition = 0; overflowed = false; }
+
+    /** @return the raw trace data, for saving the trace */
+    const uint8_t* getData() const { return data; }
+
+    /** @return the number of bytes of trace data stored */
+    size_t size() const { return used; }
+
+    /** @return true if at least one record did not fit into the buffer */
+    bool hasOverflowed() const { return overflowed; }
+};
+
+/**
+ * An IoAbstraction decorator that delegates to another IoAbstraction, recording every call along with the time
+ * at which it happened into an IoTraceBuffer. By default reads are only recorded when the value read differs from
+ * the last one recorded, as this is all that is needed to replay and keeps the trace small. Only one recording
+ * device can capture interrupts at once, as the raw handlers have no context.
+ *
+ * Only pins below IOTRACE_MAX_PINS can be recorded, calls on any other pin, or a port that starts at or above it,
+ * are still delegated but are not added to the trace, and hasUnrecordedPins() then returns true. On mbed, where
+ * pins are PinName values, define IOTRACE_MAX_PINS large enough for the pins in use.
+ *
+ * Example usage: IoAbstractionRef ioDevice = new RecordingIoAbstraction(ioFrom8574(0x20), &traceBuffer);
+ */
+class RecordingIoAbstraction : public BasicIoAbstraction {
+private:
+    IoAbstractionRef delegate;
+    IoTraceBuffer* trace;
+    unsigned long lastRecordMicros;
+    uint8_t lastReadPins[IOTRACE_PIN_BYTES];
+    uint8_t knownReadPins[IOTRACE_PIN_BYTES];
+    bool changesOnly;
+    bool recording;
+    bool unrecordedPins;
+public:
+    RecordingIoAbstraction(IoAbstractionRef delegate, IoTraceBuffer* trace);
+
+    /**
+     * Releases any interrupt slots held by this recorder, the original handlers are attached directly to the
+     * delegate again, so the delegate must still exist.
+     */
+    ~RecordingIoAbstraction() override;
+
+    /**
+     * Turn on or off recording of reads that have not changed since the previous read of the same pin or port.
+     * @param onlyChanges true to only record changed reads (default), false to record every read.
+     */
+    void setRecordChangesOnly(bool onlyChanges) { changesOnly = onlyChanges; }
+
+    /**
+     * Start or pause recording, calls are always delegated regardless.
+     * @param rec true to record, otherwise false
+     */
+    void setRecording(bool rec) { recording = rec; }
+
+    /** @return true if any call was not recorded because its pin is not below IOTRACE_MAX_PINS */
+    bool hasUnrecordedPins() const { return unrecordedPins; }
+
+    void pinDirection(pinid_t pin, uint8_t mode) override;
+    void writeValue(pinid_t pin, uint8_t value) override;
+    uint8_t readValue(pinid_t pin) override;
+    void writePort(pinid_t pin, uint8_t portVal) override;
+    uint8_t readPort(pinid_t pin) override;
+    bool runLoop() override;
+
+    /**
+     * Attaches the interrupt on the delegate through a trampoline that records each interrupt before calling the
+     * real handler. Up to IOTRACE_MAX_INTERRUPTS different pins can be recorded. The interrupt is only counted in
+     * interrupt context, it is added to the trace on the next call to the recorder, such as a read or runLoop.
+     */
+    void attachInterrupt(pinid_t pin, RawIntHandler interruptHandler, uint8_t mode) override;
+private:
+    void record(IoTraceEventType type, pinid_t pin, uint8_t value);
+    void appendRecord(IoTraceEventType type, pinid_t pin, uint8_t value);
+    void drainInterrupts();
+};
+
+/**
+ * Replays a trace that was captured with RecordingIoAbstraction, it acts as the IoAbstraction for switches,
+ * keyboard manager or an encoder, and presents the state that was read at the same point in time during the
+ * recording. Interrupts are raised at the recorded times. Writes, pin modes and syncs made during replay are
+ * not validated but are counted, so that bus usage can be compared between the recording and replay.
+ *
+ * The replay schedules itself on task manager, so taskManager.runLoop() must be called. A speed multiplier
+ * greater than 1 compresses the timeline, for example 4 replays a one minute capture in 15 seconds. Pins at or above
+ * IOTRACE_MAX_PINS always read LOW.
+ */
+class ReplayIoAbstraction : public BasicIoAbstraction, public Executable {
+private:
+    IoTraceBuffer* trace;
+    IoTraceRecord pending;
+    uint32_t pendingTraceTime;
+    uint8_t pinState[IOTRACE_PIN_BYTES];
+    RawIntHandler intHandlers[IOTRACE_MAX_INTERRUPTS];
+    uint8_t intPins[IOTRACE_MAX_INTERRUPTS];
+    unsigned long startMicros;
+    uint32_t maxLatenessMicros;
+    uint32_t recordsReplayed;
+    uint32_t recordedSyncs;
+    uint32_t replaySyncs;
+    uint8_t speed;
+    bool havePending;
+public:
+    explicit ReplayIoAbstraction(IoTraceBuffer* trace);
+
+    /**
+     * Start the replay from the beginning of the trace, it runs on task manager from this point.
+     * @param speedMultiplier 1 for the original speed, higher to accelerate the replay.
+     */
+    void start(uint8_t speedMultiplier = 1);
+
+    /** @return true once every record in the trace has been replayed */
+    bool isFinished() const { return !havePending; }
+
+    /** @return the worst case lateness of a record being applied in replay time, a measure of scheduling latency */
+    uint32_t getMaxLatenessMicros() const { return maxLatenessMicros; }
+
+    /** @return the number of records that have been applied so far */
+    uint32_t getRecordsReplayed() const { return recordsReplayed; }
+
+    /** @return the number of syncs that were made on the device during recording, up to the current point */
+    uint32_t getRecordedSyncCount() const { return recordedSyncs; }
+
+    /** @return the number of syncs that the code under test made on this device during replay */
+    uint32_t getReplaySyncCount() const { return replaySyncs; }
+
+    void pinDirection(pinid_t, uint8_t) override { }
+    void writeValue(pinid_t, uint8_t) override { }
+    void writePort(pinid_t, uint8_t) override { }
+    uint8_t readValue(pinid_t pin) override;
+    uint8_t readPort(pinid_t pin) override;
+    bool runLoop() override;
+    void attachInterrupt(pinid_t pin, RawIntHandler interruptHandler, uint8_t mode) override;
+
+    /** called by task manager to apply the records that are now due */
+    void exec() override;
+private:
+    uint32_t traceTimeNow() const;
+    uint32_t applyDueRecords();
+    void fireInterrupt(uint8_t pin);
+};
+
+#endif // _RECORDING_IO_ABSTRACTION_H_
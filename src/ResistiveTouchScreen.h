@@ -4,6 +4,7 @@
 
 #include "PlatformDetermination.h"
 #include "AnalogDeviceAbstraction.h"
+#include "SwitchInput.h"
 #include <TaskManagerIO.h>
 
 /**
@@ -15,6 +16,21 @@
 #define TOUCH_THRESHOLD 0.05F
 #endif
 
+#define TOUCH_THRESHOLD_FIXED int32_t(TOUCH_THRESHOLD * float(ANALOG_FIXED_MAX))
+
+/** the number of samples taken on each axis, the median of them is used. Must be odd and no more than 15 */
+#ifndef TOUCH_MEDIAN_SAMPLES
+#define TOUCH_MEDIAN_SAMPLES 5
+#endif
+
+/** the time allowed for the panel to settle after the pins are reconfigured for each axis */
+#ifndef TOUCH_SETTLE_MICROS
+#define TOUCH_SETTLE_MICROS 20
+#endif
+
+/** the value of 1.0 for the scaling coefficients of an affine calibration matrix */
+#define TOUCH_AFFINE_ONE 65536L
+
 namespace iotouch {
     enum AccelerationMode: uint8_t {
         WAITING,
@@ -52,12 +68,70 @@ namespace iotouch {
         }
     };
 
+    /**
+     * An affine transform from one set of fixed point touch coordinates to another, it can scale, offset, rotate and
+     * skew. The a, b, d and e coefficients are Q16 where TOUCH_AFFINE_ONE is 1.0, and the offsets c and f are in
+     * analogfixed_t units, so that x' = ((a * x + b * y) >> 16) + c and y' = ((d * x + e * y) >> 16) + f.
+     */
+    struct TouchAffineMatrix {
+        int32_t a, b, c;
+        int32_t d, e, f;
+
+        /** @return the transform that leaves coordinates unchanged */
+        static TouchAffineMatrix identity() {
+            return TouchAffineMatrix{TOUCH_AFFINE_ONE, 0, 0, 0, TOUCH_AFFINE_ONE, 0};
+        }
+
+        /**
+         * Transform a point, the result is clamped to the fixed point range
+         */
+        void apply(analogfixed_t x, analogfixed_t y, analogfixed_t& outX, analogfixed_t& outY) const {
+            outX = clampFixed(((int64_t(a) * x + int64_t(b) * y) >> 16) + c);
+            outY = clampFixed(((int64_t(d) * x + int64_t(e) * y) >> 16) + f);
+        }
+
+        /**
+         * @return a transform that applies first, followed by this one.
+         */
+        TouchAffineMatrix combinedWith(const TouchAffineMatrix& first) const {
+            TouchAffineMatrix r;
+            r.a = int32_t((int64_t(a) * first.a + int64_t(b) * first.d) >> 16);
+            r.b = int32_t((int64_t(a) * first.b + int64_t(b) * first.e) >> 16);
+            r.c = int32_t(((int64_t(a) * first.c + int64_t(b) * first.f) >> 16) + c);
+            r.d = int32_t((int64_t(d) * first.a + int64_t(e) * first.d) >> 16);
+            r.e = int32_t((int64_t(d) * first.b + int64_t(e) * first.e) >> 16);
+            r.f = int32_t(((int64_t(d) * first.c + int64_t(e) * first.f) >> 16) + f);
+            return r;
+        }
+
+        static analogfixed_t clampFixed(int64_t v) {
+            return v <= 0 ? 0 : (v >= int64_t(ANALOG_FIXED_MAX) ? ANALOG_FIXED_MAX : analogfixed_t(v));
+        }
+    };
+
     class CalibrationHandler {
     private:
+        TouchAffineMatrix panelMatrix = TouchAffineMatrix::identity();
+        TouchAffineMatrix effectiveMatrix = TouchAffineMatrix::identity();
+        bool affineOn = false;
         float minX, maxX;
         float minY, maxY;
-        bool calibrationOn;
+        uint32_t scaleX, scaleY;
+        analogfixed_t minXFixed, minYFixed;
+        analogfixed_t rangeX, rangeY;
+        bool calibrationOn = false;
+
+        static analogfixed_t calibrateFixed(analogfixed_t raw, analogfixed_t min, analogfixed_t range, uint32_t scale) {
+            // the delta is clamped to the range, so the product always fits in 32 bits.
+            int32_t delta = int32_t(raw) - int32_t(min);
+            if(delta <= 0) return 0;
+            if(delta >= range) return ANALOG_FIXED_MAX;
+            return analogfixed_t((uint32_t(delta) * scale) >> 16U);
+        }
 
+        static uint32_t scaleForRange(analogfixed_t range) {
+            return range == 0 ? 0 : (uint32_t(ANALOG_FIXED_MAX) << 16U) / range;
+        }
     public:
         CalibrationHandler() = default;
 
@@ -66,7 +140,50 @@ namespace iotouch {
             minY = mnY;
             maxX = mxX;
             maxY = mxY;
+            // work out the fixed point scaling once, so that calibrating a sample needs no division
+            minXFixed = analogFixedFromFloat(mnX);
+            minYFixed = analogFixedFromFloat(mnY);
+            rangeX = analogfixed_t(analogFixedFromFloat(mxX) - minXFixed);
+            rangeY = analogfixed_t(analogFixedFromFloat(mxY) - minYFixed);
+            scaleX = scaleForRange(rangeX);
+            scaleY = scaleForRange(rangeY);
             calibrationOn = true;
+            affineOn = false;
+        }
+
+        /**
+         * Use an affine calibration instead of the minimum and maximum values. The panel matrix transforms raw
+         * readings into calibrated coordinates without any rotation, the rotation transform is then folded into it
+         * so that calibrating a sample is a single matrix apply.
+         * @param panel the calibration in the raw orientation of the panel, as solved by TouchCalibrationRoutine
+         * @param rotation the transform for the current rotation, see touchRotationMatrix
+         */
+        void setAffineCalibration(const TouchAffineMatrix& panel, const TouchAffineMatrix& rotation) {
+            panelMatrix = panel;
+            affineOn = true;
+            calibrationOn = true;
+            setAffineRotation(rotation);
+        }
+
+        /**
+         * Change the rotation that is folded into the affine calibration
+         * @param rotation the transform for the new rotation
+         */
+        void setAffineRotation(const TouchAffineMatrix& rotation) {
+            effectiveMatrix = rotation.combinedWith(panelMatrix);
+        }
+
+        /** @return true if affine calibration is active, the rotation is then already applied by the calibration */
+        bool isAffineEnabled() const { return calibrationOn && affineOn; }
+
+        /** @return the affine calibration in the raw orientation of the panel, for saving */
+        const TouchAffineMatrix& getAffineCalibration() const { return panelMatrix; }
+
+        /**
+         * Calibrate a raw sample using the affine calibration with rotation applied
+         */
+        void calibrateAffine(analogfixed_t rawX, analogfixed_t rawY, analogfixed_t& outX, analogfixed_t& outY) const {
+            effectiveMatrix.apply(rawX, rawY, outX, outY);
         }
 
         void enableCalibration(bool state) {
@@ -82,6 +199,22 @@ namespace iotouch {
             auto y = (calibrationOn) ? ((rawValue - minY) * (1.0F / (maxY - minY))) : rawValue;
             return isInverted ? 1.0F - y : y;
         }
+
+        /**
+         * Integer version of calibrateX that works on a fixed point sample, the result is clamped to 0..1
+         */
+        analogfixed_t calibrateXFixed(analogfixed_t rawValue, bool isInverted) const {
+            auto x = calibrationOn ? calibrateFixed(rawValue, minXFixed, rangeX, scaleX) : rawValue;
+            return isInverted ? analogfixed_t(ANALOG_FIXED_MAX - x) : x;
+        }
+
+        /**
+         * Integer version of calibrateY that works on a fixed point sample, the result is clamped to 0..1
+         */
+        analogfixed_t calibrateYFixed(analogfixed_t rawValue, bool isInverted) const {
+            auto y = calibrationOn ? calibrateFixed(rawValue, minYFixed, rangeY, scaleY) : rawValue;
+            return isInverted ? analogfixed_t(ANALOG_FIXED_MAX - y) : y;
+        }
     };
 
     enum TouchState : uint8_t {
@@ -91,10 +224,14 @@ namespace iotouch {
         TOUCHED,
         /** the touch is being dragged or held */
         HELD,
-        /** a debounce is needed */
+        /**
+         * a debounce is needed, the resistive interrogator no longer returns this as it takes the median of several
+         * samples instead, it is kept for other interrogators and is still handled by the touch screen manager.
+         */
         TOUCH_DEBOUNCE
     };
 
+/** no longer used by the library, kept only for compatibility with code that uses it */
 #define portableFloatAbs(x) ((x)<0.0F?-(x):(x))
 
     class TouchInterrogator {
@@ -108,9 +245,71 @@ namespace iotouch {
         };
 
         virtual TouchState internalProcessTouch(float* ptrX, float* ptrY, TouchRotation rotation, const CalibrationHandler& calib)=0;
+
+        /**
+         * @return the pressure of the last touch between 0 and 1, interrogators that cannot measure it report 1.
+         */
+        virtual float getTouchPressure() { return 1.0F; }
+
+        /**
+         * Put the panel into a state where a touch raises an interrupt, so that polling can stop while untouched.
+         * Interrogators that cannot do this return false and are polled as usual.
+         * @param handler the interrupt handler to attach
+         * @return true if armed and not already touched, otherwise false and polling continues.
+         */
+        virtual bool armTouchWake(RawIntHandler /*handler*/) { return false; }
+    };
+
+    /**
+     * Gets the transform from raw panel coordinates to screen coordinates for a rotation, this gives the same
+     * orientation as the inversion and swapping used with min / max calibration.
+     * @param rotation the rotation required
+     * @return the transform for that rotation
+     */
+    inline TouchAffineMatrix touchRotationMatrix(TouchInterrogator::TouchRotation rotation) {
+        const int32_t one = TOUCH_AFFINE_ONE;
+        const int32_t full = ANALOG_FIXED_MAX;
+        switch(rotation) {
+            case TouchInterrogator::PORTRAIT:
+                return TouchAffineMatrix{-one, 0, full, 0, -one, full};
+            case TouchInterrogator::LANDSCAPE:
+                return TouchAffineMatrix{0, -one, full, one, 0, 0};
+            case TouchInterrogator::LANDSCAPE_INVERTED:
+                return TouchAffineMatrix{0, one, 0, -one, 0, full};
+            default:
+                return TouchAffineMatrix::identity();
+        }
+    }
+
+    class TouchScreenManager;
+
+    /**
+     * The event that wakes up the touch screen manager when the panel raises an interrupt in touch wake mode.
+     */
+    class TouchWakeEvent : public BaseEvent {
+    private:
+        TouchScreenManager* manager;
+    public:
+        explicit TouchWakeEvent(TouchScreenManager* manager) : BaseEvent(), manager(manager) {}
+
+        uint32_t timeOfNextCheck() override {
+            // only ever triggered by the interrupt, so we just check back very infrequently.
+            return 60UL * 1000000UL;
+        }
+
+        void exec() override;
     };
 
-    class TouchInterrogator;
+    /** the wake event of the touch screen that is using touch wake, interrupt handlers have no context */
+    inline TouchWakeEvent*& touchWakeEventInstance() {
+        static TouchWakeEvent* instance = nullptr;
+        return instance;
+    }
+
+    inline void onTouchWakeInterrupt() {
+        auto* ev = touchWakeEventInstance();
+        if(ev != nullptr) ev->markTriggeredAndNotify();
+    }
 
     class TouchScreenManager : public Executable {
     public:
@@ -120,15 +319,57 @@ namespace iotouch {
         TouchInterrogator* touchInterrogator;
         TouchState touchMode;
         bool usedForScrolling = false;
+        bool usingTouchWake = false;
+        volatile bool waitingForTouch = false;
+        taskid_t wakeTaskId = TASKMGR_INVALIDID;
+        taskid_t pollTaskId = TASKMGR_INVALIDID;
         TouchInterrogator::TouchRotation rotation;
+        TouchWakeEvent wakeEvent;
     public:
         explicit TouchScreenManager(TouchInterrogator* interrogator, TouchInterrogator::TouchRotation rot) :
                 accelerationHandler(10, true), calibrator(),
-                touchInterrogator(interrogator), touchMode(NOT_TOUCHED), rotation(rot) {}
+                touchInterrogator(interrogator), touchMode(NOT_TOUCHED), rotation(rot), wakeEvent(this) {}
+
+        /**
+         * Stops polling and removes the wake event from task manager, and if this screen was using touch wake the
+         * interrupt no longer refers to it, so that nothing is left pointing at this object.
+         */
+        ~TouchScreenManager() override {
+            if(touchWakeEventInstance() == &wakeEvent) touchWakeEventInstance() = nullptr;
+            if(wakeTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(wakeTaskId);
+            if(pollTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(pollTaskId);
+        }
 
         void start() {
             touchMode = NOT_TOUCHED;
-            taskManager.execute(this);
+            waitingForTouch = false;
+            if(usingTouchWake && wakeTaskId == TASKMGR_INVALIDID) {
+                touchWakeEventInstance() = &wakeEvent;
+                wakeTaskId = taskManager.registerEvent(&wakeEvent);
+            }
+            pollTaskId = taskManager.execute(this);
+        }
+
+        /**
+         * Turn on touch wake mode before calling start, instead of polling while untouched the interrogator sets up
+         * the panel to raise an interrupt on touch, and polling resumes straight away when it fires. Only one touch
+         * screen can use this mode at once. Interrogators that do not support it are polled as usual.
+         * @param wake true to use touch wake
+         */
+        void setUsingTouchWake(bool wake) {
+            usingTouchWake = wake;
+        }
+
+        /** @return true if polling is stopped waiting for the touch interrupt */
+        bool isWaitingForTouch() const {
+            return waitingForTouch;
+        }
+
+        /** called by the wake event when the panel is touched, starts polling again */
+        void wakeFromTouch() {
+            if(!waitingForTouch) return;
+            waitingForTouch = false;
+            pollTaskId = taskManager.execute(this);
         }
 
         void setUsedForScrolling(bool scrolling) {
@@ -139,11 +380,28 @@ namespace iotouch {
             calibrator.setCalibrationValues(xmin, xmax, ymin, ymax);
         }
 
+        /**
+         * Use an affine calibration that corrects for rotation and skew of the panel as well as scale and offset,
+         * the current rotation is folded into it. Only interrogators that support it, such as the resistive one,
+         * will use it.
+         * @param panelCalibration the calibration in the raw panel orientation, see TouchCalibrationRoutine
+         */
+        void applyAffineCalibration(const TouchAffineMatrix& panelCalibration) {
+            calibrator.setAffineCalibration(panelCalibration, touchRotationMatrix(rotation));
+        }
+
+        /** @return the calibration handler, for example to save the affine calibration */
+        const CalibrationHandler& getCalibrator() const {
+            return calibrator;
+        }
+
         void enableCalibration(bool ena) {
             calibrator.enableCalibration(ena);
         }
 
         void exec() override {
+            // this poll has now run, only a poll scheduled from here on needs cancelling
+            pollTaskId = TASKMGR_INVALIDID;
             float x;
             float y;
             auto touch = touchInterrogator->internalProcessTouch(&x, &y, rotation, calibrator);
@@ -158,32 +416,40 @@ namespace iotouch {
                     touchMode = (oldTouchMode == TOUCHED || oldTouchMode == HELD) ? HELD : TOUCHED;
                     break;
                 case TOUCH_DEBOUNCE:
-                    taskManager.scheduleOnce(5, this, TIME_MILLIS);
+                    pollTaskId = taskManager.scheduleOnce(5, this, TIME_MILLIS);
                     return;
             }
 
             // we are in a repeated not touch situation, we can slow down the polling slightly now. No update needed
             // even at 1/10th of a second, we'll still wake up pretty quick when they select something.
             if (oldTouchMode == NOT_TOUCHED && touchMode == NOT_TOUCHED) {
-                taskManager.scheduleOnce(100, this, TIME_MILLIS);
                 accelerationHandler.reset();
+                // in touch wake mode we stop polling altogether until the panel interrupt fires.
+                if(usingTouchWake && touchInterrogator->armTouchWake(onTouchWakeInterrupt)) {
+                    waitingForTouch = true;
+                    return;
+                }
+                pollTaskId = taskManager.scheduleOnce(100, this, TIME_MILLIS);
                 return;
             }
 
             // only the held state state is subject to acceleration control
             if(touchMode != HELD || usedForScrolling || accelerationHandler.tick()) {
-                if (rotation == TouchInterrogator::LANDSCAPE || rotation == TouchInterrogator::LANDSCAPE_INVERTED) {
-                    sendEvent(y, x, touch, touchMode);
+                float pressure = (touchMode == NOT_TOUCHED) ? 0.0F : touchInterrogator->getTouchPressure();
+                bool landscape = rotation == TouchInterrogator::LANDSCAPE || rotation == TouchInterrogator::LANDSCAPE_INVERTED;
+                if (landscape && !calibrator.isAffineEnabled()) {
+                    sendEvent(y, x, pressure, touchMode);
                 } else {
-                    sendEvent(x, y, touch, touchMode);
+                    sendEvent(x, y, pressure, touchMode);
                 }
             }
-            taskManager.scheduleOnce(20, this, TIME_MILLIS);
+            pollTaskId = taskManager.scheduleOnce(20, this, TIME_MILLIS);
         }
 
         TouchInterrogator::TouchRotation changeRotation(TouchInterrogator::TouchRotation newRotation) {
             auto oldRotation = rotation;
             rotation = newRotation;
+            calibrator.setAffineRotation(touchRotationMatrix(newRotation));
             return oldRotation;
         }
 
@@ -193,17 +459,55 @@ namespace iotouch {
          *
          * @param locationX the location between 0 and 1 in the X domain
          * @param locationY the location between 0 and 1 in the Y domain
+         * @param touchPressure the pressure between 0 and 1, or 0 when not touched
          * @param touched if the panel is current touched
          */
         virtual void sendEvent(float locationX, float locationY, float touchPressure, TouchState touched) = 0;
     };
 
+    inline void TouchWakeEvent::exec() {
+        manager->wakeFromTouch();
+    }
+
+    /**
+     * The state that each of the four touch panel pins is put into during a measurement phase.
+     */
+    enum TouchPinState : uint8_t {
+        /** the state is not known, the pin is always set on the next phase */
+        TOUCH_PIN_UNKNOWN,
+        /** the pin is a high impedance input */
+        TOUCH_PIN_FLOAT,
+        /** the pin is an input that is being read by the ADC */
+        TOUCH_PIN_ADC,
+        /** the pin is an input with the pull up enabled, used to sense a touch */
+        TOUCH_PIN_PULLUP,
+        /** the pin is an output driven low */
+        TOUCH_PIN_LOW,
+        /** the pin is an output driven high */
+        TOUCH_PIN_HIGH
+    };
+
+    /**
+     * The three measurement phases, Z (pressure) is measured first so that X and Y can be skipped when untouched,
+     * and the wake phase where a touch pulls the sense pin low.
+     */
+    enum TouchPhase : uint8_t { TOUCH_PHASE_Z, TOUCH_PHASE_X, TOUCH_PHASE_Y, TOUCH_PHASE_WAKE, TOUCH_PHASE_COUNT };
+
+    /** the index of each pin in the phase table, X+, X-, Y+ and Y- */
+    enum TouchPinIndex : uint8_t { TOUCH_XP, TOUCH_XN, TOUCH_YP, TOUCH_YN, TOUCH_PIN_COUNT };
+
     /**
      * This class handles the basics of a touch screen interface, capturing the values and converting them into a usable
      * form, it is pure abstract and the sendEvent needs implementing with a suitable implemetnation for your needs.
      * It is heavily based on the Adafruit TouchScreen library but modified to work with AnalogDevice so that it can
      * work reliably across a wider range of devices.
      *
+     * The pin states for each of the Z, X and Y phases are held in a table, and moving between phases only changes
+     * the pins that differ from the previous phase, with a single sync for each phase. Every pin is set at the start
+     * of each measurement unless setPinsExclusive has been called. All sampling and calibration
+     * is done in fixed point, each axis is the median of TOUCH_MEDIAN_SAMPLES readings to reject noise, and the
+     * axes are only measured when the pressure measurement shows the panel is touched.
+     *
      * Important notes
      *
      * * all the GPIOs used must be OUTPUT capable, this matters on some boards such as ESP32
@@ -212,67 +516,187 @@ namespace iotouch {
      */
     class ResistiveTouchInterrogator : public TouchInterrogator {
     private:
-        pinid_t xpPin, xnPinAdc, ypPinAdc, ynPin;
-    public:
+        pinid_t pins[TOUCH_PIN_COUNT];
+        TouchPinState pinStates[TOUCH_PIN_COUNT];
+        AnalogDevice* analogDevice;
+        IoAbstractionRef device;
+        analogfixed_t lastX = 0, lastY = 0;
+        analogfixed_t lastRawX = 0, lastRawY = 0;
+        analogfixed_t lastPressure = 0;
+        uint16_t samplesThisPeriod = 0;
+        uint16_t samplesPerSecond = 0;
+        unsigned long periodStartMillis = 0;
+        bool wakeInterruptAttached = false;
+        bool pinsExclusive = false;
+
+        static TouchPinState stateForPhase(TouchPhase phase, TouchPinIndex pin) {
+            // X+, X-, Y+, Y- for each phase, X and Y put a voltage across one plane and read it from the other
+            static const uint8_t phaseTable[TOUCH_PHASE_COUNT][TOUCH_PIN_COUNT] = {
+                    { TOUCH_PIN_LOW, TOUCH_PIN_ADC, TOUCH_PIN_ADC, TOUCH_PIN_HIGH },    // Z
+                    { TOUCH_PIN_HIGH, TOUCH_PIN_LOW, TOUCH_PIN_ADC, TOUCH_PIN_FLOAT },  // X
+                    { TOUCH_PIN_FLOAT, TOUCH_PIN_ADC, TOUCH_PIN_HIGH, TOUCH_PIN_LOW },  // Y
+                    { TOUCH_PIN_LOW, TOUCH_PIN_FLOAT, TOUCH_PIN_PULLUP, TOUCH_PIN_FLOAT } // wake
+            };
+            return (TouchPinState)phaseTable[phase][pin];
+        }
 
-        ResistiveTouchInterrogator(pinid_t xpPin, pinid_t xnPin, pinid_t ypPin, pinid_t ynPin)
-                : xpPin(xpPin), xnPinAdc(xnPin), ypPinAdc(ypPin), ynPin(ynPin) {}
+        void applyPhase(TouchPhase phase) {
+            bool changed = false;
+            // first release any pins that become inputs, so two outputs are never fighting
+            for(uint8_t i = 0; i < TOUCH_PIN_COUNT; i++) {
+                auto wanted = stateForPhase(phase, (TouchPinIndex)i);
+                if(wanted == pinStates[i] || wanted > TOUCH_PIN_PULLUP) continue;
+                if(wanted == TOUCH_PIN_PULLUP) {
+                    ioDevicePinMode(device, pins[i], INPUT_PULLUP);
+                }
+                else if(pinStates[i] == TOUCH_PIN_UNKNOWN || pinStates[i] > TOUCH_PIN_ADC) {
+                    ioDevicePinMode(device, pins[i], INPUT);
+                }
+                if(wanted == TOUCH_PIN_ADC) analogDevice->initPin(pins[i], DIR_IN);
+                pinStates[i] = wanted;
+                changed = true;
+            }
+            // then drive the outputs, a pin that was already an output only needs its level changing
+            for(uint8_t i = 0; i < TOUCH_PIN_COUNT; i++) {
+                auto wanted = stateForPhase(phase, (TouchPinIndex)i);
+                if(wanted == pinStates[i] || wanted <= TOUCH_PIN_PULLUP) continue;
+                if(pinStates[i] <= TOUCH_PIN_PULLUP) ioDevicePinMode(device, pins[i], OUTPUT);
+                ioDeviceDigitalWrite(device, pins[i], wanted == TOUCH_PIN_HIGH ? HIGH : LOW);
+                pinStates[i] = wanted;
+                changed = true;
+            }
+            if(changed) {
+                ioDeviceSync(device);
+                taskManager.yieldForMicros(TOUCH_SETTLE_MICROS);
+            }
+        }
+
+        analogfixed_t medianSample(pinid_t pin) {
+            analogfixed_t samples[TOUCH_MEDIAN_SAMPLES];
+            for(uint8_t i = 0; i < TOUCH_MEDIAN_SAMPLES; i++) {
+                // insertion sort as we go, the list is tiny
+                analogfixed_t val = analogDevice->getCurrentFixed(pin);
+                int8_t j = int8_t(i) - 1;
+                while(j >= 0 && samples[j] > val) {
+                    samples[j + 1] = samples[j];
+                    j--;
+                }
+                samples[j + 1] = val;
+            }
+            return samples[TOUCH_MEDIAN_SAMPLES / 2];
+        }
+
+        void countSample() {
+            samplesThisPeriod++;
+            unsigned long elapsed = millis() - periodStartMillis;
+            if(elapsed >= 1000UL) {
+                samplesPerSecond = uint16_t((samplesThisPeriod * 1000UL) / elapsed);
+                samplesThisPeriod = 0;
+                periodStartMillis = millis();
+            }
+        }
+
+    public:
+        /**
+         * Create the interrogator for the four pins of the panel, the devices default to the internal ones.
+         * @param xpPin the X+ pin
+         * @param xnPin the X- pin, must be ADC capable
+         * @param ypPin the Y+ pin, must be ADC capable
+         * @param ynPin the Y- pin
+         * @param analog optionally the analog device that reads X- and Y+
+         * @param digital optionally the IoAbstraction for all four pins
+         */
+        ResistiveTouchInterrogator(pinid_t xpPin, pinid_t xnPin, pinid_t ypPin, pinid_t ynPin,
+                                   AnalogDevice* analog = nullptr, IoAbstractionRef digital = nullptr)
+                : pins{xpPin, xnPin, ypPin, ynPin}, analogDevice(analog), device(digital) {
+            resetPinStates();
+        }
 
         TouchState internalProcessTouch(float* ptrX, float* ptrY, TouchRotation rotation, const CalibrationHandler& calibrator) override {
-            auto* analogDevice = internalAnalogIo();
-            auto* device = internalDigitalIo();
-            // first we calculate everything in the X dimension.
-            analogDevice->initPin(ypPinAdc, DIR_IN);
-            ioDevicePinMode(device, xnPinAdc, OUTPUT);
-            ioDevicePinMode(device, ynPin, INPUT);
-            ioDevicePinMode(device, xpPin, OUTPUT);
-            ioDeviceDigitalWrite(device, xpPin, HIGH);
-            ioDeviceDigitalWriteS(device, xnPinAdc, LOW);
-
-            taskManager.yieldForMicros(20);
-            float firstSample = analogDevice->getCurrentFloat(ypPinAdc);
-            float secondSample = analogDevice->getCurrentFloat(ypPinAdc);
-
-            if (portableFloatAbs(firstSample - secondSample) > 0.007) {
-                return TOUCH_DEBOUNCE;
+            if(analogDevice == nullptr) analogDevice = internalAnalogIo();
+            if(device == nullptr) device = internalDigitalIo();
+
+            // unless the pins are ours alone, something else may have changed them since the last measurement
+            if(!pinsExclusive) resetPinStates();
+
+            // the pressure measurement comes first, when there is no touch the axes are not measured at all
+            applyPhase(TOUCH_PHASE_Z);
+            int32_t z1 = analogDevice->getCurrentFixed(pins[TOUCH_XN]);
+            int32_t z2 = analogDevice->getCurrentFixed(pins[TOUCH_YP]);
+            int32_t touch = int32_t(ANALOG_FIXED_MAX) - (z2 - z1);
+            lastPressure = analogfixed_t(touch < 0 ? 0 : (touch > int32_t(ANALOG_FIXED_MAX) ? ANALOG_FIXED_MAX : touch));
+
+            if (touch > TOUCH_THRESHOLD_FIXED) {
+                applyPhase(TOUCH_PHASE_X);
+                lastRawX = medianSample(pins[TOUCH_YP]);
+                applyPhase(TOUCH_PHASE_Y);
+                lastRawY = medianSample(pins[TOUCH_XN]);
+                if(calibrator.isAffineEnabled()) {
+                    calibrator.calibrateAffine(lastRawX, lastRawY, lastX, lastY);
+                }
+                else {
+                    lastX = calibrator.calibrateXFixed(lastRawX, (rotation == LANDSCAPE_INVERTED || rotation == PORTRAIT));
+                    lastY = calibrator.calibrateYFixed(lastRawY, (rotation == LANDSCAPE || rotation == PORTRAIT));
+                }
             }
-            float x = calibrator.calibrateX((firstSample + secondSample) / 2.0F, (rotation == LANDSCAPE_INVERTED || rotation == PORTRAIT));
-
-            // now we calculate everything in the Y dimension.
-            analogDevice->initPin(xnPinAdc, DIR_IN);
-            ioDevicePinMode(device, xpPin, INPUT);
-            ioDevicePinMode(device, ypPinAdc, OUTPUT);
-            ioDevicePinMode(device, ynPin, OUTPUT);
-            ioDeviceDigitalWrite(device, ypPinAdc, HIGH);
-            ioDeviceDigitalWriteS(device, ynPin, LOW);
-
-            taskManager.yieldForMicros(20);
-            firstSample = analogDevice->getCurrentFloat(xnPinAdc);
-            secondSample = analogDevice->getCurrentFloat(xnPinAdc);
-
-            if (portableFloatAbs(firstSample - secondSample) > 0.007) {
-                return TOUCH_DEBOUNCE;
+            countSample();
+
+            *ptrX = analogFixedToFloat(lastX);
+            *ptrY = analogFixedToFloat(lastY);
+            return (touch > TOUCH_THRESHOLD_FIXED) ? TOUCHED : NOT_TOUCHED;
+        }
+
+        float getTouchPressure() override {
+            return analogFixedToFloat(lastPressure);
+        }
+
+        /**
+         * Arms touch wake by driving X+ low and pulling up Y+, a touch connects the planes and pulls Y+ low, raising
+         * a falling interrupt. Y+ must therefore be interrupt capable on the IoAbstraction. The pins are put back
+         * by the next measurement. If the panel is already touched once armed, false is returned.
+         */
+        bool armTouchWake(RawIntHandler handler) override {
+            if(analogDevice == nullptr) analogDevice = internalAnalogIo();
+            if(device == nullptr) device = internalDigitalIo();
+            applyPhase(TOUCH_PHASE_WAKE);
+            if(!wakeInterruptAttached) {
+                ioDeviceAttachInterrupt(device, pins[TOUCH_YP], handler, FALLING);
+                wakeInterruptAttached = true;
             }
-            float y = calibrator.calibrateY((firstSample + secondSample) / 2.0F, (rotation == LANDSCAPE || rotation == PORTRAIT));
+            // a touch could have started between the last measurement and arming, then we must keep polling
+            return ioDeviceDigitalReadS(device, pins[TOUCH_YP]) != LOW;
+        }
 
-            // and finally the Z dimension
-            ioDevicePinMode(device, xpPin, OUTPUT);
-            analogDevice->initPin(ypPinAdc, DIR_IN);
-            ioDeviceDigitalWrite(device, xpPin, LOW);
-            ioDeviceDigitalWriteS(device, ynPin, HIGH);
+        /** @return the last pressure reading in fixed point, it is updated even when not touched */
+        analogfixed_t getTouchPressureFixed() const { return lastPressure; }
 
-            taskManager.yieldForMicros(20);
+        /** @return the last X reading before calibration and rotation, as needed for calibrating the panel */
+        analogfixed_t getLastRawX() const { return lastRawX; }
 
-            firstSample = analogDevice->getCurrentFloat(xnPinAdc);
-            secondSample = analogDevice->getCurrentFloat(ypPinAdc);
+        /** @return the last Y reading before calibration and rotation, as needed for calibrating the panel */
+        analogfixed_t getLastRawY() const { return lastRawY; }
 
-            //float touch = ((z2 / z1) * -1.0) * x * resistanceX;
-            float touch = 1.0F - (secondSample - firstSample);
-            *ptrX = x;
-            *ptrY = y;
-            return (touch > TOUCH_THRESHOLD) ? TOUCHED : NOT_TOUCHED;
+        /** @return the number of complete touch measurements made in the last second */
+        uint16_t getSamplesPerSecond() const { return samplesPerSecond; }
+
+        /**
+         * Forget the pin states, so that every pin is set again on the next measurement. Call this if anything else
+         * has changed the pins, for example if they are shared with a display.
+         */
+        void resetPinStates() {
+            for(auto& st : pinStates) st = TOUCH_PIN_UNKNOWN;
         }
 
+        /**
+         * By default every pin is set again at the start of each measurement, in case something else shares the
+         * pins. When nothing else uses them, call this with true to keep the pin states between measurements, so
+         * that polling an untouched panel needs no pin changes at all.
+         * @param exclusive true if only the touch screen uses these pins
+         */
+        void setPinsExclusive(bool exclusive) {
+            pinsExclusive = exclusive;
+            resetPinStates();
+        }
     };
 
     /**
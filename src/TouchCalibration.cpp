@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TouchCalibration.h"
+
+using namespace iotouch;
+
+// the targets are placed in from the edges, where resistive panels are least linear
+#define TOUCH_CAL_NEAR 0.1F
+#define TOUCH_CAL_FAR 0.9F
+
+namespace {
+    // an affine transform in floating point where 1.0 is full scale, only used while solving.
+    struct FloatAffine {
+        float a, b, c, d, e, f;
+    };
+
+    FloatAffine toFloat(const TouchAffineMatrix& m) {
+        return FloatAffine{
+            float(m.a) / float(TOUCH_AFFINE_ONE), float(m.b) / float(TOUCH_AFFINE_ONE), float(m.c) / float(ANALOG_FIXED_MAX),
+            float(m.d) / float(TOUCH_AFFINE_ONE), float(m.e) / float(TOUCH_AFFINE_ONE), float(m.f) / float(ANALOG_FIXED_MAX)
+        };
+    }
+
+    int32_t roundToInt(float v) {
+        return int32_t(v < 0.0F ? v - 0.5F : v + 0.5F);
+    }
+
+    float det3(float m00, float m01, float m02, float m10, float m11, float m12, float m20, float m21, float m22) {
+        return m00 * (m11 * m22 - m12 * m21) - m01 * (m10 * m22 - m12 * m20) + m02 * (m10 * m21 - m11 * m20);
+    }
+}
+
+bool iotouch::solveTouchCalibration(const TouchCalibrationPoint* points, uint8_t count,
+                                    TouchInterrogator::TouchRotation rotation, TouchAffineMatrix& panelMatrix) {
+    if(count < 3) return false;
+
+    // build the normal equations for a least squares fit of both axes, they share the same left hand side.
+    float suu = 0, suv = 0, svv = 0, su = 0, sv = 0;
+    float sux = 0, svx = 0, sx = 0, suy = 0, svy = 0, sy = 0;
+    for(uint8_t i = 0; i < count; i++) {
+        float u = analogFixedToFloat(points[i].rawX);
+        float v = analogFixedToFloat(points[i].rawY);
+        float x = analogFixedToFloat(points[i].screenX);
+        float y = analogFixedToFloat(points[i].screenY);
+        suu += u * u; suv += u * v; svv += v * v; su += u; sv += v;
+        sux += u * x; svx += v * x; sx += x;
+        suy += u * y; svy += v * y; sy += y;
+    }
+    float n = float(count);
+
+    float det = det3(suu, suv, su, suv, svv, sv, su, sv, n);
+    if(det > -1.0E-9F && det < 1.0E-9F) return false;
+
+    FloatAffine m;
+    m.a = det3(sux, suv, su, svx, svv, sv, sx, sv, n) / det;
+    m.b = det3(suu, sux, su, suv, svx, sv, su, sx, n) / det;
+    m.c = det3(suu, suv, sux, suv, svv, svx, su, sv, sx) / det;
+    m.d = det3(suy, suv, su, svy, svv, sv, sy, sv, n) / det;
+    m.e = det3(suu, suy, su, suv, svy, sv, su, sy, n) / det;
+    m.f = det3(suu, suv, suy, suv, svv, svy, su, sv, sy) / det;
+
+    // the solution includes the rotation the targets were drawn in, take it out so that the matrix is in the
+    // panel orientation and any rotation can be folded in later.
+    FloatAffine r = toFloat(touchRotationMatrix(rotation));
+    float rdet = r.a * r.e - r.b * r.d;
+    FloatAffine inv;
+    inv.a = r.e / rdet;
+    inv.b = -r.b / rdet;
+    inv.d = -r.d / rdet;
+    inv.e = r.a / rdet;
+    inv.c = -(inv.a * r.c + inv.b * r.f);
+    inv.f = -(inv.d * r.c + inv.e * r.f);
+
+    panelMatrix.a = roundToInt((inv.a * m.a + inv.b * m.d) * float(TOUCH_AFFINE_ONE));
+    panelMatrix.b = roundToInt((inv.a * m.b + inv.b * m.e) * float(TOUCH_AFFINE_ONE));
+    panelMatrix.c = roundToInt((inv.a * m.c + inv.b * m.f + inv.c) * float(ANALOG_FIXED_MAX));
+    panelMatrix.d = roundToInt((inv.d * m.a + inv.e * m.d) * float(TOUCH_AFFINE_ONE));
+    panelMatrix.e = roundToInt((inv.d * m.b + inv.e * m.e) * float(TOUCH_AFFINE_ONE));
+    panelMatrix.f = roundToInt((inv.d * m.c + inv.e * m.f + inv.f) * float(ANALOG_FIXED_MAX));
+    return true;
+}
+
+TouchCalibrationRoutine::TouchCalibrationRoutine(bool fivePoint) : points() {
+    readingsTaken = 0;
+    const analogfixed_t nearPos = analogFixedFromFloat(TOUCH_CAL_NEAR);
+    const analogfixed_t farPos = analogFixedFromFloat(TOUCH_CAL_FAR);
+    const analogfixed_t midPos = analogFixedFromFloat(0.5F);
+    if(fivePoint) {
+        pointCount = 5;
+        points[0].screenX = nearPos; points[0].screenY = nearPos;
+        points[1].screenX = farPos;  points[1].screenY = nearPos;
+        points[2].screenX = farPos;  points[2].screenY = farPos;
+        points[3].screenX = nearPos; points[3].screenY = farPos;
+        points[4].screenX = midPos;  points[4].screenY = midPos;
+    }
+    else {
+        pointCount = 3;
+        points[0].screenX = nearPos; points[0].screenY = nearPos;
+        points[1].screenX = farPos;  points[1].screenY = midPos;
+        points[2].screenX = midPos;  points[2].screenY = farPos;
+    }
+}
+
+void TouchCalibrationRoutine::setRawReading(uint8_t idx, analogfixed_t rawX, analogfixed_t rawY) {
+    if(idx >= pointCount) return;
+    points[idx].rawX = rawX;
+    points[idx].rawY = rawY;
+    readingsTaken |= (1U << idx);
+}
+
+bool TouchCalibrationRoutine::solve(TouchInterrogator::TouchRotation rotation, TouchAffineMatrix& panelMatrix) const {
+    if(!isComplete()) return false;
+    return solveTouchCalibration(points, pointCount, rotation, panelMatrix);
+}
+
+void iotouch::saveTouchCalibration(EepromAbstraction* rom, EepromPosition position, const TouchAffineMatrix& matrix) {
+    rom->write16(position, TOUCH_CALIBRATION_MAGIC);
+    rom->write32(position + 2, (uint32_t)matrix.a);
+    rom->write32(position + 6, (uint32_t)matrix.b);
+    rom->write32(position + 10, (uint32_t)matrix.c);
+    rom->write32(position + 14, (uint32_t)matrix.d);
+    rom->write32(position + 18, (uint32_t)matrix.e);
+    rom->write32(position + 22, (uint32_t)matrix.f);
+}
+
+bool iotouch::loadTouchCalibration(EepromAbstraction* rom, EepromPosition position, TouchAffineMatrix& matrix) {
+    if(rom->read16(position) != TOUCH_CALIBRATION_MAGIC) return false;
+    matrix.a = (int32_t)rom->read32(position + 2);
+    matrix.b = (int32_t)rom->read32(position + 6);
+    matrix.c = (int32_t)rom->read32(position + 10);
+    matrix.d = (int32_t)rom->read32(position + 14);
+    matrix.e = (int32_t)rom->read32(position + 18);
+    matrix.f = (int32_t)rom->read32(position + 22);
+    return true;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOA_TOUCH_CALIBRATION_H
+#define IOA_TOUCH_CALIBRATION_H
+
+/**
+ * @file TouchCalibration.h
+ *
+ * Contains a 3 or 5 point touch calibration routine that solves an affine calibration matrix, and functions to save
+ * and load the matrix using an EepromAbstraction.
+ */
+
+#include "ResistiveTouchScreen.h"
+#include "EepromAbstraction.h"
+
+/** the default value written before a saved calibration, so that an unprogrammed rom is not used */
+#ifndef TOUCH_CALIBRATION_MAGIC
+#define TOUCH_CALIBRATION_MAGIC 0xCA1BU
+#endif
+
+/** the number of bytes that a saved calibration takes up in the rom */
+#define TOUCH_CALIBRATION_ROM_SIZE 26
+
+namespace iotouch {
+
+    /**
+     * A point used for calibration, where the raw reading was taken when the target at the screen position was
+     * touched. All values are fixed point, screen positions are in the rotation the routine is solved for.
+     */
+    struct TouchCalibrationPoint {
+        analogfixed_t rawX, rawY;
+        analogfixed_t screenX, screenY;
+    };
+
+    /**
+     * Solves the affine transform that best fits the calibration points using least squares, three points give
+     * an exact fit and more points average out the error. This uses float maths, but it only runs once.
+     * @param points the calibration points, at least 3 that are not in a line
+     * @param count the number of points
+     * @param rotation the rotation that the screen positions are in
+     * @param panelMatrix the result, converted back to the raw panel orientation so that any rotation can be used
+     * @return true if solved, false if the points are unsuitable
+     */
+    bool solveTouchCalibration(const TouchCalibrationPoint* points, uint8_t count,
+                               TouchInterrogator::TouchRotation rotation, TouchAffineMatrix& panelMatrix);
+
+    /**
+     * Leads the calibration process, for each target you draw a marker at the target position, wait for a firm
+     * touch and then pass the raw reading from the interrogator (getLastRawX / getLastRawY on the resistive one)
+     * to setRawReading. Once all targets have a reading, call solve and then apply the result to the manager with
+     * applyAffineCalibration, and optionally save it with saveTouchCalibration.
+     */
+    class TouchCalibrationRoutine {
+    private:
+        TouchCalibrationPoint points[5];
+        uint8_t pointCount;
+        uint8_t readingsTaken;
+    public:
+        /**
+         * @param fivePoint true for four corners and the centre, false for three points
+         */
+        explicit TouchCalibrationRoutine(bool fivePoint);
+
+        /** @return the number of targets */
+        uint8_t getPointCount() const { return pointCount; }
+
+        /** @return the screen position of a target, as fixed point */
+        analogfixed_t getTargetX(uint8_t idx) const { return idx < pointCount ? points[idx].screenX : 0; }
+
+        /** @return the screen position of a target, as fixed point */
+        analogfixed_t getTargetY(uint8_t idx) const { return idx < pointCount ? points[idx].screenY : 0; }
+
+        /**
+         * Record the raw reading for a target
+         */
+        void setRawReading(uint8_t idx, analogfixed_t rawX, analogfixed_t rawY);
+
+        /** @return true once every target has a reading */
+        bool isComplete() const { return readingsTaken == ((1U << pointCount) - 1U); }
+
+        /**
+         * Solve the calibration from the readings taken
+         * @param rotation the rotation the targets were drawn in
+         * @param panelMatrix the result in the raw panel orientation
+         * @return true if solved
+         */
+        bool solve(TouchInterrogator::TouchRotation rotation, TouchAffineMatrix& panelMatrix) const;
+    };
+
+    /**
+     * Save a calibration matrix to rom along with a magic value, it takes TOUCH_CALIBRATION_ROM_SIZE bytes.
+     */
+    void saveTouchCalibration(EepromAbstraction* rom, EepromPosition position, const TouchAffineMatrix& matrix);
+
+    /**
+     * Load a calibration matrix from rom, if the magic value is not present the matrix is not changed.
+     * @return true if a calibration was loaded.
+     */
+    bool loadTouchCalibration(EepromAbstraction* rom, EepromPosition position, TouchAffineMatrix& matrix);
+}
+
+#endif //IOA_TOUCH_CALIBRATION_H
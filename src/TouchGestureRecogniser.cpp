@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TouchGestureRecogniser.h"
+
+using namespace iotouch;
+
+static int32_t gestureAbs(int32_t v) { return v < 0 ? -v : v; }
+
+static int16_t toHalfUnits(int32_t delta) {
+    return int16_t(delta / 2);
+}
+
+TouchGestureRecogniser::TouchGestureRecogniser(TouchGestureListener* listener) : samples() {
+    this->listener = listener;
+    this->lastTapMillis = 0;
+    this->lastTapX = this->lastTapY = 0;
+    this->tapPending = false;
+    reset();
+}
+
+void TouchGestureRecogniser::reset() {
+    state = GESTURE_IDLE;
+    sampleHead = 0;
+    sampleCount = 0;
+    downMillis = 0;
+    downX = downY = 0;
+}
+
+void TouchGestureRecogniser::recordSample(analogfixed_t x, analogfixed_t y, uint32_t nowMillis) {
+    auto& s = samples[sampleHead];
+    s.millis = nowMillis;
+    s.x = x;
+    s.y = y;
+    sampleHead = uint8_t((sampleHead + 1) % TOUCH_GESTURE_SAMPLES);
+    if(sampleCount < TOUCH_GESTURE_SAMPLES) sampleCount++;
+}
+
+void TouchGestureRecogniser::fire(TouchGestureType type, analogfixed_t x, analogfixed_t y, int32_t dx, int32_t dy,
+                                  TouchSwipeDirection dir, uint16_t velocity) {
+    if(listener == nullptr) return;
+    TouchGestureEvent ev;
+    ev.type = type;
+    ev.direction = dir;
+    ev.x = x;
+    ev.y = y;
+    ev.deltaX = toHalfUnits(dx);
+    ev.deltaY = toHalfUnits(dy);
+    ev.velocity = velocity;
+    listener->onGesture(ev);
+}
+
+void TouchGestureRecogniser::addSample(analogfixed_t x, analogfixed_t y, bool touched, uint32_t nowMillis) {
+    if(!touched) {
+        if(state != GESTURE_IDLE) released(nowMillis);
+        return;
+    }
+
+    if(state == GESTURE_IDLE) {
+        state = GESTURE_PRESSED;
+        sampleHead = sampleCount = 0;
+        downMillis = nowMillis;
+        downX = x;
+        downY = y;
+        recordSample(x, y, nowMillis);
+        return;
+    }
+
+    // the previous sample is needed for the incremental drag delta
+    const auto& prev = samples[(sampleHead + TOUCH_GESTURE_SAMPLES - 1) % TOUCH_GESTURE_SAMPLES];
+    int32_t stepX = int32_t(x) - int32_t(prev.x);
+    int32_t stepY = int32_t(y) - int32_t(prev.y);
+
+    if(state == GESTURE_PRESSED || state == GESTURE_LONG_PRESSED) {
+        int32_t movedX = int32_t(x) - int32_t(downX);
+        int32_t movedY = int32_t(y) - int32_t(downY);
+        if(gestureAbs(movedX) > TOUCH_GESTURE_MOVE_THRESHOLD_FIXED || gestureAbs(movedY) > TOUCH_GESTURE_MOVE_THRESHOLD_FIXED) {
+            state = GESTURE_DRAGGING;
+            tapPending = false;
+            fire(GESTURE_DRAG_START, downX, downY, movedX, movedY);
+        }
+        else if(state == GESTURE_PRESSED && (nowMillis - downMillis) >= TOUCH_GESTURE_LONG_PRESS_MILLIS) {
+            state = GESTURE_LONG_PRESSED;
+            tapPending = false;
+            fire(GESTURE_LONG_PRESS, x, y, 0, 0);
+        }
+    }
+    else if(state == GESTURE_DRAGGING && (stepX != 0 || stepY != 0)) {
+        fire(GESTURE_DRAG, x, y, stepX, stepY);
+    }
+
+    recordSample(x, y, nowMillis);
+}
+
+void TouchGestureRecogniser::released(uint32_t nowMillis) {
+    const auto& last = samples[(sampleHead + TOUCH_GESTURE_SAMPLES - 1) % TOUCH_GESTURE_SAMPLES];
+
+    if(state == GESTURE_PRESSED) {
+        bool nearLastTap = gestureAbs(int32_t(last.x) - int32_t(lastTapX)) <= TOUCH_GESTURE_MOVE_THRESHOLD_FIXED &&
+                           gestureAbs(int32_t(last.y) - int32_t(lastTapY)) <= TOUCH_GESTURE_MOVE_THRESHOLD_FIXED;
+        if(tapPending && nearLastTap && (nowMillis - lastTapMillis) <= TOUCH_GESTURE_DOUBLE_TAP_MILLIS) {
+            tapPending = false;
+            fire(GESTURE_DOUBLE_TAP, last.x, last.y, 0, 0);
+        }
+        else {
+            tapPending = true;
+            lastTapMillis = nowMillis;
+            lastTapX = last.x;
+            lastTapY = last.y;
+            fire(GESTURE_TAP, last.x, last.y, 0, 0);
+        }
+    }
+    else if(state == GESTURE_DRAGGING) {
+        // find the oldest sample within the swipe window, the velocity is measured from there to the release.
+        uint8_t oldestIdx = uint8_t((sampleHead + TOUCH_GESTURE_SAMPLES - 1) % TOUCH_GESTURE_SAMPLES);
+        for(uint8_t i = 2; i <= sampleCount; i++) {
+            uint8_t idx = uint8_t((sampleHead + TOUCH_GESTURE_SAMPLES - i) % TOUCH_GESTURE_SAMPLES);
+            if((last.millis - samples[idx].millis) > TOUCH_GESTURE_SWIPE_WINDOW_MILLIS) break;
+            oldestIdx = idx;
+        }
+        const auto& oldest = samples[oldestIdx];
+        int32_t dx = int32_t(last.x) - int32_t(oldest.x);
+        int32_t dy = int32_t(last.y) - int32_t(oldest.y);
+        uint32_t dt = last.millis - oldest.millis;
+        if(dt > 0) {
+            bool horizontal = gestureAbs(dx) >= gestureAbs(dy);
+            uint32_t dist = uint32_t(horizontal ? gestureAbs(dx) : gestureAbs(dy));
+            // fixed point units per second, then divide by 1% of the screen to get percent per second
+            uint32_t velocity = ((dist * 1000UL) / dt) / (ANALOG_FIXED_MAX / 100U);
+            if(velocity >= TOUCH_GESTURE_SWIPE_MIN_VELOCITY) {
+                TouchSwipeDirection dir = horizontal ? (dx < 0 ? SWIPE_LEFT : SWIPE_RIGHT) : (dy < 0 ? SWIPE_UP : SWIPE_DOWN);
+                fire(GESTURE_SWIPE, last.x, last.y, dx, dy, dir, uint16_t(velocity > 0xffffU ? 0xffffU : velocity));
+            }
+        }
+        fire(GESTURE_DRAG_END, last.x, last.y, int32_t(last.x) - int32_t(downX), int32_t(last.y) - int32_t(downY));
+    }
+
+    state = GESTURE_IDLE;
+}
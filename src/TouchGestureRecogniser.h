@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOA_TOUCH_GESTURE_RECOGNISER_H
+#define IOA_TOUCH_GESTURE_RECOGNISER_H
+
+/**
+ * @file TouchGestureRecogniser.h
+ *
+ * Contains a gesture layer that sits on top of the touch screen manager, it turns the stream of touch positions into
+ * taps, double taps, long presses, swipes and drags without allocating any memory.
+ */
+
+#include "ResistiveTouchScreen.h"
+
+/** the number of recent samples kept for measuring the velocity of a swipe */
+#ifndef TOUCH_GESTURE_SAMPLES
+#define TOUCH_GESTURE_SAMPLES 8
+#endif
+
+/** movement from the touch down point, as a fraction of the screen, beyond which a press becomes a drag */
+#ifndef TOUCH_GESTURE_MOVE_THRESHOLD
+#define TOUCH_GESTURE_MOVE_THRESHOLD 0.04F
+#endif
+
+/** the time a press must be held without moving to be a long press */
+#ifndef TOUCH_GESTURE_LONG_PRESS_MILLIS
+#define TOUCH_GESTURE_LONG_PRESS_MILLIS 700
+#endif
+
+/** the maximum time between the end of one tap and the end of the next for a double tap */
+#ifndef TOUCH_GESTURE_DOUBLE_TAP_MILLIS
+#define TOUCH_GESTURE_DOUBLE_TAP_MILLIS 350
+#endif
+
+/** the time before release over which the velocity of a swipe is measured */
+#ifndef TOUCH_GESTURE_SWIPE_WINDOW_MILLIS
+#define TOUCH_GESTURE_SWIPE_WINDOW_MILLIS 120
+#endif
+
+/** the minimum velocity at release for a drag to also be a swipe, in percent of the screen per second */
+#ifndef TOUCH_GESTURE_SWIPE_MIN_VELOCITY
+#define TOUCH_GESTURE_SWIPE_MIN_VELOCITY 80
+#endif
+
+#define TOUCH_GESTURE_MOVE_THRESHOLD_FIXED int32_t(TOUCH_GESTURE_MOVE_THRESHOLD * float(ANALOG_FIXED_MAX))
+
+namespace iotouch {
+
+    /**
+     * The type of gesture that has been recognised
+     */
+    enum TouchGestureType : uint8_t {
+        /** a short press and release without moving */
+        GESTURE_TAP,
+        /** a second tap close in time and position to the first, reported instead of a second tap */
+        GESTURE_DOUBLE_TAP,
+        /** held without moving for the long press time, reported while still held */
+        GESTURE_LONG_PRESS,
+        /** the touch has moved far enough from where it started to be a drag */
+        GESTURE_DRAG_START,
+        /** the touch moved while dragging, the delta is the movement since the last drag event */
+        GESTURE_DRAG,
+        /** the drag was released, the delta is the total movement */
+        GESTURE_DRAG_END,
+        /** the drag was released while moving quickly, the direction and velocity are set */
+        GESTURE_SWIPE
+    };
+
+    /**
+     * The direction of a swipe, the Y axis follows screen coordinates so up is towards 0.
+     */
+    enum TouchSwipeDirection : uint8_t {
+        SWIPE_NONE, SWIPE_LEFT, SWIPE_RIGHT, SWIPE_UP, SWIPE_DOWN
+    };
+
+    /**
+     * A compact gesture event, positions are in fixed point where ANALOG_FIXED_MAX is the full width or height.
+     * Deltas are in half fixed point units so that they fit in 16 bits, 32767 is the full width or height.
+     */
+    struct TouchGestureEvent {
+        TouchGestureType type;
+        TouchSwipeDirection direction;
+        analogfixed_t x;
+        analogfixed_t y;
+        int16_t deltaX;
+        int16_t deltaY;
+        /** the velocity of a swipe in percent of the screen per second, otherwise 0 */
+        uint16_t velocity;
+    };
+
+    /**
+     * Implement this to receive gestures from the recogniser.
+     */
+    class TouchGestureListener {
+    public:
+        virtual void onGesture(const TouchGestureEvent& gesture) = 0;
+    };
+
+    /**
+     * Recognises gestures incrementally from touch samples, each sample is processed as it arrives and any gesture
+     * is reported to the listener straight away. The recent samples of a touch are held in a fixed size ring buffer
+     * that is only used to measure the velocity at release, so no memory is allocated and the cost per sample is
+     * a few integer comparisons. Samples can be provided directly by calling addSample, or by using the
+     * GestureTouchScreen below that takes them from a touch interrogator.
+     */
+    class TouchGestureRecogniser {
+    private:
+        enum GestureState : uint8_t { GESTURE_IDLE, GESTURE_PRESSED, GESTURE_LONG_PRESSED, GESTURE_DRAGGING };
+
+        struct TimedSample {
+            uint32_t millis;
+            analogfixed_t x, y;
+        };
+
+        TouchGestureListener* listener;
+        TimedSample samples[TOUCH_GESTURE_SAMPLES];
+        uint8_t sampleHead;
+        uint8_t sampleCount;
+        GestureState state;
+        uint32_t downMillis;
+        analogfixed_t downX, downY;
+        uint32_t lastTapMillis;
+        analogfixed_t lastTapX, lastTapY;
+        bool tapPending;
+    public:
+        explicit TouchGestureRecogniser(TouchGestureListener* listener = nullptr);
+
+        /** set the listener that receives the gestures */
+        void setListener(TouchGestureListener* l) { listener = l; }
+
+        /**
+         * Process the next touch sample, call this for every sample including the first one that is not touched.
+         * @param x the X position in fixed point
+         * @param y the Y position in fixed point
+         * @param touched true if the panel is touched
+         * @param nowMillis the time of the sample
+         */
+        void addSample(analogfixed_t x, analogfixed_t y, bool touched, uint32_t nowMillis);
+
+        /** abandon any gesture in progress without reporting it */
+        void reset();
+
+        /** @return true if a touch is currently being tracked */
+        bool isTracking() const { return state != GESTURE_IDLE; }
+
+    private:
+        void recordSample(analogfixed_t x, analogfixed_t y, uint32_t nowMillis);
+        void released(uint32_t nowMillis);
+        void fire(TouchGestureType type, analogfixed_t x, analogfixed_t y, int32_t dx, int32_t dy,
+                  TouchSwipeDirection dir = SWIPE_NONE, uint16_t velocity = 0);
+    };
+
+    /**
+     * A touch screen manager that sends every sample through a gesture recogniser, it is set up for scrolling so
+     * that no held samples are skipped. Provide a listener to receive the gestures.
+     */
+    class GestureTouchScreen : public TouchScreenManager {
+    private:
+        TouchGestureRecogniser recogniser;
+    public:
+        GestureTouchScreen(TouchInterrogator& interrogator, TouchInterrogator::TouchRotation rotation,
+                           TouchGestureListener* listener)
+                : TouchScreenManager(&interrogator, rotation), recogniser(listener) {
+            setUsedForScrolling(true);
+        }
+
+        void sendEvent(float locationX, float locationY, float /*touchPressure*/, TouchState touched) override {
+            recogniser.addSample(analogFixedFromFloat(locationX), analogFixedFromFloat(locationY),
+                                 touched != NOT_TOUCHED, millis());
+        }
+
+        TouchGestureRecogniser& getRecogniser() { return recogniser; }
+    };
+}
+
+#endif //IOA_TOUCH_GESTURE_RECOGNISER_H
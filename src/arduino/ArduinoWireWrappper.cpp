@@ -36,7 +36,12 @@ bool ioaWireRead(WireType pI2c, int addr, uint8_t* buffer, size_t len) {
     return false;
 }
 
-bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, size_t len, int retriesAllowed, bool sendStop) {
+bool ioaWireReady(WireType pI2c, int address) {
+    pI2c->beginTransmission(address);
+    return pI2c->endTransmission() == 0;
+}
+
+static bool waitForWireReady(WireType pI2c, int address, int retriesAllowed) {
     bool firstTime = true;
     bool i2cReady = retriesAllowed == 0;
     while(retriesAllowed && !i2cReady) {
@@ -51,8 +56,12 @@ bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, si
 
     if(!i2cReady) {
         serdebugF("I2C was not ready after retries, failing");
-        return false;
     }
+    return i2cReady;
+}
+
+bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, size_t len, int retriesAllowed, bool sendStop) {
+    if(!waitForWireReady(pI2c, address, retriesAllowed)) return false;
 
     pI2c->beginTransmission(address);
     pI2c->write(buffer, len);
@@ -61,4 +70,14 @@ bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, si
     return writeOk;
 }
 
+bool ioaWireWritePrefixed(WireType pI2c, int address, const uint8_t* prefix, size_t prefixLen,
+                          const uint8_t* buffer, size_t len, int retriesAllowed) {
+    if(!waitForWireReady(pI2c, address, retriesAllowed)) return false;
+
+    pI2c->beginTransmission(address);
+    pI2c->write(prefix, prefixLen);
+    pI2c->write(buffer, len);
+    return pI2c->endTransmission() == 0;
+}
+
 #endif
@@ -66,6 +66,8 @@ public:
 
     /** send data over the twi bus */
     bool sendData(uint8_t addr, const uint8_t* data, uint8_t len, bool stop);
+    /** send a prefix followed by data over the twi bus as one transaction */
+    bool sendData(uint8_t addr, const uint8_t* prefix, uint8_t prefixLen, const uint8_t* data, uint8_t len);
     /** receive data from the twi bus */
     bool receiveData(uint8_t addr, uint8_t* data, uint8_t len);
 
@@ -305,6 +307,15 @@ bool AvrTwiManager::sendData(uint8_t addr, const uint8_t *data, uint8_t len, boo
     return waitForCompletion(I2C_OPERATION_SUCCESS);
 }
 
+bool AvrTwiManager::sendData(uint8_t addr, const uint8_t *prefix, uint8_t prefixLen, const uint8_t *data, uint8_t len) {
+    if(!prefix || (!data && len) || (prefixLen + len) > TWI_BUFFER_LENGTH) return false;
+    waitForCompletion(READY_FOR_USE);
+    memcpy(buffer, prefix, prefixLen);
+    if(len) memcpy(buffer + prefixLen, data, len);
+    startTwi(addr, I2C_SEND_ADDRESS, TWI_MODE_WRITE, prefixLen + len);
+    return waitForCompletion(I2C_OPERATION_SUCCESS);
+}
+
 bool AvrTwiManager::startTwi(uint8_t addr, AvrTwiManager::TwiStatus status, AvrTwiManager::TwiMode mode, uint8_t len) {
     twiStatus = status;
     twiMode = mode;
@@ -330,6 +341,8 @@ void ioaWireSetSpeed(WireType wireType, long frequency) {
 }
 
 bool ioaWireRead(WireType pI2c, int addr, uint8_t* buffer, size_t len) {
+    // check before narrowing to the 8 bit length of the TWI manager
+    if(len > TWI_BUFFER_LENGTH) return false;
     return IoaTwi.receiveData(addr, buffer, len);
 }
 
@@ -345,4 +358,20 @@ bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, si
     return IoaTwi.sendData(address, buffer, len, sendStop);
 }
 
+bool ioaWireWritePrefixed(WireType pI2c, int address, const uint8_t* prefix, size_t prefixLen,
+                          const uint8_t* buffer, size_t len, int retriesAllowed) {
+    // check before narrowing to the 8 bit lengths of the TWI manager, otherwise 300 bytes would be sent as 44
+    if(prefixLen + len > TWI_BUFFER_LENGTH) return false;
+
+    bool ready = retriesAllowed == 0;
+    while(retriesAllowed != 0 && !ready) {
+        ready = IoaTwi.isReady(address);
+        if(!ready) taskManager.yieldForMicros(50);
+        retriesAllowed--;
+    }
+    if(!ready) return false;
+
+    return IoaTwi.sendData(address, prefix, prefixLen, buffer, len);
+}
+
 #endif
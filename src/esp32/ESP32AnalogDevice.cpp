@@ -10,8 +10,43 @@
 #include <SimpleCollections.h>
 #include <driver/dac.h>
 #include <AnalogDeviceAbstraction.h>
+#ifndef IOA_ESP32_NO_ADC_CALIBRATION
+#include <esp_adc_cal.h>
+#endif
+
+// the default reference voltage used when the eFuse does not contain one
+#define IOA_ADC_DEFAULT_VREF 1100
+#define IOA_ADC_ATTEN_COUNT 4
+
+#ifndef IOA_ESP32_NO_ADC_CALIBRATION
+static uint16_t* calibrationTables[2][IOA_ADC_ATTEN_COUNT] = { { nullptr } };
+#endif
+
+const uint16_t* espAdcCalibrationTable(bool adc1, uint8_t attenuation) {
+#ifdef IOA_ESP32_NO_ADC_CALIBRATION
+    return nullptr;
+#else
+    if(attenuation >= IOA_ADC_ATTEN_COUNT) return nullptr;
+    auto& table = calibrationTables[adc1 ? 0 : 1][attenuation];
+    if(table != nullptr) return table;
+
+    // characterise once, and then evaluate the curve at each segment boundary so that reads only need a lookup.
+    esp_adc_cal_characteristics_t characteristics;
+    esp_adc_cal_characterize(adc1 ? ADC_UNIT_1 : ADC_UNIT_2, static_cast<adc_atten_t>(attenuation),
+                             IOA_ESP_BIT_SELECTION, IOA_ADC_DEFAULT_VREF, &characteristics);
+    table = new uint16_t[IOA_ADC_CAL_SEGMENTS + 1];
+    const uint32_t step = IOA_ADC_MAX / IOA_ADC_CAL_SEGMENTS;
+    for(uint32_t i = 0; i <= IOA_ADC_CAL_SEGMENTS; i++) {
+        uint32_t raw = min(i * step, uint32_t(IOA_ADC_MAX - 1));
+        table[i] = esp_adc_cal_raw_to_voltage(raw, &characteristics);
+    }
+    serdebugF3("ADC cal table built ", adc1, attenuation);
+    return table;
+#endif
+}
 
-EspAnalogInputMode::EspAnalogInputMode(pinid_t pin) : onAdc1(false), adcChannelNum(0xff), pin(pin), attenuation(ADC_ATTEN_DB_11) {}
+EspAnalogInputMode::EspAnalogInputMode(pinid_t pin) : onAdc1(false), adcChannelNum(0xff), pin(pin), attenuation(ADC_ATTEN_DB_11),
+                                                      appliedAttenuation(0xff), calibrationTable(nullptr) {}
 
 EspAnalogInputMode::EspAnalogInputMode(const EspAnalogInputMode& other) = default;
 
@@ -42,6 +77,16 @@ void EspAnalogInputMode::pinSetup() {
     // ensure that it's initialised as input with no pull up/down.
     if(adcChannelNum != 0xff) {
         alterPinAttenuation(ADC_ATTEN_DB_11);
+
+        // if the ADC is on a dac channel it must be turned off, this only needs doing once during setup.
+        if(pin == DAC1 || pin == DAC2) {
+            dac_output_disable(pin == DAC1 ? DAC_CHANNEL_1 : DAC_CHANNEL_2);
+        }
+
+        // force the channel configuration and calibration table to be set up now rather than on first read
+        appliedAttenuation = 0xff;
+        applyConfiguration();
+
         gpio_config_t config;
         config.intr_type = GPIO_INTR_DISABLE;
         config.mode = GPIO_MODE_INPUT;
@@ -55,19 +100,28 @@ void EspAnalogInputMode::pinSetup() {
     }
 }
 
-uint16_t EspAnalogInputMode::getCurrentReading() {
-    // if the ADC is on the dac channel it must be turned off first.
-    if(pin == DAC1 || pin == DAC2) {
-        dac_output_disable(pin == DAC1 ? DAC_CHANNEL_1 : DAC_CHANNEL_2);
-    }
+void EspAnalogInputMode::applyConfiguration() {
+    // the channel only needs reconfiguring when the attenuation has changed since it was last applied.
+    if(attenuation == appliedAttenuation || adcChannelNum == 0xff) return;
 
     if(onAdc1) {
         adc1_config_channel_atten(static_cast<adc1_channel_t>(adcChannelNum), static_cast<adc_atten_t>(attenuation));
+    }
+    else {
+        adc2_config_channel_atten(static_cast<adc2_channel_t>(adcChannelNum), static_cast<adc_atten_t>(attenuation));
+    }
+    appliedAttenuation = attenuation;
+    calibrationTable = espAdcCalibrationTable(onAdc1, attenuation);
+}
+
+uint16_t EspAnalogInputMode::getCurrentReading() {
+    applyConfiguration();
+
+    if(onAdc1) {
         return adc1_get_raw(static_cast<adc1_channel_t>(adcChannelNum));
     }
     else {
         int adcVal;
-        adc2_config_channel_atten(static_cast<adc2_channel_t>(adcChannelNum), static_cast<adc_atten_t>(attenuation));
         if(adc2_get_raw(static_cast<adc2_channel_t>(adcChannelNum), IOA_ESP_BIT_SELECTION, &adcVal) == ESP_OK) {
             lastCached = adcVal;
             return adcVal;
@@ -76,6 +130,29 @@ uint16_t EspAnalogInputMode::getCurrentReading() {
     }
 }
 
+uint16_t EspAnalogInputMode::rawToMillivolts(const uint16_t* table, uint16_t raw) {
+    const uint8_t segmentBits = IOA_ADC_BITS - IOA_ADC_CAL_SEGMENTS_BITS;
+    uint16_t idx = raw >> segmentBits;
+    if(idx >= IOA_ADC_CAL_SEGMENTS) return table[IOA_ADC_CAL_SEGMENTS];
+    uint32_t fraction = raw & ((1U << segmentBits) - 1);
+    int32_t span = int32_t(table[idx + 1]) - int32_t(table[idx]);
+    return uint16_t(int32_t(table[idx]) + ((span * int32_t(fraction)) >> segmentBits));
+}
+
+uint16_t EspAnalogInputMode::getCurrentMillivolts() {
+    uint16_t raw = getCurrentReading();
+    return (calibrationTable != nullptr) ? rawToMillivolts(calibrationTable, raw) : 0;
+}
+
+analogfixed_t EspAnalogInputMode::getCurrentLinearisedFixed() {
+    uint16_t raw = getCurrentReading();
+    if(calibrationTable == nullptr) return analogScaleToFixed(raw, IOA_ADC_BITS);
+    uint32_t fullScale = calibrationTable[IOA_ADC_CAL_SEGMENTS];
+    if(fullScale == 0) return 0;
+    uint32_t mv = rawToMillivolts(calibrationTable, raw);
+    return analogfixed_t(min(mv * ANALOG_FIXED_MAX / fullScale, uint32_t(ANALOG_FIXED_MAX)));
+}
+
 EspAnalogOutputMode::EspAnalogOutputMode(pinid_t pin) : pin(pin), pwmChannel(0xff), pwmWidth(5000) {}
 
 EspAnalogOutputMode::EspAnalogOutputMode(const EspAnalogOutputMode& other)  {
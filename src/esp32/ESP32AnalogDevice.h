@@ -25,6 +25,23 @@
 #define ESP32_DAC1 25
 #define ESP32_DAC2 26
 
+/**
+ * The number of segments in each ADC calibration table, the table has one more entry than this. Each entry is the
+ * calibrated millivolts at that raw reading, and readings in between are linearly interpolated. Define
+ * IOA_ESP32_NO_ADC_CALIBRATION to turn off calibration, in which case readings are scaled linearly from raw.
+ */
+#define IOA_ADC_CAL_SEGMENTS_BITS 6
+#define IOA_ADC_CAL_SEGMENTS (1 << IOA_ADC_CAL_SEGMENTS_BITS)
+
+/**
+ * Gets the calibration table for an ADC unit at a given attenuation, it is built on first use using the
+ * esp_adc_cal characterisation and then shared by every pin with the same unit and attenuation.
+ * @param adc1 true for ADC1, false for ADC2
+ * @param attenuation the attenuation (adc_atten_t)
+ * @return the table of IOA_ADC_CAL_SEGMENTS + 1 millivolt values, or nullptr if calibration is not available
+ */
+const uint16_t* espAdcCalibrationTable(bool adc1, uint8_t attenuation);
+
 class EspAnalogOutputMode {
 private:
     pinid_t pin;
@@ -48,19 +65,50 @@ private:
     uint8_t adcChannelNum;
     pinid_t pin;
     uint8_t attenuation;
+    uint8_t appliedAttenuation;
     uint16_t lastCached = 0;
+    const uint16_t* calibrationTable;
 public:
     pinid_t getKey() const { return pin; }
     explicit EspAnalogInputMode(pinid_t pin);
     EspAnalogInputMode(const EspAnalogInputMode& other);
 
     void pinSetup();
+
+    /**
+     * Change the attenuation of the pin, the channel is only reconfigured on the next read, and only if
+     * the attenuation has actually changed.
+     * @param atten the new attenuation (adc_atten_t)
+     */
     void alterPinAttenuation(uint8_t atten) { attenuation = atten; }
 
     bool isOnDAC1() const { return onAdc1;}
     uint8_t getChannel() const { return adcChannelNum;}
 
     uint16_t getCurrentReading();
+
+    /**
+     * Takes a reading and converts it to calibrated millivolts using the calibration table for the
+     * current attenuation.
+     * @return the reading in millivolts, or 0 if calibration is not available.
+     */
+    uint16_t getCurrentMillivolts();
+
+    /**
+     * @return the reading linearised by the calibration table, as a fraction of the largest calibrated
+     * voltage for the attenuation in use. Without calibration the raw reading is scaled linearly.
+     */
+    float getCurrentLinearised() { return analogFixedToFloat(getCurrentLinearisedFixed()); }
+
+    /**
+     * @return the reading linearised by the calibration table as a fixed point fraction, the same as
+     * getCurrentLinearised but without floating point. Without calibration the raw reading is scaled.
+     */
+    analogfixed_t getCurrentLinearisedFixed();
+
+private:
+    void applyConfiguration();
+    static uint16_t rawToMillivolts(const uint16_t* table, uint16_t raw);
 };
 
 class ESP32AnalogDevice : public AnalogDevice {
@@ -85,11 +133,36 @@ public:
 	    return input != nullptr ? input->getCurrentReading() : 0;
 	}
 
+	/**
+	 * Gets the current value as a float, linearised using the calibration table for the pin's attenuation
+	 * @param pin the pin to read
+	 * @return a value between 0 and 1
+	 */
 	float getCurrentFloat(pinid_t pin) override {
-        auto maxValue = (float)getMaximumRange(DIR_IN, pin);
-        return float(getCurrentValue(pin)) / maxValue;
+	    auto input = gpioToInputKey.getByKey(pin);
+	    return input != nullptr ? input->getCurrentLinearised() : 0.0F;
 	}
 
+	/**
+	 * Gets the current value as fixed point, linearised in the same way as getCurrentFloat
+	 * @param pin the pin to read
+	 * @return a value between 0 and ANALOG_FIXED_MAX
+	 */
+	analogfixed_t getCurrentFixed(pinid_t pin) override {
+	    auto input = gpioToInputKey.getByKey(pin);
+	    return input != nullptr ? input->getCurrentLinearisedFixed() : 0;
+	}
+
+    /**
+     * Gets the current calibrated reading for a pin in millivolts.
+     * @param pin the pin to read
+     * @return the reading in millivolts, or 0 if not available
+     */
+    uint16_t getCurrentMillivolts(pinid_t pin) {
+        auto input = gpioToInputKey.getByKey(pin);
+        return input != nullptr ? input->getCurrentMillivolts() : 0;
+    }
+
 	void setCurrentFloat(pinid_t pin, float value) override;
 
     void initPin(pinid_t pin, AnalogDirection direction) override;
@@ -3,17 +3,45 @@
  * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
  */
 
-#ifdef IOA_ENABLE_STM32_HAL_EXTRAS
+#if defined(IOA_ENABLE_STM32_HAL_EXTRAS) || defined(IOA_STM32_BACKUP_RAM_SIMULATION)
 
 #include <IoLogging.h>
 #include "HalStm32EepromAbstraction.h"
 
+#ifdef IOA_STM32_BACKUP_RAM_SIMULATION
+uint32_t ioaSimulatedBackupRam[IOA_SIMULATED_BACKUP_RAM_SIZE / 4];
+uint32_t ioaSimulatedBackupClockEnables = 0;
+#define IOA_BACKUP_RAM_BASE ((uintptr_t)ioaSimulatedBackupRam)
+#define IOA_BACKUP_CLOCK_ENABLE() ioaSimulatedBackupClockEnables++
+#define IOA_BACKUP_CLOCK_DISABLE()
+#else
+#define IOA_BACKUP_RAM_BASE BKPSRAM_BASE
+#define IOA_BACKUP_CLOCK_ENABLE() __HAL_RCC_BKPSRAM_CLK_ENABLE()
+#define IOA_BACKUP_CLOCK_DISABLE() __HAL_RCC_BKPSRAM_CLK_DISABLE()
+#endif
+
+HalStm32EepromAbstraction::HalStm32EepromAbstraction() : eepromBuffer(), dirtyWords() {
+    romBase = 0;
+    errorOccurred = false;
+    autoCommitMillis = 0;
+    commitTask = TASKMGR_INVALIDID;
+}
+
+HalStm32EepromAbstraction::~HalStm32EepromAbstraction() {
+    if(commitTask != TASKMGR_INVALIDID) taskManager.cancelTask(commitTask);
+    halWriteToCache();
+}
+
 void HalStm32EepromAbstraction::enableBackupRam()
 {
+#ifdef IOA_STM32_BACKUP_RAM_SIMULATION
+    errorOccurred = false;
+#else
     HAL_PWR_EnableBkUpAccess();  // access to backup domain..
     __HAL_RCC_PWR_CLK_ENABLE();  // enable the clock
 
     errorOccurred = HAL_PWREx_EnableBkUpReg() != HAL_OK;   // enable the backup regulator
+#endif
 
     serdebugF2("STM32 Backup RAM enabled status: ", errorOccurred);
 }
@@ -27,31 +55,70 @@ void HalStm32EepromAbstraction::initialise(int baseOffs) {
 }
 
 void HalStm32EepromAbstraction::halWriteToCache() {
-    __HAL_RCC_BKPSRAM_CLK_ENABLE(); // turn on back up ram clock
+    if(getDirtyWordCount() == 0) return;
 
+    IOA_BACKUP_CLOCK_ENABLE(); // turn on back up ram clock
+
+    // only the words that changed since the last commit are written back
     auto* dataCache = reinterpret_cast<uint32_t*>(eepromBuffer);
+    uint16_t written = 0;
     for(uint32_t i=0; i<EEPROM_WORD_SIZE; i++) {
-        *(uint32_t*)(BKPSRAM_BASE + romBase + (i<<2)) = dataCache[i];
+        if(dirtyWords[i >> 5U] & (1UL << (i & 31U))) {
+            *(uint32_t*)(IOA_BACKUP_RAM_BASE + romBase + (i<<2)) = dataCache[i];
+            written++;
+        }
     }
 
-    __HAL_RCC_BKPSRAM_CLK_DISABLE(); // turn off backup ram clock
+    IOA_BACKUP_CLOCK_DISABLE(); // turn off backup ram clock
 
-    serdebugF("Completed write to cache of present data: ");
+    memset(dirtyWords, 0, sizeof dirtyWords);
+    serdebugF2("Completed write to cache of changed words: ", written);
 }
 
 void HalStm32EepromAbstraction::halReadFromCache() {
-    __HAL_RCC_BKPSRAM_CLK_ENABLE(); // enable back up ram clock
+    IOA_BACKUP_CLOCK_ENABLE(); // enable back up ram clock
 
     auto* dataCache = reinterpret_cast<uint32_t*>(eepromBuffer);
     for(uint32_t i=0; i<EEPROM_WORD_SIZE; i++) {
-        dataCache[i] = *(uint32_t*)(BKPSRAM_BASE + romBase + (i<<2));
+        dataCache[i] = *(uint32_t*)(IOA_BACKUP_RAM_BASE + romBase + (i<<2));
     }
 
-    __HAL_RCC_BKPSRAM_CLK_DISABLE();
+    IOA_BACKUP_CLOCK_DISABLE();
 
+    memset(dirtyWords, 0, sizeof dirtyWords);
     serdebugF("Completed read into cache of backup data: ");
 }
 
+uint16_t HalStm32EepromAbstraction::getDirtyWordCount() const {
+    uint16_t count = 0;
+    for(auto word : dirtyWords) {
+        for(; word; word &= word - 1) count++;
+    }
+    return count;
+}
+
+void HalStm32EepromAbstraction::exec() {
+    commitTask = TASKMGR_INVALIDID;
+    halWriteToCache();
+}
+
+void HalStm32EepromAbstraction::storeBytes(EepromPosition position, const uint8_t* data, uint8_t len) {
+    if((uint32_t(position) + len) > EEPROM_SIZE) {
+        errorOccurred = true;
+        return;
+    }
+    if(len == 0 || memcmp(eepromBuffer + position, data, len) == 0) return;
+
+    memcpy(eepromBuffer + position, data, len);
+    for(uint32_t word = position >> 2U; word <= (uint32_t(position) + len - 1) >> 2U; word++) {
+        dirtyWords[word >> 5U] |= (1UL << (word & 31U));
+    }
+
+    if(autoCommitMillis != 0 && commitTask == TASKMGR_INVALIDID) {
+        commitTask = taskManager.scheduleOnce(autoCommitMillis, this);
+    }
+}
+
 uint8_t HalStm32EepromAbstraction::read8(EepromPosition position) {
     if(position >= EEPROM_SIZE) {
         errorOccurred = true;
@@ -61,16 +128,11 @@ uint8_t HalStm32EepromAbstraction::read8(EepromPosition position) {
 }
 
 void HalStm32EepromAbstraction::write8(EepromPosition position, uint8_t val) {
-    if(position >= EEPROM_SIZE) {
-        errorOccurred = true;
-    }
-    else {
-        eepromBuffer[position] = val;
-    }
+    storeBytes(position, &val, 1);
 }
 
 uint16_t HalStm32EepromAbstraction::read16(EepromPosition position) {
-    if(position + 2 >= EEPROM_SIZE) {
+    if(position + 2 > EEPROM_SIZE) {
         errorOccurred = true;
         return 0;
     }
@@ -78,32 +140,22 @@ uint16_t HalStm32EepromAbstraction::read16(EepromPosition position) {
 }
 
 void HalStm32EepromAbstraction::write16(EepromPosition position, uint16_t val) {
-    if (position + 2 >= EEPROM_SIZE) {
-        errorOccurred = true;
-    } else {
-        eepromBuffer[position] = uint8_t(val & 0xffU);
-        eepromBuffer[position + 1] = uint8_t(val >> 8U);
-    }
+    uint8_t data[2] = { uint8_t(val & 0xffU), uint8_t(val >> 8U) };
+    storeBytes(position, data, sizeof data);
 }
 
 uint32_t HalStm32EepromAbstraction::read32(EepromPosition position) {
-    if(position + 4 >= EEPROM_SIZE) {
+    if(position + 4 > EEPROM_SIZE) {
         errorOccurred = true;
         return 0;
     }
-    return eepromBuffer[position] | (eepromBuffer[position + 1] << 8) | (eepromBuffer[position + 2] << 16) | (eepromBuffer[position + 3] << 24);
+    return (uint32_t)eepromBuffer[position] | ((uint32_t)eepromBuffer[position + 1] << 8) |
+           ((uint32_t)eepromBuffer[position + 2] << 16) | ((uint32_t)eepromBuffer[position + 3] << 24);
 }
 
 void HalStm32EepromAbstraction::write32(EepromPosition position, uint32_t val) {
-    if(position + 2 >= EEPROM_SIZE) {
-        errorOccurred = true;
-    }
-    else {
-        eepromBuffer[position] = uint8_t(val & 0xff);
-        eepromBuffer[position + 1] = uint8_t((val >> 8U) & 0xffU);
-        eepromBuffer[position + 2] = uint8_t((val >> 16U) & 0xffU);
-        eepromBuffer[position + 3] = uint8_t((val >> 24U));
-    }
+    uint8_t data[4] = { uint8_t(val & 0xffU), uint8_t((val >> 8U) & 0xffU), uint8_t((val >> 16U) & 0xffU), uint8_t(val >> 24U) };
+    storeBytes(position, data, sizeof data);
 }
 
 void HalStm32EepromAbstraction::readIntoMemArray(uint8_t *memDest, EepromPosition romSrc, uint8_t len) {
@@ -117,12 +169,7 @@ void HalStm32EepromAbstraction::readIntoMemArray(uint8_t *memDest, EepromPositio
 }
 
 void HalStm32EepromAbstraction::writeArrayToRom(EepromPosition romDest, const uint8_t *memSrc, uint8_t len) {
-    if((romDest + len) > EEPROM_SIZE) {
-        errorOccurred = true;
-    }
-    else {
-        memcpy(eepromBuffer + romDest, memSrc, len);
-    }
+    storeBytes(romDest, memSrc, len);
 }
 
 bool HalStm32EepromAbstraction::hasErrorOccurred() {
@@ -9,14 +9,16 @@
  * make a local version that instead just read on demand. By default it caches the first 512 bytes which is usually
  * more than enough for most menu cases. If not define EEPROM_WORD_SIZE as the number of 32-bit words you need.
  *
- * Part of IoAbstraction extras for mbed on STM32, requires definition of IOA_ENABLE_STM32_HAL_EXTRAS to be included
+ * Part of IoAbstraction extras for mbed on STM32, requires definition of IOA_ENABLE_STM32_HAL_EXTRAS to be included.
+ * Defining IOA_STM32_BACKUP_RAM_SIMULATION instead builds it against an array in RAM, so it can be tested off target.
  *
  * @file HalStm32EepromAbstraction.h
  */
-#if !defined(IOA_HALSTM32EEPROMABSTRACTION_H) && defined(IOA_ENABLE_STM32_HAL_EXTRAS)
+#if !defined(IOA_HALSTM32EEPROMABSTRACTION_H) && (defined(IOA_ENABLE_STM32_HAL_EXTRAS) || defined(IOA_STM32_BACKUP_RAM_SIMULATION))
 #define IOA_HALSTM32EEPROMABSTRACTION_H
 
 #include "EepromAbstraction.h"
+#include "TaskManagerIO.h"
 
 //
 // By default we cache the first 512 bytes of ROM into memory, we cache it to avoid having to leave the clock on
@@ -26,23 +28,44 @@
 #define EEPROM_WORD_SIZE 128
 #endif
 
+#ifdef IOA_STM32_BACKUP_RAM_SIMULATION
+/** the size of the simulated backup RAM, the same as the 4KB on STM32F4 */
+#define IOA_SIMULATED_BACKUP_RAM_SIZE 4096
+/** stands in for the backup RAM when simulating, aligned as the real memory is */
+extern uint32_t ioaSimulatedBackupRam[IOA_SIMULATED_BACKUP_RAM_SIZE / 4];
+/** counts each time the simulated backup RAM clock is enabled */
+extern uint32_t ioaSimulatedBackupClockEnables;
+#endif
+
 /**
  * An implementation of the EepromAbstraction that works with the STM32 HAL functions to read and write values to
  * the internal battery backed memory. This has been tested with STM32F4 boards and is known to work with mbed 6.
  *
  * This implementation caches the data from the battery backed memory into regular RAM, to avoid having to manage
- * the RAMs clock frequently. After making adjustments on the object you call commit to push it into ROM.
+ * the RAMs clock frequently. After making adjustments on the object you call commit to push it into ROM. Each 32 bit
+ * word that is changed is marked dirty, and commit only writes back the dirty words, in one period of the clock being
+ * enabled. Writes that do not change the value do not mark anything. Optionally, setAutoCommit starts a timer on the
+ * first change, so that all the changes made before it fires are committed together.
  *
  * Regular usage is to globally create an instance of the class and then call `initialise(offset)` where offset is
  * the zero based offset from the start of memory at which to start writing.
  */
-class HalStm32EepromAbstraction : public EepromAbstraction {
+class HalStm32EepromAbstraction : public EepromAbstraction, public Executable {
 private:
-    char eepromBuffer[EEPROM_SIZE];
+    alignas(4) uint8_t eepromBuffer[EEPROM_SIZE];
+    uint32_t dirtyWords[(EEPROM_WORD_SIZE + 31) / 32];
     uint16_t romBase;
     bool errorOccurred;
+    uint32_t autoCommitMillis;
+    taskid_t commitTask;
 public:
-    ~HalStm32EepromAbstraction() override = default;
+    HalStm32EepromAbstraction();
+
+    /**
+     * Cancels any pending auto commit and commits any changes, so nothing is lost and task manager is not left
+     * holding this object.
+     */
+    ~HalStm32EepromAbstraction() override;
 
     /**
      * Initialise the EEPROM, caching the current values from backup RAM starting at baseOffs.
@@ -56,10 +79,22 @@ public:
     void refresh() { halReadFromCache(); }
 
     /**
-     * Commit the values now in cache to backup
+     * Commit the words changed in cache to backup, nothing is done if there are no changes
      */
     void commit() { halWriteToCache(); }
 
+    /**
+     * Commit automatically a while after the first change, so that a number of changes are committed together.
+     * @param millis the time after the first change to commit, 0 to turn off
+     */
+    void setAutoCommit(uint32_t millis) { autoCommitMillis = millis; }
+
+    /** @return the number of 32 bit words changed since the last commit */
+    uint16_t getDirtyWordCount() const;
+
+    /** called by task manager when the auto commit timer fires */
+    void exec() override;
+
     /**
      * Reads an 8-bit value from the cache
      * @param position the position of the variable
@@ -128,6 +163,7 @@ private:
     void halReadFromCache();
     void halWriteToCache();
     void enableBackupRam();
+    void storeBytes(EepromPosition position, const uint8_t* data, uint8_t len);
 };
 
 #endif //IOA_HALSTM32EEPROMABSTRACTION_H or STM32 check
@@ -23,6 +23,10 @@ bool ioaWireRead(WireType pI2c, int address, uint8_t* buffer, size_t len) {
     return pI2c->read(address, (char*)buffer, len, false) == 0;
 }
 
+bool ioaWireReady(WireType pI2c, int address) {
+    return pI2c->write(address, nullptr, 0) == 0;
+}
+
 bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, size_t len, int retriesAllowed, bool sendStop) {
     int tries = 0;
     while(pI2c->write(address, (const char*)buffer, len, !sendStop) !=0) {
@@ -33,4 +37,23 @@ bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, si
     return true;
 }
 
+bool ioaWireWritePrefixed(WireType pI2c, int address, const uint8_t* prefix, size_t prefixLen,
+                          const uint8_t* buffer, size_t len, int retriesAllowed) {
+    // uses the byte level API so that the prefix and data go out in one transaction without being copied.
+    pI2c->lock();
+    bool addressed = false;
+    for(int tries = 0; !addressed && tries <= retriesAllowed; tries++) {
+        if(tries != 0) taskManager.yieldForMicros(50);
+        pI2c->start();
+        addressed = pI2c->write(address) == 1;
+        if(!addressed) pI2c->stop();
+    }
+    bool ok = addressed;
+    for(size_t i = 0; ok && i < prefixLen; i++) ok = pI2c->write(prefix[i]) == 1;
+    for(size_t i = 0; ok && i < len; i++) ok = pI2c->write(buffer[i]) == 1;
+    if(addressed) pI2c->stop();
+    pI2c->unlock();
+    return ok;
+}
+
 #endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "FileBackedEepromAbstraction.h"
+
+#if defined(__linux__) && defined(IOA_USE_POSIX_EXTRAS)
+
+#include "IoLogging.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+FileBackedEepromAbstraction::FileBackedEepromAbstraction(const char* fileName, size_t size, uint16_t pageSize) {
+    this->mapping = nullptr;
+    this->memSize = size;
+    this->pageSize = pageSize;
+    this->writeLatencyMicros = 0;
+    this->errorFlag = false;
+    this->wearCount = pageSize ? (size + pageSize - 1) / pageSize : size;
+    this->wear = new uint32_t[wearCount];
+    resetWear();
+
+    fd = open(fileName, O_RDWR | O_CREAT, 0644);
+    struct stat st = {};
+    if(fd < 0 || fstat(fd, &st) != 0 || (size_t(st.st_size) < size && ftruncate(fd, off_t(size)) != 0)) {
+        serdebugF2("Rom file could not be opened ", fileName);
+        errorFlag = true;
+        return;
+    }
+
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapped == MAP_FAILED) {
+        serdebugF2("Rom file could not be mapped ", fileName);
+        errorFlag = true;
+        return;
+    }
+    mapping = (uint8_t*)mapped;
+
+    // anything that was not in the file before reads as erased
+    if(size_t(st.st_size) < size) {
+        memset(&mapping[st.st_size], 0xff, size - st.st_size);
+    }
+}
+
+FileBackedEepromAbstraction::~FileBackedEepromAbstraction() {
+    if(mapping) {
+        msync(mapping, memSize, MS_SYNC);
+        munmap(mapping, memSize);
+    }
+    if(fd >= 0) close(fd);
+    delete[] wear;
+}
+
+void FileBackedEepromAbstraction::sync() {
+    if(mapping) msync(mapping, memSize, MS_SYNC);
+}
+
+bool FileBackedEepromAbstraction::hasErrorOccurred() {
+    bool err = errorFlag;
+    errorFlag = false;
+    return err;
+}
+
+void FileBackedEepromAbstraction::resetWear() {
+    memset(wear, 0, wearCount * sizeof(uint32_t));
+    writeCycles = bytesWritten = crossPageWrites = 0;
+}
+
+uint32_t FileBackedEepromAbstraction::getWearAt(EepromWidePosition position) const {
+    size_t idx = pageSize ? position / pageSize : position;
+    return idx < wearCount ? wear[idx] : 0;
+}
+
+uint32_t FileBackedEepromAbstraction::getMaxWear() const {
+    uint32_t most = 0;
+    for(size_t i = 0; i < wearCount; i++) {
+        if(wear[i] > most) most = wear[i];
+    }
+    return most;
+}
+
+bool FileBackedEepromAbstraction::checkBounds(EepromWidePosition position, size_t len) {
+    if(mapping == nullptr || position > memSize || len > (memSize - position)) {
+        serdebugF3("Rom file bounds exceeded ", position, (int)len);
+        errorFlag = true;
+        return false;
+    }
+    return true;
+}
+
+uint8_t FileBackedEepromAbstraction::read8(EepromPosition position) {
+    return checkBounds(position, 1) ? mapping[position] : 0;
+}
+
+void FileBackedEepromAbstraction::write8(EepromPosition position, uint8_t val) {
+    writeArrayToRomWide(position, &val, 1);
+}
+
+uint16_t FileBackedEepromAbstraction::read16(EepromPosition position) {
+    if(!checkBounds(position, 2)) return 0;
+    return mapping[position] | (mapping[position + 1] << 8);
+}
+
+void FileBackedEepromAbstraction::write16(EepromPosition position, uint16_t val) {
+    uint8_t data[2] = { uint8_t(val), uint8_t(val >> 8) };
+    writeArrayToRomWide(position, data, sizeof data);
+}
+
+uint32_t FileBackedEepromAbstraction::read32(EepromPosition position) {
+    if(!checkBounds(position, 4)) return 0;
+    return (uint32_t)mapping[position] | ((uint32_t)mapping[position + 1] << 8) |
+           ((uint32_t)mapping[position + 2] << 16) | ((uint32_t)mapping[position + 3] << 24);
+}
+
+void FileBackedEepromAbstraction::write32(EepromPosition position, uint32_t val) {
+    uint8_t data[4] = { uint8_t(val), uint8_t(val >> 8), uint8_t(val >> 16), uint8_t(val >> 24) };
+    writeArrayToRomWide(position, data, sizeof data);
+}
+
+void FileBackedEepromAbstraction::readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) {
+    readIntoMemArrayWide(memDest, romSrc, len);
+}
+
+void FileBackedEepromAbstraction::writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) {
+    writeArrayToRomWide(romDest, memSrc, len);
+}
+
+void FileBackedEepromAbstraction::readIntoMemArrayWide(uint8_t* memDest, EepromWidePosition romSrc, size_t len) {
+    if(checkBounds(romSrc, len)) memcpy(memDest, &mapping[romSrc], len);
+}
+
+void FileBackedEepromAbstraction::writeArrayToRomWide(EepromWidePosition romDest, const uint8_t* memSrc, size_t len) {
+    if(len == 0 || !checkBounds(romDest, len)) return;
+    memcpy(&mapping[romDest], memSrc, len);
+    bytesWritten += len;
+
+    // each page touched is one write cycle, or each byte when unpaged
+    size_t first = pageSize ? romDest / pageSize : romDest;
+    size_t last = pageSize ? (romDest + len - 1) / pageSize : (romDest + len - 1);
+    if(pageSize && first != last) crossPageWrites++;
+    for(size_t i = first; i <= last; i++) {
+        wear[i]++;
+    }
+    uint32_t cycles = last - first + 1;
+    writeCycles += cycles;
+
+    if(writeLatencyMicros) {
+        uint64_t delayNanos = uint64_t(writeLatencyMicros) * cycles * 1000ULL;
+        struct timespec ts = { time_t(delayNanos / 1000000000ULL), long(delayNanos % 1000000000ULL) };
+        nanosleep(&ts, nullptr);
+    }
+}
+
+#endif // __linux__ && IOA_USE_POSIX_EXTRAS
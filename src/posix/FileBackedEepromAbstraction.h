@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef _FILE_BACKED_EEPROM_ABSTRACTION_H_
+#define _FILE_BACKED_EEPROM_ABSTRACTION_H_
+
+/**
+ * @file FileBackedEepromAbstraction.h
+ *
+ * Contains an EepromAbstraction for host builds on Linux that keeps its contents in a memory mapped file, so that
+ * tests can run against a rom that persists between runs, and the image can be inspected afterwards. Only available
+ * when IOA_USE_POSIX_EXTRAS is defined.
+ */
+
+#include "EepromAbstraction.h"
+
+#if defined(__linux__) && defined(IOA_USE_POSIX_EXTRAS)
+
+/**
+ * An EepromAbstraction backed by a file that is memory mapped, all reads and writes go straight to the mapping so
+ * they run at memory speed, and the operating system writes the changes back to the file. A new file, or any part
+ * of the file beyond its previous length, is filled with 0xFF the same as an erased device.
+ *
+ * To help with soak tests, it counts write cycles, either for each page when a page size is given, or for each
+ * byte otherwise, and can add a delay for each write cycle to simulate the write time of a real device. Multi byte
+ * values are stored least significant byte first, the same as MockEepromAbstraction.
+ *
+ * Example: `FileBackedEepromAbstraction rom("settings.rom", 4096, 32);` then check `rom.isOpen()`.
+ */
+class FileBackedEepromAbstraction : public EepromAbstraction {
+private:
+    uint8_t* mapping;
+    size_t memSize;
+    int fd;
+    uint16_t pageSize;
+    uint32_t* wear;
+    size_t wearCount;
+    uint32_t writeLatencyMicros;
+    uint32_t writeCycles;
+    uint32_t bytesWritten;
+    uint32_t crossPageWrites;
+    bool errorFlag;
+public:
+    /**
+     * Create a rom backed by a file, the file is created if needed and extended to size.
+     * @param fileName the file to map
+     * @param size the size of the rom in bytes
+     * @param pageSize the page size to report and count write cycles by, 0 for an unpaged device
+     */
+    FileBackedEepromAbstraction(const char* fileName, size_t size, uint16_t pageSize = 0);
+    ~FileBackedEepromAbstraction() override;
+
+    /** @return true if the file was mapped successfully */
+    bool isOpen() const { return mapping != nullptr; }
+
+    /** flush all changes to the file now, normally this is left to the operating system */
+    void sync();
+
+    /**
+     * Simulate the write time of a real device by waiting this long for each write cycle.
+     * @param micros the time for each page write, or each byte write on an unpaged device
+     */
+    void setWriteLatency(uint32_t micros) { writeLatencyMicros = micros; }
+
+    /**
+     * @return a pointer to the mapped contents, for inspecting or reading without a copy, it is invalid once this
+     * object is destroyed.
+     */
+    const uint8_t* getMappedData() const { return mapping; }
+
+    /** @return the size of the rom */
+    size_t getSize() const { return memSize; }
+
+    /** @return the number of write cycles for the page (or byte when unpaged) that contains position */
+    uint32_t getWearAt(EepromWidePosition position) const;
+    /** @return the highest wear of any page (or byte when unpaged) */
+    uint32_t getMaxWear() const;
+    /** @return the number of write cycles since the counters were reset */
+    uint32_t getWriteCycles() const { return writeCycles; }
+    /** @return the number of bytes written since the counters were reset */
+    uint32_t getBytesWritten() const { return bytesWritten; }
+    /** @return the number of single writes that crossed a page boundary, these would wrap on a real device */
+    uint32_t getCrossPageWrites() const { return crossPageWrites; }
+    /** clear all the wear and write counters */
+    void resetWear();
+
+    bool hasErrorOccurred() override;
+    uint16_t getPageSize() override { return pageSize; }
+
+    uint8_t read8(EepromPosition position) override;
+    void write8(EepromPosition position, uint8_t val) override;
+
+    uint16_t read16(EepromPosition position) override;
+    void write16(EepromPosition position, uint16_t val) override;
+
+    uint32_t read32(EepromPosition position) override;
+    void write32(EepromPosition position, uint32_t val) override;
+
+    void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override;
+    void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override;
+
+    void readIntoMemArrayWide(uint8_t* memDest, EepromWidePosition romSrc, size_t len) override;
+    void writeArrayToRomWide(EepromWidePosition romDest, const uint8_t* memSrc, size_t len) override;
+
+private:
+    bool checkBounds(EepromWidePosition position, size_t len);
+};
+
+#endif // __linux__ && IOA_USE_POSIX_EXTRAS
+
+#endif //_FILE_BACKED_EEPROM_ABSTRACTION_H_
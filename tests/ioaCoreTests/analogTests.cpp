@@ -0,0 +1,454 @@
+#include <AUnit.h>
+#include "MockAnalogDevice.h"
+#include "AnalogScanGroup.h"
+#include "FilteredAnalogDevice.h"
+#include "DeviceEvents.h"
+#include "DfRobotInputAbstraction.h"
+#include "Ads1115AnalogDevice.h"
+#include "Pca9685AnalogDevice.h"
+#include "AnalogWaveformEngine.h"
+
+test(testScanGroupSharesSweepOnDemand) {
+    MockAnalogDevice device(10);
+    AnalogScanGroup group(&device);
+    assertTrue(group.addPin(1));
+    assertTrue(group.addPin(2));
+    assertTrue(group.addPin(3));
+    device.setReadValue(1, 100);
+    device.setReadValue(2, 200);
+    device.setReadValue(3, 1023);
+    device.setReadValue(7, 50);
+
+    // several consumers reading within the maximum age share one sweep
+    assertEqual(100U, group.getCurrentValue(1));
+    assertEqual(200U, group.getCurrentValue(2));
+    assertNear(1.0F, group.getCurrentFloat(3), 0.001F);
+    assertEqual(100U, group.getCurrentValue(1));
+    assertEqual((uint32_t)3, device.getConversionCount());
+    assertEqual((uint32_t)1, group.getSweepCount());
+
+    // pins that are not in the group go straight to the device
+    assertEqual(50U, group.getCurrentValue(7));
+    assertEqual((uint32_t)4, device.getConversionCount());
+
+    // once the sweep is older than the maximum age, the next read sweeps again.
+    device.setReadValue(1, 150);
+    taskManager.yieldForMicros(ANALOG_SCAN_DEFAULT_AGE_MICROS + 100);
+    assertEqual(150U, group.getCurrentValue(1));
+    assertEqual((uint32_t)2, group.getSweepCount());
+}
+
+test(testScanGroupContinuous) {
+    taskManager.reset();
+    MockAnalogDevice device(12);
+    AnalogScanGroup group(&device);
+    group.addPin(0);
+    group.addPin(4);
+    device.setReadValue(4, 2000);
+
+    group.startContinuous(1000);
+    assertTrue(group.isContinuous());
+    taskManager.yieldForMicros(5050);
+    uint32_t sweeps = group.getSweepCount();
+    assertMoreOrEqual(sweeps, (uint32_t)5);
+
+    // reads in continuous mode never convert
+    device.resetConversionCount();
+    for(int i = 0; i < 10; i++) assertEqual(2000U, group.getCurrentValue(4));
+    assertEqual((uint32_t)0, device.getConversionCount());
+    assertEqual(2000U, group.getResult(1));
+
+    group.stopContinuous();
+    taskManager.yieldForMicros(5000);
+    assertEqual(sweeps, group.getSweepCount());
+    taskManager.reset();
+}
+
+test(testFilteredDeviceOversampleAndCache) {
+    MockAnalogDevice device(10);
+    FilteredAnalogDevice filtered(&device);
+    assertTrue(filtered.addPin(2, analogFilter(4, 1)));
+    assertFalse(filtered.addPin(3, analogFilter(3)));
+    assertFalse(filtered.addPin(3, analogFilter(1, 0, 4)));
+
+    // 4 samples with one extra bit gives an 11 bit result
+    assertEqual(11, filtered.getBitDepth(DIR_IN, 2));
+
+    // a 13 bit device with 4 extra bits would need 17 bits, so it is rejected
+    MockAnalogDevice wideDevice(13);
+    FilteredAnalogDevice wideFiltered(&wideDevice);
+    assertTrue(wideFiltered.addPin(1, analogFilter(8, 3)));
+    assertFalse(wideFiltered.addPin(1, analogFilter(16, 4)));
+
+    // the EMA accumulator is 32 bits, so the shift is limited to 16
+    assertTrue(wideFiltered.addPin(1, analogFilter(1, 0, 1, 16)));
+    assertFalse(wideFiltered.addPin(1, analogFilter(1, 0, 1, 17)));
+    assertEqual(2047, filtered.getMaximumRange(DIR_IN, 2));
+    assertEqual(10, filtered.getBitDepth(DIR_IN, 5));
+
+    device.setReadValue(2, 500);
+    device.setReadValue(5, 321);
+    assertEqual(1000U, filtered.getCurrentValue(2));
+    assertEqual((uint32_t)4, device.getConversionCount());
+
+    // repeat reads within the cache time are free, unfiltered pins pass through
+    assertEqual(1000U, filtered.getCurrentValue(2));
+    assertEqual((uint32_t)4, device.getConversionCount());
+    assertEqual(321U, filtered.getCurrentValue(5));
+    assertEqual((uint32_t)5, device.getConversionCount());
+}
+
+test(testFilteredDeviceMedianEmaAndHysteresis) {
+    MockAnalogDevice device(10);
+    FilteredAnalogDevice filtered(&device);
+    filtered.setCacheMicros(0);
+    filtered.addPin(1, analogFilter(1, 0, 3));
+    filtered.addPin(2, analogFilter(1, 0, 1, 2));
+    filtered.addPin(3, analogFilter(1, 0, 1, 0, 5));
+
+    // median of 3 rejects a single spike
+    device.setReadValue(1, 100);
+    filtered.getCurrentValue(1);
+    filtered.getCurrentValue(1);
+    device.setReadValue(1, 1000);
+    assertEqual(100U, filtered.getCurrentValue(1));
+
+    // EMA with a shift of 2 moves a quarter of the way each time
+    device.setReadValue(2, 400);
+    assertEqual(400U, filtered.getCurrentValue(2));
+    device.setReadValue(2, 800);
+    assertEqual(500U, filtered.getCurrentValue(2));
+    assertEqual(575U, filtered.getCurrentValue(2));
+
+    // hysteresis holds the output for small changes
+    device.setReadValue(3, 200);
+    assertEqual(200U, filtered.getCurrentValue(3));
+    device.setReadValue(3, 204);
+    assertEqual(200U, filtered.getCurrentValue(3));
+    device.setReadValue(3, 206);
+    assertEqual(206U, filtered.getCurrentValue(3));
+}
+
+test(testAnalogFixedPointScaling) {
+    assertEqual((analogfixed_t)0, analogScaleToFixed(0, 10));
+    assertEqual((analogfixed_t)0xffff, analogScaleToFixed(1023, 10));
+    assertEqual((analogfixed_t)0xffff, analogScaleToFixed(4095, 12));
+    assertEqual((analogfixed_t)0x8020, analogScaleToFixed(512, 10));
+    assertEqual((analogfixed_t)0x1234, analogScaleToFixed(0x1234, 16));
+    assertEqual(1023U, analogScaleFromFixed(0xffff, 10));
+    assertEqual(128U, analogScaleFromFixed(0x8000, 8));
+
+    MockAnalogDevice device(12);
+    device.setReadValue(3, 2048);
+    assertEqual((analogfixed_t)0x8008, device.getCurrentFixed(3));
+    device.setCurrentFixed(4, ANALOG_FIXED_MAX);
+    assertEqual(4095U, device.getWrittenValue(4));
+}
+
+class FixedTestAnalogEvent : public AnalogInEvent {
+public:
+    int execCount = 0;
+    FixedTestAnalogEvent(AnalogDevice* device) : AnalogInEvent(device, 1, 0.75F, ANALOGIN_EXCEEDS, 1000) { }
+    void exec() override { execCount++; }
+    float getFloatReading() { return lastReading; }
+};
+
+test(testAnalogInEventFixedComparison) {
+    MockAnalogDevice device(10);
+    FixedTestAnalogEvent event(&device);
+    device.setReadValue(1, 700);
+    event.timeOfNextCheck();
+    assertFalse(event.isTriggered());
+
+    device.setReadValue(1, 800);
+    event.timeOfNextCheck();
+    assertTrue(event.isTriggered());
+    assertNear(0.782F, event.getFloatReading(), 0.001F);
+    assertEqual(analogScaleToFixed(800, 10), event.getLastReadingFixed());
+}
+
+const PROGMEM DfRobotAnalogRanges testDfRanges { 0.0488F, 0.2441F, 0.4394F, 0.6347F, 0.8300F};
+
+test(testDfRobotFixedMapping) {
+    MockAnalogDevice device(10);
+    device.setReadValue(0, 1023);
+    DfRobotInputAbstraction dfRobot(&testDfRanges, 0, &device);
+    assertEqual((uint8_t)0, ioDeviceDigitalReadPort(&dfRobot, 0));
+
+    device.setReadValue(0, 300);
+    ioDeviceSync(&dfRobot);
+    assertEqual(HIGH, ioDeviceDigitalRead(&dfRobot, DF_KEY_DOWN));
+    assertEqual((uint8_t)(1 << DF_KEY_DOWN), ioDeviceDigitalReadPort(&dfRobot, 0));
+
+    device.setReadValue(0, 10);
+    ioDeviceSync(&dfRobot);
+    assertEqual(HIGH, ioDeviceDigitalRead(&dfRobot, DF_KEY_RIGHT));
+    assertEqual((uint8_t)(1 << DF_KEY_SELECT), dfRobot.mapAnalogToPin(0.8F));
+}
+
+class ChangeTestAnalogEvent : public AnalogInEvent {
+public:
+    ChangeTestAnalogEvent(AnalogDevice* device) : AnalogInEvent(device, 2, 0.1F, ANALOGIN_CHANGE, 1000) { }
+    void exec() override { }
+};
+
+test(testAnalogInEventChangeComparesWithPrevious) {
+    MockAnalogDevice device(10);
+    ChangeTestAnalogEvent event(&device);
+
+    // a steady reading well above the threshold must not trigger, only a change does
+    device.setReadValue(2, 800);
+    event.timeOfNextCheck();
+    event.timeOfNextCheck();
+    assertFalse(event.isTriggered());
+
+    device.setReadValue(2, 850);
+    event.timeOfNextCheck();
+    assertFalse(event.isTriggered());
+
+    device.setReadValue(2, 950);
+    event.timeOfNextCheck();
+    assertTrue(event.isTriggered());
+    event.setTriggered(false);
+
+    // the next change is measured from the value that triggered
+    event.timeOfNextCheck();
+    assertFalse(event.isTriggered());
+
+    // a fast ramp moves by more than the threshold on every poll, each step must trigger again
+    for(int reading = 800; reading >= 200; reading -= 150) {
+        device.setReadValue(2, reading);
+        event.timeOfNextCheck();
+        assertTrue(event.isTriggered());
+        event.setTriggered(false);
+    }
+    event.timeOfNextCheck();
+    assertFalse(event.isTriggered());
+}
+
+class TestAnalogMonitor : public AnalogMonitorEvent {
+public:
+    uint32_t lastMask = 0;
+    TestAnalogMonitor(AnalogScanGroup* group) : AnalogMonitorEvent(group, 10000) { }
+    void exec() override { lastMask = getAndClearFiredMask(); }
+};
+
+test(testAnalogMonitorManyChannels) {
+    MockAnalogDevice device(10);
+    AnalogScanGroup group(&device);
+    TestAnalogMonitor monitor(&group);
+    assertEqual(0, monitor.addChannel(1, AnalogInEvent::ANALOGIN_EXCEEDS, 0.5F, 0.1F));
+    assertEqual(1, monitor.addChannel(2, AnalogInEvent::ANALOGIN_BELOW, 0.2F, 0.05F));
+    assertEqual(2, monitor.addChannel(3, AnalogInEvent::ANALOGIN_CHANGE, 0.1F));
+
+    device.setReadValue(1, 400);
+    device.setReadValue(2, 500);
+    device.setReadValue(3, 500);
+    monitor.timeOfNextCheck();
+    assertFalse(monitor.isTriggered());
+    assertEqual((uint32_t)3, device.getConversionCount());
+
+    // channel 0 exceeds and channel 2 changes in the same sweep
+    device.setReadValue(1, 600);
+    device.setReadValue(3, 700);
+    monitor.timeOfNextCheck();
+    assertTrue(monitor.isTriggered());
+    assertEqual((uint32_t)6, device.getConversionCount());
+    monitor.exec();
+    assertEqual((uint32_t)0x05, monitor.lastMask);
+    monitor.setTriggered(false);
+
+    // dropping just under the threshold is within the hysteresis, so going back over does not fire again
+    device.setReadValue(1, 480);
+    monitor.timeOfNextCheck();
+    device.setReadValue(1, 600);
+    monitor.timeOfNextCheck();
+    assertFalse(monitor.isTriggered());
+
+    // but dropping below the hysteresis band re-arms it, channel 1 also goes below
+    device.setReadValue(1, 400);
+    device.setReadValue(2, 100);
+    monitor.timeOfNextCheck();
+    device.setReadValue(1, 600);
+    monitor.timeOfNextCheck();
+    assertTrue(monitor.isTriggered());
+    assertEqual((uint32_t)0x03, monitor.getAndClearFiredMask());
+}
+
+// simulates the registers of an ADS1115, a result is only available once the conversion time has passed
+class SimulatedAds1115 : public Ads1115AnalogDevice {
+public:
+    int16_t inputs[ADS1115_CHANNELS] = {0};
+    uint16_t lastConfig = 0;
+    uint16_t conversionResult = 0;
+    unsigned long conversionStart = 0;
+    int writeTransactions = 0;
+    int readTransactions = 0;
+    int earlyReads = 0;
+
+    SimulatedAds1115() : Ads1115AnalogDevice(0x48, ADS1115_GAIN_4_096V, ADS1115_RATE_860SPS, nullptr) {}
+protected:
+    bool writeRegister(uint8_t reg, uint16_t value) override {
+        writeTransactions++;
+        if(reg == ADS1115_CONFIG_REG && (value & ADS1115_CFG_START)) {
+            lastConfig = value;
+            conversionStart = micros();
+            conversionResult = (uint16_t)inputs[(value >> 12U) & 0x03];
+        }
+        return true;
+    }
+
+    bool readRegister(uint8_t reg, uint16_t& value) override {
+        readTransactions++;
+        if(micros() - conversionStart < 1163) earlyReads++;
+        value = (reg == ADS1115_CONVERSION_REG) ? conversionResult : lastConfig;
+        return true;
+    }
+};
+
+test(testAds1115PipelinedRoundRobin) {
+    taskManager.reset();
+    SimulatedAds1115 adc;
+    adc.inputs[0] = 12000;
+    adc.inputs[2] = 32767;
+    adc.inputs[3] = -20;
+    adc.initPin(0, DIR_IN);
+    adc.initPin(2, DIR_IN);
+    adc.initPin(3, DIR_IN);
+    adc.initPin(0, DIR_OUT);
+    assertTrue(adc.isRunning());
+    assertEqual(32767, adc.getMaximumRange(DIR_IN, 0));
+
+    // a full round of three channels, each result is read only once its conversion has finished
+    taskManager.yieldForMicros(adc.getConversionMicros() * 3 + 200);
+    assertEqual((uint32_t)3, adc.getConversionCount());
+    assertEqual(0, adc.earlyReads);
+    assertEqual(4, adc.writeTransactions);
+    assertEqual(3, adc.readTransactions);
+    assertEqual(12000U, adc.getCurrentValue(0));
+    assertEqual(32767U, adc.getCurrentValue(2));
+    assertEqual(0U, adc.getCurrentValue(3));
+    assertFalse(adc.hasErrorOccurred());
+
+    // reading from the cache never touches the bus, and the next channel in the round is already converting
+    adc.getCurrentValue(0);
+    adc.getCurrentFloat(2);
+    assertEqual(3, adc.readTransactions);
+    assertEqual((uint16_t)0x4000, (uint16_t)(adc.lastConfig & 0x7000));
+    assertEqual((uint16_t)(ADS1115_RATE_860SPS << 5U), (uint16_t)(adc.lastConfig & 0x00e0));
+
+    // channel 0 was sampled before the change, so the new value arrives on the following round
+    adc.inputs[0] = 500;
+    taskManager.yieldForMicros(adc.getConversionMicros() + 100);
+    assertEqual(12000U, adc.getCurrentValue(0));
+    taskManager.yieldForMicros(adc.getConversionMicros() * 3);
+    assertEqual(500U, adc.getCurrentValue(0));
+
+    adc.stop();
+    taskManager.yieldForMicros(adc.getConversionMicros() * 2);
+    assertEqual((uint32_t)7, adc.getConversionCount());
+    taskManager.reset();
+}
+
+// simulates the register file of a PCA9685 with auto increment, counting every transaction and byte written
+class SimulatedPca9685 : public Pca9685AnalogDevice {
+public:
+    uint8_t registers[256] = {0};
+    int transactions = 0;
+    int bytesWritten = 0;
+
+    SimulatedPca9685() : Pca9685AnalogDevice(0x40, 200, true, nullptr) {}
+
+    uint16_t offRegister(int ch) { return registers[PCA9685_LED0_REG + ch * 4 + 2] | (registers[PCA9685_LED0_REG + ch * 4 + 3] << 8); }
+    void resetCounts() { transactions = bytesWritten = 0; }
+protected:
+    bool writeBurst(const uint8_t* data, size_t len) override {
+        transactions++;
+        bytesWritten += (int)len;
+        for(size_t i = 1; i < len; i++) registers[uint8_t(data[0] + i - 1)] = data[i];
+        return true;
+    }
+};
+
+test(testPca9685BurstsOnlyChangedChannels) {
+    SimulatedPca9685 pwm;
+    pwm.initPin(0, DIR_OUT);
+    assertEqual((uint8_t)30, pwm.registers[PCA9685_PRESCALE_REG]);
+    assertTrue((pwm.registers[PCA9685_MODE1_REG] & PCA9685_MODE1_AUTO_INC) != 0);
+    assertEqual(4095, pwm.getMaximumRange(DIR_OUT, 0));
+
+    // the first sync after begin writes everything, all the same value so the all LED register is used
+    pwm.resetCounts();
+    assertTrue(pwm.sync());
+    assertEqual(1, pwm.transactions);
+    assertEqual(5, pwm.bytesWritten);
+
+    // three adjacent channels and one on its own, two bursts of 1 + 12 and 1 + 4 bytes
+    pwm.resetCounts();
+    pwm.setCurrentValue(3, 100);
+    pwm.setCurrentValue(4, 200);
+    pwm.setCurrentValue(5, 300);
+    pwm.setCurrentValue(12, 2048);
+    pwm.setCurrentValue(13, 0);
+    assertTrue(pwm.isSyncNeeded());
+    assertTrue(pwm.sync());
+    assertEqual(2, pwm.transactions);
+    assertEqual(18, pwm.bytesWritten);
+    assertEqual((uint16_t)200, pwm.offRegister(4));
+    assertEqual((uint16_t)2048, pwm.offRegister(12));
+
+    // nothing changed, or set to the same value, nothing is written
+    pwm.resetCounts();
+    pwm.setCurrentValue(4, 200);
+    assertFalse(pwm.isSyncNeeded());
+    assertTrue(pwm.sync());
+    assertEqual(0, pwm.transactions);
+
+    // a full frame of different values is split at the burst limit, and the extremes use the full on/off bits
+    pwm.resetCounts();
+    for(int i = 0; i < PCA9685_CHANNELS; i++) pwm.setCurrentValue(i, i * 250 + 1);
+    pwm.setCurrentFloat(15, 1.0F);
+    assertTrue(pwm.sync());
+    assertEqual((PCA9685_CHANNELS + PCA9685_MAX_BURST_CHANNELS - 1) / PCA9685_MAX_BURST_CHANNELS, pwm.transactions);
+    assertEqual(pwm.transactions + PCA9685_CHANNELS * 4, pwm.bytesWritten);
+    assertEqual((uint8_t)PCA9685_FULL_ON_OFF, pwm.registers[PCA9685_LED0_REG + 15 * 4 + 1]);
+    assertFalse(pwm.hasErrorOccurred());
+}
+
+test(testWaveformEngineChannelsInLockstep) {
+    taskManager.reset();
+    MockAnalogDevice device(10);
+    AnalogWaveformEngine engine;
+    assertEqual(0, engine.addChannel(&device, 1, WAVEFORM_SAWTOOTH, 4));
+    assertEqual(1, engine.addChannel(&device, 2, WAVEFORM_SQUARE, 4, 1.0F, 0.5F, 2));
+    assertEqual(2, engine.addChannel(&device, 3, WAVEFORM_SINE, 8, 0.5F, 0.5F));
+
+    // tables are generated at the resolution of the output
+    assertEqual((uint16_t)0, engine.getSample(0, 0));
+    assertEqual((uint16_t)341, engine.getSample(0, 1));
+    assertEqual((uint16_t)1023, engine.getSample(0, 3));
+    assertEqual((uint16_t)512, engine.getSample(2, 0));
+    assertEqual((uint16_t)767, engine.getSample(2, 2));
+    assertEqual((uint16_t)256, engine.getSample(2, 6));
+
+    // each tick writes the next sample to every channel together
+    engine.start(1000);
+    taskManager.yieldForMicros(1050);
+    assertEqual((uint32_t)1, engine.getTickCount());
+    assertEqual(0U, device.getWrittenValue(1));
+    assertEqual(0U, device.getWrittenValue(2));
+    taskManager.yieldForMicros(1000);
+    assertEqual(341U, device.getWrittenValue(1));
+    assertEqual(0U, device.getWrittenValue(2));
+    taskManager.yieldForMicros(1000);
+    assertEqual(682U, device.getWrittenValue(1));
+    assertEqual(1023U, device.getWrittenValue(2));
+    assertEqual((engine.getPosition(0) + 2) % 4, (int)engine.getPosition(1));
+
+    engine.stop();
+    assertFalse(engine.isRunning());
+    uint32_t ticks = engine.getTickCount();
+    taskManager.yieldForMicros(3000);
+    assertEqual(ticks, engine.getTickCount());
+    taskManager.reset();
+}
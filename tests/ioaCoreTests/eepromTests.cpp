@@ -0,0 +1,773 @@
+#include <AUnit.h>
+#include <EepromAbstractionWire.h>
+#include <CachingEepromAbstraction.h>
+#include <EepromLogStore.h>
+#include <EepromRecordStore.h>
+#include <posix/FileBackedEepromAbstraction.h>
+#include <mbed/HalStm32EepromAbstraction.h>
+// only boards with an emulated EEPROM that needs commit are tested, and not every board has an EEPROM library at all
+#if defined(ESP32) || defined(ESP8266) || defined(ARDUINO_ARCH_RP2040) || defined(IOA_EEPROM_NEEDS_COMMIT)
+#include <ArduinoEEPROMAbstraction.h>
+#endif
+#include <MockEepromAbstraction.h>
+
+// models an AT24 chip on the wire hooks: a two byte address then data that wraps within the page, and reads that
+// continue from the address pointer. Every bus transaction is counted. If writeCycleMicros is set, the chip does not
+// acknowledge for that long after each write, in the same way as the real device. For devices over 64KB the high
+// address bits are taken from the device address, the device only responds at 0x50 with those bits. With mbed
+// addressing, the device address is the 8 bit form, so the memory bits are above the read/write bit in bit 0.
+// Large devices are simulated sparsely, only a window of memory is held, outside it writes are dropped and reads are 0.
+// Setting failTransactions makes that many of the following bus transactions fail, as a noisy bus would.
+class SimulatedAt24Eeprom : public I2cAt24Eeprom {
+public:
+    uint8_t* memory;
+    uint32_t memSize;
+    uint32_t windowStart;
+    uint32_t windowLen;
+    uint8_t outsideWindow = 0;
+    uint32_t addressPointer = 0;
+    uint16_t simPageSize;
+    int transactions = 0;
+    int bytesWritten = 0;
+    int readyPolls = 0;
+    uint32_t writeCycleMicros = 0;
+    uint32_t busyUntil = 0;
+    bool mbedAddressing;
+    int wrongAddresses = 0;
+    int failTransactions = 0;
+
+    explicit SimulatedAt24Eeprom(uint16_t pageSize, uint32_t size = 512, uint8_t highBits = 0, bool mbedAddressing = false,
+                                 uint32_t windowStart = 0, uint32_t windowLen = 0)
+            : I2cAt24Eeprom(mbedAddressing ? 0xA0 : 0x50, pageSize, defaultWireTypePtr, highBits) {
+        this->mbedAddressing = mbedAddressing;
+        if(mbedAddressing) highAddressShift = 1;
+        simPageSize = pageSize;
+        memSize = size;
+        this->windowStart = windowStart;
+        this->windowLen = windowLen ? windowLen : size;
+        memory = new uint8_t[this->windowLen];
+        memset(memory, 0, this->windowLen);
+    }
+
+    uint8_t& at(uint32_t addr) {
+        if(addr < windowStart || (addr - windowStart) >= windowLen) {
+            outsideWindow = 0;
+            return outsideWindow;
+        }
+        return memory[addr - windowStart];
+    }
+
+    ~SimulatedAt24Eeprom() override {
+        delete[] memory;
+    }
+
+    void resetCounts() { transactions = bytesWritten = readyPolls = 0; }
+
+    bool isBusy() const { return int32_t(busyUntil - micros()) > 0; }
+
+    // the 7 bit address the device sees, or 0xff if a read was requested by the read/write bit
+    uint8_t decodeAddress(uint8_t deviceAddr) const {
+        if(!mbedAddressing) return deviceAddr;
+        return (deviceAddr & 0x01U) ? 0xffU : (deviceAddr >> 1U);
+    }
+
+protected:
+    bool wireWrite(uint8_t deviceAddr, uint16_t memAddr, const uint8_t* data, size_t len, int retries) override {
+        while(isBusy() && retries-- > 0) taskManager.yieldForMicros(50);
+        transactions++;
+        if(failTransactions > 0 && failTransactions--) return false;
+        uint8_t addr = decodeAddress(deviceAddr);
+        if((addr & 0xf8U) != 0x50U) {
+            wrongAddresses++;
+            return false;
+        }
+        if(isBusy()) return false;
+        if(len > 0 && writeCycleMicros != 0) busyUntil = micros() + writeCycleMicros;
+        addressPointer = (((uint32_t)(addr & 0x07U) << 16U) | memAddr) % memSize;
+        uint32_t pageStart = addressPointer - (addressPointer % simPageSize);
+        for(size_t i = 0; i < len; i++) {
+            at(pageStart + ((addressPointer - pageStart + i) % simPageSize)) = data[i];
+            bytesWritten++;
+        }
+        return true;
+    }
+
+    bool wireRead(uint8_t deviceAddr, uint8_t* data, size_t len) override {
+        transactions++;
+        if(failTransactions > 0 && failTransactions--) return false;
+        if((decodeAddress(deviceAddr) & 0xf8U) != 0x50U) {
+            wrongAddresses++;
+            return false;
+        }
+        if(isBusy()) return false;
+        for(size_t i = 0; i < len; i++) {
+            data[i] = at(addressPointer);
+            addressPointer = (addressPointer + 1) % memSize;
+        }
+        return true;
+    }
+
+    bool wireReady() override {
+        readyPolls++;
+        return !isBusy();
+    }
+};
+
+test(testAt24MultiByteReadsAreOneTransfer) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    rom.memory[10] = 0x12;
+    rom.memory[11] = 0x34;
+    rom.memory[12] = 0x56;
+    rom.memory[13] = 0x78;
+
+    // previously 8 transactions, an address write and a read for each byte
+    assertEqual(rom.read32(10), (uint32_t)0x12345678UL);
+    assertEqual(rom.transactions, 2);
+
+    rom.resetCounts();
+    assertEqual(rom.read16(12), (uint16_t)0x5678);
+    assertEqual(rom.transactions, 2);
+    assertFalse(rom.hasErrorOccurred());
+}
+
+test(testAt24WritesCompareTheWholeSpanFirst) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+
+    // previously 12 transactions, a read32 and then a write per byte
+    rom.write32(40, 0xdeadbeefUL);
+    assertEqual(rom.transactions, 3);
+    assertEqual(rom.bytesWritten, 4);
+    assertEqual(rom.read32(40), (uint32_t)0xdeadbeefUL);
+
+    // unchanged data is only read
+    rom.resetCounts();
+    rom.write32(40, 0xdeadbeefUL);
+    assertEqual(rom.transactions, 2);
+    assertEqual(rom.bytesWritten, 0);
+
+    // only the bytes from the first to the last difference are written
+    rom.resetCounts();
+    rom.write32(40, 0xde11beefUL);
+    assertEqual(rom.transactions, 3);
+    assertEqual(rom.bytesWritten, 1);
+    assertEqual(rom.read32(40), (uint32_t)0xde11beefUL);
+
+    rom.resetCounts();
+    rom.write16(100, 0xcafe);
+    assertEqual(rom.transactions, 3);
+    assertEqual(rom.read16(100), (uint16_t)0xcafe);
+    assertFalse(rom.hasErrorOccurred());
+}
+
+test(testAt24ErrorDoesNotBlockLaterTransfers) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    rom.memory[30] = 0xab;
+    rom.memory[31] = 0xcd;
+
+    // one failed transfer is reported, but the error is not read back before carrying on
+    rom.failTransactions = 1;
+    rom.read16(30);
+
+    rom.write16(20, 0x1234);
+    assertEqual(rom.memory[20], (uint8_t)0x12);
+    assertEqual(rom.memory[21], (uint8_t)0x34);
+    assertEqual(rom.read16(30), (uint16_t)0xabcd);
+    rom.write32(24, 0x01020304UL);
+    assertEqual(rom.read32(24), (uint32_t)0x01020304UL);
+
+    assertTrue(rom.hasErrorOccurred());
+    assertFalse(rom.hasErrorOccurred());
+}
+
+test(testAt24TransfersSplitAtPageBoundaries) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+
+    // straddles the page boundary at 32, so the write needs two bursts but the compare read does not
+    rom.write32(30, 0x01020304UL);
+    assertEqual(rom.transactions, 4);
+    assertEqual(rom.memory[30], 0x01);
+    assertEqual(rom.memory[31], 0x02);
+    assertEqual(rom.memory[32], 0x03);
+    assertEqual(rom.memory[33], 0x04);
+    assertEqual(rom.memory[0], 0);
+
+    rom.resetCounts();
+    assertEqual(rom.read32(30), (uint32_t)0x01020304UL);
+    assertEqual(rom.transactions, 2);
+}
+
+test(testCachingEepromBatchesSmallWrites) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    CachingEepromAbstraction cache(&rom, 2);
+    assertEqual(cache.getPageSize(), (uint16_t)PAGESIZE_AT24C32);
+
+    // loading the page is one read, then everything happens in RAM
+    for(uint8_t i = 0; i < 8; i++) {
+        cache.write8(i, i + 1);
+    }
+    cache.write16(8, 0x1234);
+    cache.write32(10, 0xcafebabeUL);
+    assertEqual(rom.transactions, 2);
+    assertEqual(rom.bytesWritten, 0);
+    assertEqual(cache.read32(10), (uint32_t)0xcafebabeUL);
+    assertEqual(cache.getDirtyPageCount(), (uint8_t)1);
+    assertEqual(cache.getMissCount(), (uint32_t)1);
+    assertEqual(cache.getHitCount(), (uint32_t)10);
+
+    // all of the changes go out in a single page write
+    rom.resetCounts();
+    cache.commit();
+    assertEqual(rom.transactions, 1);
+    assertEqual(rom.bytesWritten, 14);
+    assertEqual(cache.getFlushCount(), (uint32_t)1);
+    assertEqual(cache.getDirtyPageCount(), (uint8_t)0);
+    assertEqual(rom.read16(8), (uint16_t)0x1234);
+    assertEqual(rom.read32(10), (uint32_t)0xcafebabeUL);
+
+    // nothing changed, so nothing is written
+    rom.resetCounts();
+    cache.write8(0, 1);
+    cache.commit();
+    assertEqual(rom.transactions, 0);
+    assertFalse(cache.hasErrorOccurred());
+}
+
+test(testCachingEepromKeepsUnderlyingByteOrder) {
+    // the mock stores least significant byte first, values stored before wrapping must read back unchanged
+    MockEepromAbstraction mock(128);
+    mock.write16(0, 0x1234);
+    mock.write32(4, 0xdeadbeefUL);
+
+    CachingEepromAbstraction cache(&mock, 2);
+    assertFalse(cache.isBigEndian());
+    assertEqual(cache.read16(0), (uint16_t)0x1234);
+    assertEqual(cache.read32(4), (uint32_t)0xdeadbeefUL);
+
+    cache.write16(10, 0xabcd);
+    cache.write32(12, 0x01020304UL);
+    cache.commit();
+    assertEqual(mock.read8(10), (uint8_t)0xcd);
+    assertEqual(mock.read16(10), (uint16_t)0xabcd);
+    assertEqual(mock.read8(12), (uint8_t)0x04);
+    assertEqual(mock.read32(12), (uint32_t)0x01020304UL);
+
+    // and over an AT24 the order stays most significant byte first
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    CachingEepromAbstraction at24Cache(&rom, 1);
+    assertTrue(at24Cache.isBigEndian());
+    at24Cache.write16(2, 0xabcd);
+    at24Cache.commit();
+    assertEqual(rom.memory[2], (uint8_t)0xab);
+    assertEqual(rom.memory[3], (uint8_t)0xcd);
+}
+
+test(testCachingEepromEvictsLeastRecentlyUsed) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    CachingEepromAbstraction cache(&rom, 2);
+
+    cache.write8(0, 0xaa);      // page 0, dirty
+    cache.read8(32);            // page 1
+    cache.read8(1);             // page 0 is now the most recent
+    assertEqual(rom.bytesWritten, 0);
+
+    // page 1 is evicted, it is clean so no write is needed
+    rom.resetCounts();
+    cache.read8(64);
+    assertEqual(rom.bytesWritten, 0);
+    assertEqual(cache.getDirtyPageCount(), (uint8_t)1);
+
+    // now page 0 is the oldest and is written back when evicted
+    cache.read8(96);
+    assertEqual(rom.bytesWritten, 1);
+    assertEqual(rom.memory[0], 0xaa);
+    assertEqual(cache.getFlushCount(), (uint32_t)1);
+    assertEqual(cache.getMissCount(), (uint32_t)4);
+    assertEqual(cache.getHitCount(), (uint32_t)1);
+
+    // values spanning two pages are handled
+    cache.write32(62, 0x11223344UL);
+    assertEqual(cache.read32(62), (uint32_t)0x11223344UL);
+    cache.commit();
+    assertEqual(rom.read32(62), (uint32_t)0x11223344UL);
+}
+
+test(testCachingEepromAutoFlush) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    CachingEepromAbstraction cache(&rom, 1, 2);
+
+    cache.write16(4, 0xbeef);
+    assertEqual(cache.getDirtyPageCount(), (uint8_t)1);
+    taskManager.yieldForMicros(5000);
+    assertEqual(cache.getDirtyPageCount(), (uint8_t)0);
+    assertEqual(rom.read16(4), (uint16_t)0xbeef);
+}
+
+int asyncCompletions = 0;
+bool asyncSucceeded = false;
+
+void onAsyncWriteComplete(bool success) {
+    asyncCompletions++;
+    asyncSucceeded = success;
+}
+
+test(testAt24AsyncWritesReturnImmediately) {
+    asyncCompletions = 0;
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    rom.writeCycleMicros = 5000;
+    rom.enableAsyncWrites(onAsyncWriteComplete, 8);
+
+    uint8_t data[100];
+    for(uint8_t i = 0; i < sizeof data; i++) data[i] = i + 1;
+
+    // seven page writes are queued, only the first is started, so it returns well within one write cycle
+    uint32_t started = micros();
+    rom.writeArrayToRom(0, data, sizeof data);
+    assertLess(micros() - started, (unsigned long)rom.writeCycleMicros);
+    assertTrue(rom.isWritePending());
+    assertEqual(rom.transactions, 1);
+
+    // reads of queued data come from the queue without touching the bus
+    rom.resetCounts();
+    assertEqual(rom.read8(50), (uint8_t)51);
+    assertEqual(rom.read32(96), (uint32_t)0x61626364UL);
+    assertEqual(rom.transactions, 0);
+
+    // the event polls the device and starts each page as the previous one finishes
+    taskManager.yieldForMicros(60000);
+    assertFalse(rom.isWritePending());
+    assertEqual(asyncCompletions, 1);
+    assertTrue(asyncSucceeded);
+    assertTrue(rom.readyPolls > 7);
+    for(uint8_t i = 0; i < sizeof data; i++) {
+        assertEqual(rom.memory[i], data[i]);
+    }
+    assertFalse(rom.hasErrorOccurred());
+}
+
+test(testAt24AsyncPartialReadWaitsForDevice) {
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24C32);
+    rom.writeCycleMicros = 5000;
+    rom.memory[201] = 0x55;
+    rom.enableAsyncWrites();
+
+    rom.write16(202, 0x1234);
+    assertTrue(rom.isWritePending());
+
+    // only part of this is in the queue, so the device is read once it is ready and the queue laid over it
+    assertEqual(rom.read32(200), (uint32_t)0x00551234UL);
+
+    rom.waitForPendingWrites();
+    assertFalse(rom.isWritePending());
+    assertEqual(rom.memory[202], 0x12);
+    assertEqual(rom.memory[203], 0x34);
+    assertFalse(rom.hasErrorOccurred());
+}
+
+#define LOG_KEY_COUNTER 1
+#define LOG_KEY_MENU 2
+#define LOG_KEY_VOLUME 3
+
+test(testEepromCrc16) {
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    assertEqual(eepromCrc16(check, sizeof check), (uint16_t)0x29B1);
+    // can be calculated in parts
+    assertEqual(eepromCrc16(&check[4], 5, eepromCrc16(check, 4)), (uint16_t)0x29B1);
+}
+
+test(testEepromLogStoreSurvivesRestart) {
+    WearCountingEepromAbstraction rom(300, 32);
+    EepromLogStore store(&rom, 0, 256);
+    store.begin();
+    assertEqual(store.getSlotCount(), (uint16_t)16);
+    assertEqual(store.readUint32(LOG_KEY_COUNTER, 99), (uint32_t)99);
+
+    for(uint32_t i = 0; i < 40; i++) {
+        assertTrue(store.writeUint32(LOG_KEY_COUNTER, i));
+        if((i % 10) == 0) assertTrue(store.writeUint32(LOG_KEY_MENU, i * 100));
+    }
+    uint8_t name[] = { 'v', 'o', 'l' };
+    assertTrue(store.writeValue(LOG_KEY_VOLUME, name, sizeof name));
+    assertEqual(store.getKeyCount(), (uint8_t)3);
+
+    // writing the same value again does not use a slot
+    uint32_t before = rom.getBytesWritten();
+    store.writeUint32(LOG_KEY_COUNTER, 39);
+    assertEqual(rom.getBytesWritten(), before);
+
+    EepromLogStore restarted(&rom, 0, 256);
+    restarted.begin();
+    assertEqual(restarted.getKeyCount(), (uint8_t)3);
+    assertEqual(restarted.readUint32(LOG_KEY_COUNTER), (uint32_t)39);
+    assertEqual(restarted.readUint32(LOG_KEY_MENU), (uint32_t)3000);
+    uint8_t readBack[EEPROM_LOG_VALUE_SIZE];
+    assertEqual(restarted.readValue(LOG_KEY_VOLUME, readBack, sizeof readBack), (uint8_t)3);
+    assertEqual(readBack[2], (uint8_t)'l');
+
+    // carries on from where it was, a further write is still the latest after another restart
+    restarted.writeUint32(LOG_KEY_COUNTER, 1000);
+    EepromLogStore again(&rom, 0, 256);
+    again.begin();
+    assertEqual(again.readUint32(LOG_KEY_COUNTER), (uint32_t)1000);
+    assertEqual(again.readUint32(LOG_KEY_MENU), (uint32_t)3000);
+}
+
+test(testEepromLogStoreIgnoresTornRecord) {
+    WearCountingEepromAbstraction rom(300, 32);
+    EepromLogStore store(&rom, 0, 256);
+    store.begin();
+    store.writeUint32(LOG_KEY_COUNTER, 1);
+    store.writeUint32(LOG_KEY_COUNTER, 2);
+
+    // the second record is in slot 1, damage it as if power was lost part way through writing it
+    rom.write8(EEPROM_LOG_SLOT_SIZE + 5, 0xAA);
+    EepromLogStore restarted(&rom, 0, 256);
+    restarted.begin();
+    assertEqual(restarted.readUint32(LOG_KEY_COUNTER), (uint32_t)1);
+}
+
+test(testEepromLogStoreWearSimulation) {
+    const uint16_t areaSize = 512;
+    const uint32_t counterUpdates = 2000;
+    WearCountingEepromAbstraction rom(areaSize + 16, 32);
+    EepromLogStore store(&rom, 0, areaSize);
+    store.begin();
+
+    // a counter changing all the time, and menu state that changes now and again.
+    for(uint32_t i = 0; i < counterUpdates; i++) {
+        store.writeUint32(LOG_KEY_COUNTER, i);
+        if((i % 50) == 0) store.writeUint32(LOG_KEY_MENU, i);
+        if((i % 200) == 0) store.writeUint32(LOG_KEY_VOLUME, i);
+        taskManager.yieldForMicros(100);
+    }
+
+    uint32_t minWear, maxWear;
+    rom.getWearRange(0, store.getSlotCount() * EEPROM_LOG_SLOT_SIZE, minWear, maxWear);
+    uint32_t logical = store.getRecordsWritten();
+    uint32_t physical = logical + store.getRecordsRelocated();
+    uint32_t payloadBytes = logical * 4;
+
+    // written in place, the counter's four bytes would each have been written counterUpdates times
+    serdebugF3("Log store records written, relocated: ", logical, store.getRecordsRelocated());
+    serdebugF3("Log store amplification x100 records, bytes: ", (physical * 100) / logical,
+               (rom.getBytesWritten() * 100) / payloadBytes);
+    serdebugF4("Log store wear per byte min, max, in place: ", minWear, maxWear, counterUpdates);
+
+    assertTrue((physical * 100) / logical < 120);
+    assertTrue(maxWear < counterUpdates / 20);
+    assertTrue(maxWear - minWear <= 2);
+    assertEqual(store.readUint32(LOG_KEY_COUNTER), counterUpdates - 1);
+    assertEqual(store.readUint32(LOG_KEY_VOLUME), (uint32_t)1800);
+}
+
+test(testAt24WideTransfersOnLargeDevice) {
+    // an AT24CM02 has 256KB, with the top two address bits in the device address, only 512 bytes around the 128KB
+    // boundary are simulated so that this can run on a board
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24CM02, 262144UL, 2, false, 0x20000UL - 256, 512);
+    assertEqual(rom.getPageSize(), (uint16_t)256);
+
+    uint8_t data[150];
+    for(size_t i = 0; i < sizeof data; i++) data[i] = uint8_t(i * 7);
+
+    // starts 100 bytes before the 128KB boundary, so the high bits change part way through
+    EepromWidePosition pos = 0x20000UL - 100;
+    rom.writeArrayToRomWide(pos, data, sizeof data);
+    assertFalse(rom.hasErrorOccurred());
+    assertEqual(rom.at(pos), data[0]);
+    assertEqual(rom.at(0x20000UL), data[100]);
+    assertEqual(rom.at(pos + 149), data[149]);
+    assertEqual(rom.at(pos - 1), 0);
+
+    // reads stream straight into the buffer in wire buffer sized bursts, ignoring page boundaries
+    uint8_t readBack[150];
+    rom.resetCounts();
+    rom.readIntoMemArrayWide(readBack, pos, sizeof readBack);
+    assertEqual(memcmp(data, readBack, sizeof data), 0);
+    // 100 bytes up to the 128KB boundary, then 50 after it
+    assertEqual(rom.transactions, 2 * ((100 + AT24_MAX_READ_BURST - 1) / AT24_MAX_READ_BURST +
+                                       (50 + AT24_MAX_READ_BURST - 1) / AT24_MAX_READ_BURST));
+}
+
+test(testAt24MbedAddressKeepsReadWriteBit) {
+    // on mbed the address is given in 8 bit form, the high memory bits must not land on the read/write bit
+    SimulatedAt24Eeprom rom(PAGESIZE_AT24CM02, 262144UL, 2, true, 0x30000UL, 64);
+    uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    rom.writeArrayToRomWide(0x30000UL, data, sizeof data);
+    assertFalse(rom.hasErrorOccurred());
+    assertEqual(rom.wrongAddresses, 0);
+    assertEqual(rom.at(0x30000UL), (uint8_t)1);
+
+    uint8_t readBack[8];
+    rom.readIntoMemArrayWide(readBack, 0x30000UL, sizeof readBack);
+    assertEqual(memcmp(data, readBack, sizeof data), 0);
+    assertEqual(rom.wrongAddresses, 0);
+}
+
+test(testWideShimOnSmallerRom) {
+    // just over the 255 byte chunk of the shim
+    MockEepromAbstraction rom(300);
+    uint8_t data[260];
+    for(size_t i = 0; i < sizeof data; i++) data[i] = uint8_t(i);
+    rom.writeArrayToRomWide(10, data, sizeof data);
+
+    uint8_t readBack[260];
+    rom.readIntoMemArrayWide(readBack, 10, sizeof readBack);
+    assertEqual(memcmp(data, readBack, sizeof data), 0);
+    assertEqual(rom.read8(10 + 259), (uint8_t)3);
+}
+
+struct TestSettings {
+    uint16_t volume;
+    uint8_t name[10];
+    uint32_t counter;
+};
+
+test(testEepromRecordStoreSavesAndRestores) {
+    WearCountingEepromAbstraction rom(200, 32);
+    TestSettings settings = { 10, "default", 0 };
+    uint8_t brightness = 50;
+    EepromRecordStore store(&rom, 16);
+    assertEqual(store.addRecord(&settings, 1), 0);
+    assertEqual(store.addRecord(&brightness), 1);
+    assertEqual(store.getEndPosition(), EepromPosition(16 + 2 * (sizeof(TestSettings) + 6) + 2 * 7));
+
+    // nothing stored yet, so the defaults are kept
+    assertEqual(store.begin(), (uint8_t)0);
+    assertEqual(settings.volume, (uint16_t)10);
+    assertFalse(store.isStored(0));
+
+    settings.volume = 20;
+    settings.counter = 12345;
+    assertTrue(store.save(0));
+    assertTrue(store.save(1));
+    settings.volume = 30;
+    assertTrue(store.save(0));
+    assertEqual(store.getGeneration(0), (uint8_t)1);
+
+    // saving without a change does not write anything
+    uint32_t before = rom.getBytesWritten();
+    assertTrue(store.save(0));
+    assertEqual(rom.getBytesWritten(), before);
+
+    TestSettings loaded = {};
+    uint8_t loadedBrightness = 0;
+    EepromRecordStore restarted(&rom, 16);
+    restarted.addRecord(&loaded, 1);
+    restarted.addRecord(&loadedBrightness);
+    assertEqual(restarted.begin(), (uint8_t)2);
+    assertEqual(loaded.volume, (uint16_t)30);
+    assertEqual(loaded.counter, (uint32_t)12345);
+    assertEqual(loadedBrightness, (uint8_t)50);
+    assertEqual(restarted.getGeneration(0), (uint8_t)1);
+
+    // a different version is not loaded
+    TestSettings otherVersion = {};
+    EepromRecordStore upgraded(&rom, 16);
+    upgraded.addRecord(&otherVersion, 2);
+    assertEqual(upgraded.begin(), (uint8_t)0);
+    assertEqual(otherVersion.volume, (uint16_t)0);
+}
+
+test(testEepromRecordStoreSurvivesTornSave) {
+    WearCountingEepromAbstraction rom(200, 32);
+    TestSettings settings = { 1, "first", 1 };
+    EepromRecordStore store(&rom, 0);
+    store.addRecord(&settings);
+    store.begin();
+    assertTrue(store.save(0));
+
+    // the second save goes into the other copy, damage it as if power was lost part way through
+    settings.volume = 2;
+    assertTrue(store.save(0));
+    const EepromPosition copySize = sizeof(TestSettings) + EEPROM_RECORD_OVERHEAD;
+    rom.write8(copySize + 8, 0xAA);
+
+    TestSettings loaded = {};
+    EepromRecordStore restarted(&rom, 0);
+    restarted.addRecord(&loaded);
+    assertEqual(restarted.begin(), (uint8_t)1);
+    assertEqual(loaded.volume, (uint16_t)1);
+    assertEqual(restarted.getGeneration(0), (uint8_t)0);
+
+    // the next save overwrites the damaged copy and leaves the good one alone
+    loaded.volume = 3;
+    assertTrue(restarted.save(0));
+    TestSettings again = {};
+    EepromRecordStore third(&rom, 0);
+    third.addRecord(&again);
+    assertEqual(third.begin(), (uint8_t)1);
+    assertEqual(again.volume, (uint16_t)3);
+    assertEqual(rom.read8(1), (uint8_t)0);
+}
+
+test(testEepromRecordStoreGenerationWraps) {
+    MockEepromAbstraction rom(100);
+    uint32_t value = 0;
+    EepromRecordStore store(&rom, 0);
+    store.addRecord(&value);
+    store.begin();
+    for(value = 1; value <= 300; value++) {
+        assertTrue(store.save(0));
+    }
+
+    uint32_t loaded = 0;
+    EepromRecordStore restarted(&rom, 0);
+    restarted.addRecord(&loaded);
+    restarted.begin();
+    assertEqual(loaded, (uint32_t)300);
+    assertEqual(restarted.getGeneration(0), uint8_t(299));
+}
+
+#if defined(__linux__) && defined(IOA_USE_POSIX_EXTRAS)
+
+test(testFileBackedEepromPersists) {
+    const char* fileName = "ioaFileBackedTest.rom";
+    remove(fileName);
+    {
+        FileBackedEepromAbstraction rom(fileName, 1024, 32);
+        assertTrue(rom.isOpen());
+        assertEqual(rom.read8(1000), (uint8_t)0xff);
+        rom.write32(10, 0x12345678UL);
+        rom.write16(40, 0xABCD);
+
+        uint8_t data[100];
+        for(size_t i = 0; i < sizeof data; i++) data[i] = uint8_t(i);
+        rom.writeArrayToRomWide(200, data, sizeof data);
+        assertFalse(rom.hasErrorOccurred());
+        assertEqual(memcmp(rom.getMappedData() + 200, data, sizeof data), 0);
+
+        // 200 to 299 is pages 6 to 9, so four write cycles and one write across pages
+        assertEqual(rom.getWearAt(200), (uint32_t)1);
+        assertEqual(rom.getWriteCycles(), (uint32_t)6);
+        assertEqual(rom.getCrossPageWrites(), (uint32_t)1);
+        rom.write8(0, 1);
+        assertEqual(rom.getWearAt(31), (uint32_t)2);
+        assertEqual(rom.getMaxWear(), (uint32_t)2);
+
+        // out of range is reported and does not touch the mapping
+        rom.writeArrayToRomWide(1000, data, sizeof data);
+        assertTrue(rom.hasErrorOccurred());
+        assertFalse(rom.hasErrorOccurred());
+    }
+
+    FileBackedEepromAbstraction reopened(fileName, 1024, 32);
+    assertEqual(reopened.read32(10), (uint32_t)0x12345678UL);
+    assertEqual(reopened.read16(40), (uint16_t)0xABCD);
+    assertEqual(reopened.read8(299), (uint8_t)99);
+    assertEqual(reopened.getWriteCycles(), (uint32_t)0);
+    remove(fileName);
+}
+
+#endif
+
+#ifdef IOA_STM32_BACKUP_RAM_SIMULATION
+
+test(testHalStm32CommitsOnlyDirtyWords) {
+    memset(ioaSimulatedBackupRam, 0, sizeof ioaSimulatedBackupRam);
+    ioaSimulatedBackupRam[(64 / 4) + 2] = 0x11223344UL;
+    HalStm32EepromAbstraction rom;
+    rom.initialise(64);
+    assertEqual(rom.read32(8), (uint32_t)0x11223344UL);
+
+    // the same value does not mark the word, so commit does not even enable the clock
+    uint32_t enables = ioaSimulatedBackupClockEnables;
+    rom.write32(8, 0x11223344UL);
+    assertEqual(rom.getDirtyWordCount(), (uint16_t)0);
+    rom.commit();
+    assertEqual(ioaSimulatedBackupClockEnables, enables);
+
+    // an unaligned 32 bit write covers two words, and a byte in a far word is a third
+    rom.write32(2, 0xAABBCCDDUL);
+    rom.write8(500, 0x55);
+    assertEqual(rom.getDirtyWordCount(), (uint16_t)3);
+
+    // change the backup directly in a word that is not dirty, commit must leave it alone
+    ioaSimulatedBackupRam[(64 / 4) + 10] = 0xdeadbeefUL;
+    rom.commit();
+    assertEqual(ioaSimulatedBackupClockEnables, enables + 1);
+    assertEqual(rom.getDirtyWordCount(), (uint16_t)0);
+    assertEqual(ioaSimulatedBackupRam[(64 / 4) + 10], (uint32_t)0xdeadbeefUL);
+
+    HalStm32EepromAbstraction reloaded;
+    reloaded.initialise(64);
+    assertEqual(reloaded.read32(2), (uint32_t)0xAABBCCDDUL);
+    assertEqual(reloaded.read8(500), (uint8_t)0x55);
+    assertEqual(reloaded.read32(40), (uint32_t)0xdeadbeefUL);
+    assertFalse(reloaded.hasErrorOccurred());
+}
+
+test(testHalStm32AutoCommitCoalescesWrites) {
+    memset(ioaSimulatedBackupRam, 0, sizeof ioaSimulatedBackupRam);
+    HalStm32EepromAbstraction rom;
+    rom.initialise(0);
+    rom.setAutoCommit(2);
+    uint32_t enables = ioaSimulatedBackupClockEnables;
+
+    for(int i = 0; i < 20; i++) {
+        rom.write16(i * 8, 1000 + i);
+    }
+    assertEqual(rom.getDirtyWordCount(), (uint16_t)20);
+    assertEqual(ioaSimulatedBackupRam[0], (uint32_t)0);
+
+    taskManager.yieldForMicros(5000);
+    assertEqual(rom.getDirtyWordCount(), (uint16_t)0);
+    assertEqual(ioaSimulatedBackupClockEnables, enables + 1);
+    assertEqual(ioaSimulatedBackupRam[38], (uint32_t)1019);
+
+    // destroying it with an auto commit pending commits straight away and cancels the timer
+    {
+        HalStm32EepromAbstraction temporary;
+        temporary.initialise(0);
+        temporary.setAutoCommit(2);
+        temporary.write32(200, 0x12345678UL);
+    }
+    assertEqual(ioaSimulatedBackupRam[50], (uint32_t)0x12345678UL);
+    taskManager.yieldForMicros(5000);
+}
+
+#endif
+
+#ifdef IOA_EEPROM_NEEDS_COMMIT
+
+test(testArduinoEepromCommitsOncePerSave) {
+    EEPROM.begin(512);
+    ArduinoEEPROMAbstraction rom(&EEPROM, 2);
+    rom.commit();
+    uint32_t commits = rom.getCommitCount();
+
+    // a whole save of settings, made up of many writes, is committed once after it goes idle
+    uint8_t name[20];
+    for(size_t i = 0; i < sizeof name; i++) name[i] = uint8_t('A' + i);
+    rom.writeArrayToRom(100, name, sizeof name);
+    rom.write16(130, 0x1234);
+    rom.write32(140, 0xCAFEBABEUL);
+    assertTrue(rom.isCommitPending());
+    taskManager.yieldForMicros(5000);
+    assertFalse(rom.isCommitPending());
+    assertEqual(rom.getCommitCount(), commits + 1);
+
+    // saving the same values again changes nothing, so there is nothing to commit
+    rom.writeArrayToRom(100, name, sizeof name);
+    rom.write32(140, 0xCAFEBABEUL);
+    assertFalse(rom.isCommitPending());
+    assertTrue(rom.commit());
+    assertEqual(rom.getCommitCount(), commits + 1);
+
+    uint8_t readBack[20];
+    rom.readIntoMemArray(readBack, 100, sizeof readBack);
+    assertEqual(memcmp(readBack, name, sizeof name), 0);
+    assertEqual(rom.read16(130), (uint16_t)0x1234);
+    assertEqual(rom.read32(140), (uint32_t)0xCAFEBABEUL);
+    assertFalse(rom.hasErrorOccurred());
+
+    // destroying it with changes pending commits them straight away and cancels the idle timer
+    {
+        ArduinoEEPROMAbstraction temporary(&EEPROM, 2);
+        temporary.write8(160, uint8_t(temporary.read8(160) + 1));
+        assertTrue(temporary.isCommitPending());
+        rom.write8(161, uint8_t(rom.read8(161) + 1));
+    }
+    taskManager.yieldForMicros(5000);
+    assertEqual(rom.getCommitCount(), commits + 2);
+}
+
+#endif
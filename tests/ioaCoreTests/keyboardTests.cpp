@@ -0,0 +1,227 @@
+#include <AUnit.h>
+#include "MockIoAbstraction.h"
+#include "KeyboardManager.h"
+
+class RecordingKeyboardListener : public KeyboardListener {
+public:
+    int pressCount = 0;
+    int releaseCount = 0;
+    int heldCount = 0;
+    char lastPressed = 0;
+    char lastReleased = 0;
+
+    void keyPressed(char key, bool held) override {
+        if(held) heldCount++; else pressCount++;
+        lastPressed = key;
+    }
+
+    void keyReleased(char key) override {
+        releaseCount++;
+        lastReleased = key;
+    }
+};
+
+const char TEST_KEYS_4X4[] PROGMEM = "123A456B789C*0#D";
+
+// with a mock of four cycles, and one sync per column, column 0 reads slot 1, column 1 slot 2 and so on.
+void setKeyboardRowsForColumn(MockedIoAbstraction& mockIo, int col, uint16_t rowsLow) {
+    mockIo.setValueForReading((col + 1) % 4, ~rowsLow);
+}
+
+test(testPortWideKeyboardRollover) {
+    taskManager.reset();
+    MockedIoAbstraction mockIo(4);
+    KeyboardLayout layout(4, 4, TEST_KEYS_4X4);
+    for(int i = 0; i < 4; i++) {
+        layout.setRowPin(i, i);
+        layout.setColPin(i, 8 + i);
+    }
+    RecordingKeyboardListener listener;
+    MatrixKeyboardManager keyboard;
+    keyboard.setScanMode(KEYBOARD_SCAN_PORT_WIDE);
+    keyboard.initialise(&mockIo, &layout, &listener);
+    assertEqual(KEYBOARD_SCAN_PORT_WIDE, keyboard.getScanMode());
+
+    mockIo.resetIo();
+    for(int c = 0; c < 4; c++) setKeyboardRowsForColumn(mockIo, c, 0);
+
+    // press '1' (row 0, col 0) and '6' (row 1, col 2) together, reported only after debounce
+    setKeyboardRowsForColumn(mockIo, 0, 0x01);
+    setKeyboardRowsForColumn(mockIo, 2, 0x02);
+    keyboard.exec();
+    assertEqual(0, listener.pressCount);
+    assertEqual(0, mockIo.getNumberOfRunLoops()); // exactly one sync per column
+    keyboard.exec();
+    assertEqual(2, listener.pressCount);
+    assertTrue(keyboard.isKeyDown(0, 0));
+    assertTrue(keyboard.isKeyDown(1, 2));
+    assertFalse(keyboard.isKeyDown(1, 0));
+    assertEqual('6', listener.lastPressed);
+
+    // release '1' only, '6' stays down
+    setKeyboardRowsForColumn(mockIo, 0, 0);
+    keyboard.exec();
+    keyboard.exec();
+    assertEqual(1, listener.releaseCount);
+    assertEqual('1', listener.lastReleased);
+    assertTrue(keyboard.isKeyDown(1, 2));
+
+    // rows 1 and 2 sharing columns 0 and 2 could contain a ghost, the scan must be ignored
+    setKeyboardRowsForColumn(mockIo, 0, 0x06);
+    setKeyboardRowsForColumn(mockIo, 2, 0x06);
+    keyboard.exec();
+    keyboard.exec();
+    assertTrue(keyboard.isGhostDetected());
+    assertEqual(2, listener.pressCount);
+    assertFalse(keyboard.isKeyDown(2, 0));
+
+    taskManager.reset();
+}
+
+test(testPortWideFallsBackWhenPinsSpanPorts) {
+    taskManager.reset();
+    MockedIoAbstraction mockIo(4);
+    KeyboardLayout layout(2, 2, TEST_KEYS_4X4);
+    layout.setRowPin(0, 0);
+    layout.setRowPin(1, 9);
+    layout.setColPin(0, 10);
+    layout.setColPin(1, 11);
+    RecordingKeyboardListener listener;
+    MatrixKeyboardManager keyboard;
+    keyboard.setScanMode(KEYBOARD_SCAN_PORT_WIDE);
+    keyboard.initialise(&mockIo, &layout, &listener);
+    assertEqual(KEYBOARD_SCAN_PIN_BY_PIN, keyboard.getScanMode());
+    taskManager.reset();
+}
+
+test(testKeyboardIdleInterruptWake) {
+    taskManager.reset();
+    MockedIoAbstraction mockIo(6);
+    KeyboardLayout layout(2, 2, TEST_KEYS_4X4);
+    layout.setRowPin(0, 0);
+    layout.setRowPin(1, 1);
+    layout.setColPin(0, 8);
+    layout.setColPin(1, 9);
+    RecordingKeyboardListener listener;
+    MatrixKeyboardManager keyboard;
+    keyboard.setUsingIdleInterrupt(true);
+    keyboard.initialise(&mockIo, &layout, &listener);
+    assertTrue(mockIo.isIntRegisteredAs(1, CHANGE));
+
+    // no keys are pressed, rows read high in every slot
+    for(int i = 0; i < 6; i++) mockIo.setValueForReading(i, 0xffff);
+    for(int i = 0; i < KEYBOARD_IDLE_SCANS; i++) {
+        assertFalse(keyboard.isIdle());
+        keyboard.exec();
+    }
+    assertTrue(keyboard.isIdle());
+
+    // all the columns must now be driven low, so any key press raises the interrupt
+    assertEqual((uint16_t)0, (uint16_t)(mockIo.getWrittenValue(mockIo.getNumberOfRunLoops()) & 0x0300));
+
+    // interrupt while idle wakes up scanning on the next task manager loop
+    mockIo.getInterruptFunction()();
+    taskManager.yieldForMicros(1000);
+    assertFalse(keyboard.isIdle());
+    taskManager.reset();
+}
+
+test(testKeyboardDestroyedLeavesNothingScheduled) {
+    taskManager.reset();
+    MockedIoAbstraction mockIo(6);
+    KeyboardLayout layout(2, 2, TEST_KEYS_4X4);
+    layout.setRowPin(0, 0);
+    layout.setRowPin(1, 1);
+    layout.setColPin(0, 8);
+    layout.setColPin(1, 9);
+    RecordingKeyboardListener listener;
+    for(int i = 0; i < 6; i++) mockIo.setValueForReading(i, 0xfffe);
+    {
+        MatrixKeyboardManager keyboard;
+        keyboard.setUsingIdleInterrupt(true);
+        keyboard.initialise(&mockIo, &layout, &listener);
+    }
+
+    // neither the row interrupt nor task manager can reach the keyboard once it has gone
+    mockIo.getInterruptFunction()();
+    taskManager.yieldForMicros(100000UL);
+    assertEqual(0, listener.pressCount);
+    taskManager.reset();
+}
+
+const uint16_t TEST_KEY_CODES_4X8[] PROGMEM = {
+    0x1000, 0x1001, 0x1002, 0x1003, 0x1004, 0x1005, 0x1006, 0x1007,
+    0x1100, 0x1101, 0x1102, 0x1103, 0x1104, 0x1105, 0x1106, 0x1107,
+    0x1200, 0x1201, 0x1202, 0x1203, 0x1204, 0x1205, 0x1206, 0x1207,
+    0x1300, 0x1301, 0x1302, 0x1303, 0x1304, 0x1305, 0x1306, 0x1307
+};
+
+class KeyCodeListener : public KeyboardListener {
+public:
+    int pressCount = 0;
+    int heldCount = 0;
+    int releaseCount = 0;
+    uint16_t lastPressed = 0;
+    uint16_t lastReleased = 0;
+
+    void keyPressed(char, bool) override { }
+    void keyReleased(char) override { }
+
+    void keyCodePressed(uint16_t code, bool held) override {
+        if(held) heldCount++; else pressCount++;
+        lastPressed = code;
+    }
+
+    void keyCodeReleased(uint16_t code) override {
+        releaseCount++;
+        lastReleased = code;
+    }
+};
+
+test(testLargeKeyboardIndependentKeys) {
+    taskManager.reset();
+    MockedIoAbstraction mockIo(8);
+    KeyboardLayout layout(4, 8, TEST_KEY_CODES_4X8);
+    for(int i = 0; i < 4; i++) layout.setRowPin(i, i);
+    for(int i = 0; i < 8; i++) layout.setColPin(i, 8 + i);
+    KeyCodeListener listener;
+    LargeMatrixKeyboardManager keyboard;
+    keyboard.initialise(&mockIo, &layout, &listener);
+    keyboard.setRepeatKeyMillis(30, 20);
+    assertEqual((uint16_t)0x1203, layout.keyCodeFor(2, 3));
+
+    // with eight cycles and one sync per column, column c is read from slot c + 1.
+    mockIo.resetIo();
+    for(int i = 0; i < 8; i++) mockIo.setValueForReading(i, 0xffff);
+    mockIo.setValueForReading(1, 0xfffe);   // row 0, col 0
+    mockIo.setValueForReading(0, 0xfff7);   // row 3, col 7
+
+    // four consistent scans are needed before the keys are pressed
+    for(int i = 0; i < 3; i++) keyboard.exec();
+    assertEqual(0, listener.pressCount);
+    keyboard.exec();
+    assertEqual(2, listener.pressCount);
+    assertTrue(keyboard.isKeyDown(0, 0));
+    assertTrue(keyboard.isKeyDown(3, 7));
+
+    // a third key goes down while the others are held, and each repeats on its own
+    mockIo.setValueForReading(4, 0xfffd);   // row 1, col 3
+    for(int i = 0; i < 4; i++) keyboard.exec();
+    assertEqual(3, listener.pressCount);
+    assertTrue(keyboard.isKeyDown(1, 3));
+    assertEqual(2, listener.heldCount);
+
+    // a single scan glitch on one key does not release it
+    mockIo.setValueForReading(1, 0xffff);
+    keyboard.exec();
+    mockIo.setValueForReading(1, 0xfffe);
+    keyboard.exec();
+    assertEqual(0, listener.releaseCount);
+
+    // releasing everything, each key is released
+    for(int i = 0; i < 8; i++) mockIo.setValueForReading(i, 0xffff);
+    for(int i = 0; i < 4; i++) keyboard.exec();
+    assertEqual(3, listener.releaseCount);
+    assertFalse(keyboard.isKeyDown(1, 3));
+    taskManager.reset();
+}
@@ -0,0 +1,127 @@
+#include <AUnit.h>
+#include "MockIoAbstraction.h"
+#include "RecordingIoAbstraction.h"
+
+int replayInterrupts;
+
+void replayInterruptHandler() {
+    replayInterrupts++;
+}
+
+test(testTraceBufferEncodesTimeGaps) {
+    IoTraceBuffer trace(20);
+    assertTrue(trace.append(IOTRACE_READ_VALUE, 2, 1, 100));
+    assertTrue(trace.append(IOTRACE_SYNC, 0, 1, 200000UL));
+    assertEqual((size_t)15, trace.size());
+
+    IoTraceRecord rec;
+    assertTrue(trace.next(rec));
+    assertEqual(IOTRACE_READ_VALUE, rec.type);
+    assertEqual((uint8_t)2, rec.pin);
+    assertEqual((uint32_t)100, rec.deltaMicros);
+    assertTrue(trace.next(rec));
+    assertEqual(IOTRACE_SYNC, rec.type);
+    assertEqual((uint32_t)200000UL, rec.deltaMicros);
+    assertFalse(trace.next(rec));
+
+    // there is room for exactly one more record, after that the buffer overflows.
+    assertTrue(trace.append(IOTRACE_SYNC, 0, 1, 10));
+    assertFalse(trace.hasOverflowed());
+    assertFalse(trace.append(IOTRACE_SYNC, 0, 1, 10));
+    assertTrue(trace.hasOverflowed());
+}
+
+test(testRecordAndReplayInput) {
+    taskManager.reset();
+    MockedIoAbstraction mockIo;
+    IoTraceBuffer trace(256);
+    RecordingIoAbstraction recorder(&mockIo, &trace);
+    replayInterrupts = 0;
+
+    ioDevicePinMode(&recorder, 2, INPUT);
+    ioDeviceAttachInterrupt(&recorder, 2, replayInterruptHandler, CHANGE);
+    mockIo.setValueForReading(1, 0x0004);
+    mockIo.setValueForReading(2, 0x0004);
+
+    // record three syncs 10ms apart, the pin changes to high on the second one along with an interrupt
+    for(int i = 0; i < 3; i++) {
+        ioDeviceDigitalRead(&recorder, 2);
+        taskManager.yieldForMicros(10000);
+        ioDeviceSync(&recorder);
+        if(i == 0) mockIo.getInterruptFunction()();
+    }
+    ioDeviceDigitalRead(&recorder, 2);
+    assertEqual(1, replayInterrupts);
+    assertFalse(trace.hasOverflowed());
+
+    // now replay the trace at double speed, first the pin should read low, then high after the interrupt.
+    ReplayIoAbstraction replay(&trace);
+    ioDeviceAttachInterrupt(&replay, 2, replayInterruptHandler, CHANGE);
+    replayInterrupts = 0;
+    replay.start(2);
+    taskManager.yieldForMicros(1000);
+    assertEqual(LOW, ioDeviceDigitalRead(&replay, 2));
+    taskManager.yieldForMicros(5000);
+    assertEqual(1, replayInterrupts);
+    assertEqual(HIGH, ioDeviceDigitalReadS(&replay, 2));
+    taskManager.yieldForMicros(15000);
+    assertTrue(replay.isFinished());
+    assertEqual((uint32_t)3, replay.getRecordedSyncCount());
+    assertEqual((uint32_t)1, replay.getReplaySyncCount());
+    taskManager.reset();
+}
+
+test(testRecorderReleasesInterruptSlots) {
+    MockedIoAbstraction mockIo;
+    IoTraceBuffer trace(64);
+    {
+        RecordingIoAbstraction recorder(&mockIo, &trace);
+        ioDeviceAttachInterrupt(&recorder, 3, replayInterruptHandler, CHANGE);
+        assertTrue(mockIo.getInterruptFunction() != replayInterruptHandler);
+    }
+    // once the recorder has gone, the handler is attached directly and every slot is free again
+    assertTrue(mockIo.getInterruptFunction() == replayInterruptHandler);
+
+    RecordingIoAbstraction another(&mockIo, &trace);
+    for(pinid_t pin = 0; pin < IOTRACE_MAX_INTERRUPTS; pin++) {
+        ioDeviceAttachInterrupt(&another, pin, replayInterruptHandler, CHANGE);
+        assertTrue(mockIo.getInterruptFunction() != replayInterruptHandler);
+    }
+}
+
+// every pin reads high and every port 0xa5, so that pins beyond the 16 of the mock can be recorded
+class HighPinsIoAbstraction : public BasicIoAbstraction {
+public:
+    void pinDirection(pinid_t, uint8_t) override { }
+    void writeValue(pinid_t, uint8_t) override { }
+    uint8_t readValue(pinid_t) override { return HIGH; }
+    void writePort(pinid_t, uint8_t) override { }
+    uint8_t readPort(pinid_t) override { return 0xa5; }
+};
+
+test(testRecordAndReplayHighPins) {
+    taskManager.reset();
+    HighPinsIoAbstraction highIo;
+    IoTraceBuffer trace(64);
+    RecordingIoAbstraction recorder(&highIo, &trace);
+
+    // ESP32 input only GPIOs and Mega pins are above 32, anything past IOTRACE_MAX_PINS is flagged, not truncated
+    ioDeviceDigitalRead(&recorder, 35);
+    ioDeviceDigitalReadPort(&recorder, 64);
+    assertFalse(recorder.hasUnrecordedPins());
+    ioDeviceDigitalRead(&recorder, IOTRACE_MAX_PINS + 2);
+    assertTrue(recorder.hasUnrecordedPins());
+    assertEqual((size_t)(IOTRACE_RECORD_SIZE * 2), trace.size());
+
+    ReplayIoAbstraction replay(&trace);
+    replay.start();
+    taskManager.yieldForMicros(1000);
+    assertTrue(replay.isFinished());
+    assertEqual(HIGH, ioDeviceDigitalRead(&replay, 35));
+    assertEqual(LOW, ioDeviceDigitalRead(&replay, 34));
+    assertEqual((uint8_t)0xa5, ioDeviceDigitalReadPort(&replay, 64));
+    assertEqual(HIGH, ioDeviceDigitalRead(&replay, 64));
+    assertEqual(LOW, ioDeviceDigitalRead(&replay, 65));
+    assertEqual(LOW, ioDeviceDigitalRead(&replay, IOTRACE_MAX_PINS + 2));
+    taskManager.reset();
+}
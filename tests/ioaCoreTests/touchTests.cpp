@@ -0,0 +1,297 @@
+#include <AUnit.h>
+#include "MockAnalogDevice.h"
+#include "ResistiveTouchScreen.h"
+#include "TouchGestureRecogniser.h"
+#include "TouchCalibration.h"
+#include "MockEepromAbstraction.h"
+
+using namespace iotouch;
+
+// counts every call made to the device, so that the cost of a touch measurement can be checked
+class CountingIoAbstraction : public BasicIoAbstraction {
+public:
+    int pinModes = 0;
+    int writes = 0;
+    int syncs = 0;
+    uint8_t readLevel = HIGH;
+    pinid_t intPin = 0xff;
+    RawIntHandler intHandler = nullptr;
+
+    void reset() { pinModes = writes = syncs = 0; }
+    void pinDirection(pinid_t, uint8_t) override { pinModes++; }
+    void writeValue(pinid_t, uint8_t) override { writes++; }
+    uint8_t readValue(pinid_t) override { return readLevel; }
+    void attachInterrupt(pinid_t pin, RawIntHandler handler, uint8_t) override { intPin = pin; intHandler = handler; }
+    void writePort(pinid_t, uint8_t) override { writes++; }
+    uint8_t readPort(pinid_t) override { return 0; }
+    bool runLoop() override { syncs++; return true; }
+};
+
+#define TOUCH_XP_PIN 1
+#define TOUCH_XN_PIN 2
+#define TOUCH_YP_PIN 3
+#define TOUCH_YN_PIN 4
+
+test(testResistiveTouchOnlyChangesPinsThatDiffer) {
+    MockAnalogDevice analog(12);
+    CountingIoAbstraction io;
+    ResistiveTouchInterrogator interrogator(TOUCH_XP_PIN, TOUCH_XN_PIN, TOUCH_YP_PIN, TOUCH_YN_PIN, &analog, &io);
+    CalibrationHandler calibrator;
+    float x, y;
+
+    // not touched, X- is pulled low and Y+ high, only the pressure phase is measured
+    analog.setReadValue(TOUCH_XN_PIN, 0);
+    analog.setReadValue(TOUCH_YP_PIN, 4095);
+    assertEqual(NOT_TOUCHED, interrogator.internalProcessTouch(&x, &y, TouchInterrogator::RAW, calibrator));
+    assertEqual(4, io.pinModes);
+    assertEqual(1, io.syncs);
+    assertEqual(2U, analog.getConversionCount());
+
+    // by default the pins may be shared, so every measurement sets them again
+    io.reset();
+    analog.resetConversionCount();
+    assertEqual(NOT_TOUCHED, interrogator.internalProcessTouch(&x, &y, TouchInterrogator::RAW, calibrator));
+    assertEqual(4, io.pinModes);
+    assertEqual(2, io.writes);
+    assertEqual(1, io.syncs);
+
+    // when the pins are exclusive, polling again while untouched needs no pin changes at all
+    interrogator.setPinsExclusive(true);
+    interrogator.internalProcessTouch(&x, &y, TouchInterrogator::RAW, calibrator);
+    io.reset();
+    analog.resetConversionCount();
+    assertEqual(NOT_TOUCHED, interrogator.internalProcessTouch(&x, &y, TouchInterrogator::RAW, calibrator));
+    assertEqual(0, io.pinModes);
+    assertEqual(0, io.writes);
+    assertEqual(0, io.syncs);
+    assertEqual(2U, analog.getConversionCount());
+
+    // touched, each axis is the median of several samples, and a full cycle costs three syncs
+    analog.setReadValue(TOUCH_XN_PIN, 1024);
+    analog.setReadValue(TOUCH_YP_PIN, 2048);
+    assertEqual(TOUCHED, interrogator.internalProcessTouch(&x, &y, TouchInterrogator::RAW, calibrator));
+    io.reset();
+    analog.resetConversionCount();
+    assertEqual(TOUCHED, interrogator.internalProcessTouch(&x, &y, TouchInterrogator::RAW, calibrator));
+    assertEqual(2U + (TOUCH_MEDIAN_SAMPLES * 2), analog.getConversionCount());
+    assertEqual(3, io.syncs);
+    assertEqual(8, io.pinModes);
+    assertEqual(6, io.writes);
+    assertNear(0.5F, x, 0.001F);
+    assertNear(0.25F, y, 0.001F);
+    assertNear(0.75F, interrogator.getTouchPressure(), 0.001F);
+}
+
+test(testTouchCalibrationFixedPoint) {
+    CalibrationHandler calibrator;
+    calibrator.setCalibrationValues(0.25F, 0.75F, 0.1F, 0.9F);
+    assertNear(0.5F, analogFixedToFloat(calibrator.calibrateXFixed(analogFixedFromFloat(0.5F), false)), 0.001F);
+    assertNear(0.0F, analogFixedToFloat(calibrator.calibrateXFixed(analogFixedFromFloat(0.1F), false)), 0.001F);
+    assertNear(1.0F, analogFixedToFloat(calibrator.calibrateXFixed(analogFixedFromFloat(0.8F), false)), 0.001F);
+    assertNear(0.75F, analogFixedToFloat(calibrator.calibrateYFixed(analogFixedFromFloat(0.3F), true)), 0.001F);
+    assertNear(calibrator.calibrateY(0.7F, false),
+               analogFixedToFloat(calibrator.calibrateYFixed(analogFixedFromFloat(0.7F), false)), 0.001F);
+}
+
+test(testTouchWakeStopsPollingUntilInterrupt) {
+    taskManager.reset();
+    MockAnalogDevice analog(12);
+    CountingIoAbstraction io;
+    ResistiveTouchInterrogator interrogator(TOUCH_XP_PIN, TOUCH_XN_PIN, TOUCH_YP_PIN, TOUCH_YN_PIN, &analog, &io);
+    ValueStoringResistiveTouchScreen touchScreen(interrogator, TouchInterrogator::RAW);
+    analog.setReadValue(TOUCH_XN_PIN, 0);
+    analog.setReadValue(TOUCH_YP_PIN, 4095);
+
+    // the first untouched poll arms the wake interrupt on Y+ and then polling stops
+    touchScreen.setUsingTouchWake(true);
+    touchScreen.start();
+    taskManager.yieldForMicros(1000);
+    assertTrue(touchScreen.isWaitingForTouch());
+    assertEqual((pinid_t)TOUCH_YP_PIN, io.intPin);
+    analog.resetConversionCount();
+    taskManager.yieldForMicros(500000UL);
+    assertEqual(0U, analog.getConversionCount());
+
+    // a touch raises the interrupt, and the touch is measured on the next task manager loop
+    analog.setReadValue(TOUCH_XN_PIN, 1024);
+    analog.setReadValue(TOUCH_YP_PIN, 2048);
+    io.intHandler();
+    taskManager.yieldForMicros(1000);
+    assertFalse(touchScreen.isWaitingForTouch());
+    assertEqual(TOUCHED, touchScreen.getTouchState());
+    assertNear(0.75F, touchScreen.getTouchPressure(), 0.001F);
+
+    // if the panel is still touched once armed, it keeps polling instead of waiting
+    analog.setReadValue(TOUCH_XN_PIN, 0);
+    analog.setReadValue(TOUCH_YP_PIN, 4095);
+    io.readLevel = LOW;
+    taskManager.yieldForMicros(50000UL);
+    assertFalse(touchScreen.isWaitingForTouch());
+    io.readLevel = HIGH;
+    taskManager.yieldForMicros(150000UL);
+    assertTrue(touchScreen.isWaitingForTouch());
+    taskManager.reset();
+}
+
+test(testTouchScreenDestroyedLeavesNothingScheduled) {
+    taskManager.reset();
+    MockAnalogDevice analog(12);
+    CountingIoAbstraction io;
+    ResistiveTouchInterrogator interrogator(TOUCH_XP_PIN, TOUCH_XN_PIN, TOUCH_YP_PIN, TOUCH_YN_PIN, &analog, &io);
+    analog.setReadValue(TOUCH_XN_PIN, 1024);
+    analog.setReadValue(TOUCH_YP_PIN, 2048);
+    {
+        // one screen destroyed while polling, and one while waiting for the touch interrupt
+        ValueStoringResistiveTouchScreen polling(interrogator, TouchInterrogator::RAW);
+        polling.start();
+        taskManager.yieldForMicros(1000);
+
+        analog.setReadValue(TOUCH_XN_PIN, 0);
+        analog.setReadValue(TOUCH_YP_PIN, 4095);
+        ValueStoringResistiveTouchScreen waiting(interrogator, TouchInterrogator::RAW);
+        waiting.setUsingTouchWake(true);
+        waiting.start();
+        taskManager.yieldForMicros(200000UL);
+        assertTrue(waiting.isWaitingForTouch());
+    }
+
+    analog.resetConversionCount();
+    io.intHandler();
+    taskManager.yieldForMicros(100000UL);
+    assertEqual(0U, analog.getConversionCount());
+    taskManager.reset();
+}
+
+class RecordingGestureListener : public TouchGestureListener {
+public:
+    TouchGestureEvent events[16];
+    int count = 0;
+
+    void onGesture(const TouchGestureEvent& gesture) override {
+        if(count < 16) events[count++] = gesture;
+    }
+
+    const TouchGestureEvent& last() const { return events[count - 1]; }
+};
+
+#define GESTURE_POS(x) analogFixedFromFloat(x)
+
+test(testGestureTapDoubleTapAndLongPress) {
+    RecordingGestureListener listener;
+    TouchGestureRecogniser recogniser(&listener);
+
+    // a short press is a tap, and another close by soon after is a double tap
+    recogniser.addSample(GESTURE_POS(0.5F), GESTURE_POS(0.5F), true, 1000);
+    recogniser.addSample(GESTURE_POS(0.505F), GESTURE_POS(0.5F), true, 1020);
+    recogniser.addSample(0, 0, false, 1040);
+    assertEqual(1, listener.count);
+    assertEqual(GESTURE_TAP, listener.last().type);
+    recogniser.addSample(GESTURE_POS(0.51F), GESTURE_POS(0.5F), true, 1200);
+    recogniser.addSample(0, 0, false, 1240);
+    assertEqual(2, listener.count);
+    assertEqual(GESTURE_DOUBLE_TAP, listener.last().type);
+
+    // held still, the long press is reported while still touched and there is no tap on release
+    for(uint32_t t = 5000; t <= 5800; t += 20) recogniser.addSample(GESTURE_POS(0.2F), GESTURE_POS(0.3F), true, t);
+    assertEqual(3, listener.count);
+    assertEqual(GESTURE_LONG_PRESS, listener.last().type);
+    recogniser.addSample(0, 0, false, 5820);
+    assertEqual(3, listener.count);
+}
+
+test(testGestureDragAndSwipe) {
+    RecordingGestureListener listener;
+    TouchGestureRecogniser recogniser(&listener);
+
+    // a slow drag to the right, reported incrementally with no swipe at the end
+    uint32_t t = 1000;
+    for(int i = 0; i <= 10; i++, t += 100) recogniser.addSample(GESTURE_POS(0.2F + (i * 0.01F)), GESTURE_POS(0.5F), true, t);
+    recogniser.addSample(0, 0, false, t);
+    assertEqual(GESTURE_DRAG_START, listener.events[0].type);
+    assertEqual(GESTURE_DRAG, listener.events[1].type);
+    assertTrue(listener.events[1].deltaX > 0);
+    assertEqual(GESTURE_DRAG_END, listener.last().type);
+    assertNear(0.1F * 32767.0F, (float)listener.last().deltaX, 40.0F);
+    for(int i = 0; i < listener.count; i++) assertTrue(listener.events[i].type != GESTURE_SWIPE);
+
+    // a quick flick upwards is a swipe, with the velocity in percent of the screen per second
+    listener.count = 0;
+    t = 5000;
+    for(int i = 0; i <= 5; i++, t += 20) recogniser.addSample(GESTURE_POS(0.5F), GESTURE_POS(0.8F - (i * 0.1F)), true, t);
+    recogniser.addSample(0, 0, false, t);
+    assertEqual(GESTURE_DRAG_END, listener.last().type);
+    auto& swipe = listener.events[listener.count - 2];
+    assertEqual(GESTURE_SWIPE, swipe.type);
+    assertEqual(SWIPE_UP, swipe.direction);
+    assertNear(500.0F, (float)swipe.velocity, 10.0F);
+}
+
+test(testAffineCalibrationSolvesRotatedSkewedPanel) {
+    // a panel that is scaled, offset and skewed, with the targets drawn in landscape
+    TouchAffineMatrix panel = { 78643, 6554, -6554, -3277, 81920, -7864 };
+    TouchAffineMatrix toScreen = touchRotationMatrix(TouchInterrogator::LANDSCAPE).combinedWith(panel);
+    TouchCalibrationPoint points[5];
+    const float rawPositions[5][2] = { {0.2F, 0.2F}, {0.8F, 0.25F}, {0.75F, 0.8F}, {0.25F, 0.7F}, {0.5F, 0.5F} };
+    for(int i = 0; i < 5; i++) {
+        points[i].rawX = analogFixedFromFloat(rawPositions[i][0]);
+        points[i].rawY = analogFixedFromFloat(rawPositions[i][1]);
+        toScreen.apply(points[i].rawX, points[i].rawY, points[i].screenX, points[i].screenY);
+    }
+
+    TouchAffineMatrix solved;
+    assertTrue(solveTouchCalibration(points, 5, TouchInterrogator::LANDSCAPE, solved));
+    assertNear(float(panel.a), float(solved.a), 20.0F);
+    assertNear(float(panel.b), float(solved.b), 20.0F);
+    assertNear(float(panel.c), float(solved.c), 20.0F);
+    assertNear(float(panel.d), float(solved.d), 20.0F);
+    assertNear(float(panel.e), float(solved.e), 20.0F);
+    assertNear(float(panel.f), float(solved.f), 20.0F);
+
+    // points in a line cannot be solved
+    points[1] = points[0];
+    points[2] = points[0];
+    assertFalse(solveTouchCalibration(points, 3, TouchInterrogator::RAW, solved));
+}
+
+test(testAffineCalibrationFoldsRotationAndPersists) {
+    // a three point routine where the raw readings match the targets gives an identity calibration
+    TouchCalibrationRoutine routine(false);
+    assertEqual((uint8_t)3, routine.getPointCount());
+    for(uint8_t i = 0; i < 2; i++) routine.setRawReading(i, routine.getTargetX(i), routine.getTargetY(i));
+    assertFalse(routine.isComplete());
+    routine.setRawReading(2, routine.getTargetX(2), routine.getTargetY(2));
+    assertTrue(routine.isComplete());
+    TouchAffineMatrix panel;
+    assertTrue(routine.solve(TouchInterrogator::RAW, panel));
+    assertNear(float(TOUCH_AFFINE_ONE), float(panel.a), 20.0F);
+    assertNear(0.0F, float(panel.b), 20.0F);
+
+    // before any affine calibration is set, changing rotation combines it with an identity panel matrix
+    CalibrationHandler calibrator;
+    analogfixed_t x, y;
+    assertEqual((int32_t)TOUCH_AFFINE_ONE, calibrator.getAffineCalibration().a);
+    calibrator.setAffineRotation(touchRotationMatrix(TouchInterrogator::RAW));
+    calibrator.calibrateAffine(analogFixedFromFloat(0.2F), analogFixedFromFloat(0.7F), x, y);
+    assertNear(0.2F, analogFixedToFloat(x), 0.002F);
+    assertNear(0.7F, analogFixedToFloat(y), 0.002F);
+
+    // the rotation is applied by the same matrix, portrait inverts both axes and landscape swaps them
+    calibrator.setAffineCalibration(panel, touchRotationMatrix(TouchInterrogator::PORTRAIT));
+    assertTrue(calibrator.isAffineEnabled());
+    calibrator.calibrateAffine(analogFixedFromFloat(0.2F), analogFixedFromFloat(0.7F), x, y);
+    assertNear(0.8F, analogFixedToFloat(x), 0.002F);
+    assertNear(0.3F, analogFixedToFloat(y), 0.002F);
+    calibrator.setAffineRotation(touchRotationMatrix(TouchInterrogator::LANDSCAPE));
+    calibrator.calibrateAffine(analogFixedFromFloat(0.2F), analogFixedFromFloat(0.7F), x, y);
+    assertNear(0.3F, analogFixedToFloat(x), 0.002F);
+    assertNear(0.2F, analogFixedToFloat(y), 0.002F);
+
+    // and the calibration can be saved and loaded again
+    MockEepromAbstraction rom(64);
+    TouchAffineMatrix loaded = TouchAffineMatrix::identity();
+    assertFalse(loadTouchCalibration(&rom, 10, loaded));
+    saveTouchCalibration(&rom, 10, calibrator.getAffineCalibration());
+    assertTrue(loadTouchCalibration(&rom, 10, loaded));
+    assertEqual(panel.a, loaded.a);
+    assertEqual(panel.f, loaded.f);
+}